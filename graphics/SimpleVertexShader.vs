@@ -1,7 +1,11 @@
 #version 330 core
 in vec3 aPos;
 in vec4 aColor;
+#ifdef OCT_NORMALS
+in vec2 aNormal;
+#else
 in vec3 aNormal;
+#endif
 in vec2 aUV;
 
 // Output data ; will be interpolated for each fragment.
@@ -14,17 +18,44 @@ out vec3 FragPos;
 // Values that stay constant for the whole mesh.
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
+
+// Per object model and normal matrices computed on the CPU (xlTransformBatch),
+// 7 texels per object: model columns then normal matrix columns.
+uniform samplerBuffer objectTransforms;
+uniform int objectBase;
+
+#ifdef OCT_NORMALS
+// inverse of EncodeOctahedral in ogl.cpp
+vec3 decodeOct(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+#endif
 
 void main()
 {
+	int base = (objectBase + gl_InstanceID) * 7;
+	mat4 model = mat4(texelFetch(objectTransforms, base),
+	                  texelFetch(objectTransforms, base + 1),
+	                  texelFetch(objectTransforms, base + 2),
+	                  texelFetch(objectTransforms, base + 3));
+	mat3 normalMatrix = mat3(texelFetch(objectTransforms, base + 4).xyz,
+	                         texelFetch(objectTransforms, base + 5).xyz,
+	                         texelFetch(objectTransforms, base + 6).xyz);
+
 	FragPos = vec3(model * vec4(aPos, 1.0));
     gl_Position = projection * view * vec4(FragPos, 1.0);
 
 	ourColor = aColor;
-	// Ineffecient for the shader to compute inverse for every vertex.
-	// Move to CPU
-    ourNormal = mat3(transpose(inverse(model))) * aNormal;
+#ifdef OCT_NORMALS
+    ourNormal = normalMatrix * decodeOct(aNormal);
+#else
+    ourNormal = normalMatrix * aNormal;
+#endif
 	// ourNormal = aNormal;  
 	//UV = aUV;
 }
@@ -0,0 +1,61 @@
+#version 330 core
+in vec3 aPos;
+in vec4 aColor;
+in vec3 aNormal;
+// up to four bones per vertex, see xlSkinningBatch::SetupAttributes
+in uvec4 aBoneIDs;
+in vec4 aWeights;
+
+// Output data ; will be interpolated for each fragment.
+flat out vec4 ourColor;
+flat out vec3 ourNormal;
+out vec3 FragPos;
+
+// Values that stay constant for the whole mesh.
+uniform mat4 projection;
+uniform mat4 view;
+
+// Per object model and normal matrices, as in SimpleVertexShader.vs
+uniform samplerBuffer objectTransforms;
+uniform int objectBase;
+
+// Skinning matrices from xlSkinningBatch, 3 texels (matrix rows) per bone.
+// Instance i uses the rig starting at boneBase + i * bonesPerInstance.
+uniform samplerBuffer boneMatrices;
+uniform int boneBase;
+uniform int bonesPerInstance;
+
+void main()
+{
+	int base = (objectBase + gl_InstanceID) * 7;
+	mat4 model = mat4(texelFetch(objectTransforms, base),
+	                  texelFetch(objectTransforms, base + 1),
+	                  texelFetch(objectTransforms, base + 2),
+	                  texelFetch(objectTransforms, base + 3));
+	mat3 normalMatrix = mat3(texelFetch(objectTransforms, base + 4).xyz,
+	                         texelFetch(objectTransforms, base + 5).xyz,
+	                         texelFetch(objectTransforms, base + 6).xyz);
+
+	// blend the bone rows first, then transform once
+	int rig = boneBase + gl_InstanceID * bonesPerInstance;
+	vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+	for (int i = 0; i < 4; i++) {
+		float w = aWeights[i];
+		if (w > 0.0) {
+			int t = (rig + int(aBoneIDs[i])) * 3;
+			r0 += w * texelFetch(boneMatrices, t);
+			r1 += w * texelFetch(boneMatrices, t + 1);
+			r2 += w * texelFetch(boneMatrices, t + 2);
+		}
+	}
+	vec4 p = vec4(aPos, 1.0);
+	vec3 skinned = vec3(dot(r0, p), dot(r1, p), dot(r2, p));
+	// the bone rotation part, bones are expected to be close to uniformly scaled
+	vec3 skinnedNormal = vec3(dot(r0.xyz, aNormal), dot(r1.xyz, aNormal), dot(r2.xyz, aNormal));
+
+	FragPos = vec3(model * vec4(skinned, 1.0));
+	gl_Position = projection * view * vec4(FragPos, 1.0);
+
+	ourColor = aColor;
+	ourNormal = normalMatrix * skinnedNormal;
+}
@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
 #include "ogl.h"
+#include "xlShaderCache.h"
+#include "xlMeshOptimizer.h"
+#include "xlMeshSimplifier.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb/stb_image.h"
@@ -190,6 +195,54 @@ glm::vec3 pyramidPositions[] = {
     glm::vec3(-1.3f,  1.0f, -1.5f)
 };
 
+// Where the skinned columns stand, drawn after the cube
+glm::vec3 armPositions[] = {
+    glm::vec3(-3.0f, -1.5f, -4.0f),
+    glm::vec3( 3.0f, -1.5f, -4.0f)
+};
+
+// A square column two units tall with a bone in each half. The bottom ring
+// follows the lower bone, the top ring the upper one, and the rings between
+// blend so the column bends smoothly at the joint.
+static void BuildArm(std::vector<SkinnedVertex>& vertices)
+{
+    const int rings = 5;
+    const float half = 0.2f;
+    const glm::vec2 corners[] = { {-half, -half}, {half, -half}, {half, half}, {-half, half} };
+    const glm::vec4 color(0.3f, 0.6f, 1.0f, 1.0f);
+
+    auto vertex = [&](const glm::vec2& c, int ring, const glm::vec3& normal) {
+        SkinnedVertex v;
+        float y = ring * 2.0f / (rings - 1);
+        v.position = glm::vec3(c.x, y, c.y);
+        v.color = color;
+        v.normal = normal;
+        float upper = std::clamp(y - 0.5f, 0.0f, 1.0f);
+        v.boneIDs[0] = 0;
+        v.boneIDs[1] = 1;
+        v.boneIDs[2] = v.boneIDs[3] = 0;
+        v.weights[1] = (GLubyte)std::lround(upper * 255.0f);
+        v.weights[0] = 255 - v.weights[1];
+        v.weights[2] = v.weights[3] = 0;
+        vertices.push_back(v);
+    };
+    for (int side = 0; side < 4; ++side)
+    {
+        const glm::vec2& a = corners[side];
+        const glm::vec2& b = corners[(side + 1) % 4];
+        glm::vec3 normal = glm::normalize(glm::vec3(a.x + b.x, 0.0f, a.y + b.y));
+        for (int r = 0; r + 1 < rings; ++r)
+        {
+            vertex(a, r, normal);
+            vertex(b, r, normal);
+            vertex(b, r + 1, normal);
+            vertex(b, r + 1, normal);
+            vertex(a, r + 1, normal);
+            vertex(a, r, normal);
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 // Shaders
 // ----------------------------------------------------------------------------
@@ -406,9 +459,69 @@ void myLight::Set(const glm::vec3& position, GLfloat intensity,
 // ----------------------------------------------------------------------------
 // OGLMesh
 // ----------------------------------------------------------------------------
+// Round to nearest even float to half conversion
+static GLushort FloatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+
+    if ( ((x >> 23) & 0xff) == 0xff ) // inf and nan
+        return (GLushort)(sign | 0x7c00 | (mant ? 0x200 : 0));
+    if ( exp >= 31 )
+        return (GLushort)(sign | 0x7c00);
+    if ( exp <= 0 )
+    {
+        // subnormal or zero
+        if ( exp < -10 )
+            return (GLushort)sign;
+        mant |= 0x800000;
+        uint32_t shift = 14 - exp;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if ( rem > halfway || (rem == halfway && (h & 1)) )
+            h++;
+        return (GLushort)(sign | h);
+    }
+    uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fff;
+    // a carry out of the mantissa correctly bumps the exponent
+    if ( rem > 0x1000 || (rem == 0x1000 && (h & 1)) )
+        h++;
+    return (GLushort)(sign | h);
+}
+
+// Octahedral normal encoding: project on the octahedron |x|+|y|+|z| = 1 and
+// fold the lower half over the upper one. Decoded by decodeOct in the shader.
+static void EncodeOctahedral(const glm::vec3& n, GLshort out[2])
+{
+    float l = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if ( l <= 0.0f )
+    {
+        out[0] = out[1] = 0;
+        return;
+    }
+    float x = n.x / l;
+    float y = n.y / l;
+    if ( n.z < 0.0f )
+    {
+        float ox = x;
+        x = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    out[0] = (GLshort)std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (GLshort)std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f);
+}
+
 OGLMesh::OGLMesh()
 {
     _VAO = _VBO = _EBO = 0;
+    _indexType = GL_UNSIGNED_INT;
+    _compact = false;
+    _lod = 0;
 }
 
 OGLMesh::~OGLMesh()
@@ -459,11 +572,89 @@ void OGLMesh::SetBuffers(Shader& shader,
         for (int i = 0; i < numFaces * 3; ++i) {
             _indices.push_back(indices[i]);
         }
+        OptimizeOrder();
+        BuildLODs();
     }
 
     SetupMesh(shader);
 }
 
+// Reorder the triangles for the vertex cache and the vertices for fetching,
+// as they come from modeling tools the order is usually poor
+void OGLMesh::OptimizeOrder()
+{
+    if ( _indices.size() < 6 || _vertices.empty() )
+        return;
+
+    const size_t stride = sizeof(Vertex) / sizeof(float);
+    xlMeshOptimizer::CacheStats before =
+        xlMeshOptimizer::AnalyzeVertexCache(&_indices[0], _indices.size(), _vertices.size());
+
+    xlMeshOptimizer::OptimizeTriangles(&_indices[0], _indices.size() - _indices.size() % 3,
+                                       &_vertices[0].position.x, stride, _vertices.size());
+    std::vector<uint32_t> remap;
+    xlMeshOptimizer::OptimizeVertexFetch(&_indices[0], _indices.size(), _vertices.size(), remap);
+    xlMeshOptimizer::RemapVertices(_vertices, 1, remap);
+
+    xlMeshOptimizer::CacheStats after =
+        xlMeshOptimizer::AnalyzeVertexCache(&_indices[0], _indices.size(), _vertices.size());
+
+    std::ostringstream msg;
+    msg << "Mesh of " << _indices.size() / 3 << " triangles: ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr;
+    OnGLError(OGL_ERR_JUSTLOG, msg.str().c_str());
+}
+
+// Up to three simplified levels, each about half of the previous one, appended
+// to _indices. A level that can't get below 80% of the previous ends the list.
+void OGLMesh::BuildLODs()
+{
+    _lods.clear();
+    _lod = 0;
+    if ( _indices.size() < 3 || _vertices.empty() )
+        return;
+    size_t fullCount = _indices.size() - _indices.size() % 3;
+    _lods.push_back({ 0, fullCount, 0.0f });
+
+    const size_t stride = sizeof(Vertex) / sizeof(float);
+    const float* positions = &_vertices[0].position.x;
+    // beyond 5% of the size the shape is lost anyway
+    float maxError = 0.05f * xlMeshSimplifier::GetExtent(positions, stride, _vertices.size());
+
+    std::vector<uint32_t> level(fullCount);
+    for (int l = 1; l < 4; ++l)
+    {
+        const LOD& prev = _lods.back();
+        float error = 0.0f;
+        size_t count = xlMeshSimplifier::Simplify(&level[0], &_indices[prev.start], prev.count,
+                                                  positions, stride, _vertices.size(),
+                                                  prev.count / 2, maxError, &error);
+        if ( count == 0 || count > prev.count * 4 / 5 )
+            break;
+        xlMeshOptimizer::OptimizeVertexCache(&level[0], count, _vertices.size());
+
+        LOD lod = { _indices.size(), count, std::max(error, prev.error) };
+        _indices.insert(_indices.end(), level.begin(), level.begin() + count);
+        _lods.push_back(lod);
+
+        std::ostringstream msg;
+        msg << "Mesh LOD " << l << ": " << count / 3 << " triangles, error " << lod.error;
+        OnGLError(OGL_ERR_JUSTLOG, msg.str().c_str());
+    }
+}
+
+size_t OGLMesh::SelectLOD(float pixelsPerUnit, float maxPixelError) const
+{
+    size_t level = 0;
+    for (size_t l = 1; l < _lods.size(); ++l)
+    {
+        if ( _lods[l].error * pixelsPerUnit > maxPixelError )
+            break;
+        level = l;
+    }
+    return level;
+}
+
 void OGLMesh::SetupMesh(Shader& shader)
 {
     OnGLError(OGL_ERR_CLEAR);
@@ -476,32 +667,74 @@ void OGLMesh::SetupMesh(Shader& shader)
     glBindVertexArray(_VAO);
     // load data into vertex buffers
     glBindBuffer(GL_ARRAY_BUFFER, _VBO);
-    // A great thing about structs is that their memory layout is sequential for all its items.
-    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-    // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), &_vertices[0], GL_STATIC_DRAW);  
+    GLsizei stride = sizeof(Vertex);
+    if ( _compact )
+    {
+        std::vector<PackedVertex> packed(_vertices.size());
+        for (size_t i = 0; i < _vertices.size(); ++i)
+        {
+            const Vertex& v = _vertices[i];
+            PackedVertex& p = packed[i];
+            p.position[0] = FloatToHalf(v.position.x);
+            p.position[1] = FloatToHalf(v.position.y);
+            p.position[2] = FloatToHalf(v.position.z);
+            p.position[3] = FloatToHalf(1.0f);
+            for (int c = 0; c < 4; ++c)
+                p.color[c] = (GLubyte)std::lround(std::clamp(v.color[c], 0.0f, 1.0f) * 255.0f);
+            EncodeOctahedral(v.normal, p.normal);
+        }
+        stride = sizeof(PackedVertex);
+        glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        // A great thing about structs is that their memory layout is sequential for all its items.
+        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+        // again translates to 3/2 floats which translates to a byte array.
+        glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), _vertices.data(), GL_STATIC_DRAW);
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned int), &_indices[0], GL_STATIC_DRAW);
+    // Half the index bandwidth when the vertex count allows it
+    if ( _vertices.size() <= 65536 )
+    {
+        std::vector<GLushort> shortIndices(_indices.begin(), _indices.end());
+        _indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        _indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned int), _indices.data(), GL_STATIC_DRAW);
+    }
 
     // set the vertex attribute pointers
     // vertex positions
     GLuint loc = shader.GetAttribLoc("aPos");
     if (loc != -1) {
         glEnableVertexAttribArray(loc);	
-        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        if ( _compact )
+            glVertexAttribPointer(loc, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, position));
+        else
+            glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
     }
     // vertex colors
     loc = shader.GetAttribLoc("aColor");
     if (loc != -1) {
         glEnableVertexAttribArray(loc);	
-        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+        if ( _compact )
+            glVertexAttribPointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PackedVertex, color));
+        else
+            glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, color));
     }
     // vertex normals
     loc = shader.GetAttribLoc("aNormal");
     if (loc != -1) {
         glEnableVertexAttribArray(loc);	
-        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        if ( _compact )
+            glVertexAttribPointer(loc, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+        else
+            glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, normal));
     }
     // // vertex texture coords
     // loc = shader.GetAttribLoc("aUV");
@@ -509,6 +742,12 @@ void OGLMesh::SetupMesh(Shader& shader)
     //     glEnableVertexAttribArray(loc);	
     //     glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
     // }
+
+    std::ostringstream msg;
+    msg << "Mesh of " << _vertices.size() << " vertices uploaded, "
+        << _vertices.size() * stride << " bytes of vertices, "
+        << (_indexType == GL_UNSIGNED_SHORT ? 16 : 32) << " bit indices";
+    OnGLError(OGL_ERR_JUSTLOG, msg.str().c_str());
 }
 // void OGLMesh::SetBuffers(Shader* theShader,
 //                                 GLsizei numPoints, GLsizei numFaces,
@@ -658,7 +897,7 @@ void OGLMesh::Draw(bool useIndices)
     //glDrawArrays(GL_TRIANGLES, 0, 36);
     //glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, (GLvoid *)0);
     if (useIndices) {
-        glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, (GLvoid *)0);
+        glDrawElements(GL_TRIANGLES, IndexCount(), _indexType, IndexOffset());
     } else {
         glDrawArrays(GL_TRIANGLES, 0, _vertices.size());
     }    
@@ -666,6 +905,94 @@ void OGLMesh::Draw(bool useIndices)
     glBindVertexArray(0);
 }
 
+void OGLMesh::DrawInstanced(GLsizei count, bool useIndices)
+{
+    if ( !_VAO || count <= 0 )
+        return;
+
+    glBindVertexArray(_VAO);
+    if (useIndices) {
+        glDrawElementsInstanced(GL_TRIANGLES, IndexCount(), _indexType, IndexOffset(), count);
+    } else {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, _vertices.size(), count);
+    }
+    OnGLError(OGL_ERR_DRAWING_TRI);
+    glBindVertexArray(0);
+}
+
+
+// ----------------------------------------------------------------------------
+// OGLSkinnedMesh
+// ----------------------------------------------------------------------------
+OGLSkinnedMesh::OGLSkinnedMesh()
+{
+    _VAO = _VBO = 0;
+    _numVertices = 0;
+}
+
+OGLSkinnedMesh::~OGLSkinnedMesh()
+{
+    Clear();
+}
+
+void OGLSkinnedMesh::Clear()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if ( _VBO )
+        glDeleteBuffers(1, &_VBO);
+    glBindVertexArray(0);
+    if ( _VAO )
+        glDeleteVertexArrays(1, &_VAO);
+    _VAO = _VBO = 0;
+    _numVertices = 0;
+}
+
+void OGLSkinnedMesh::SetBuffers(Shader& shader, const std::vector<SkinnedVertex>& vertices)
+{
+    OnGLError(OGL_ERR_CLEAR);
+    Clear();
+    if ( vertices.empty() )
+        return;
+
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_VBO);
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinnedVertex), vertices.data(), GL_STATIC_DRAW);
+    _numVertices = (GLsizei)vertices.size();
+
+    GLsizei stride = sizeof(SkinnedVertex);
+    GLuint loc = shader.GetAttribLoc("aPos");
+    if ( loc != (GLuint)-1 ) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(SkinnedVertex, position));
+    }
+    loc = shader.GetAttribLoc("aColor");
+    if ( loc != (GLuint)-1 ) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(SkinnedVertex, color));
+    }
+    loc = shader.GetAttribLoc("aNormal");
+    if ( loc != (GLuint)-1 ) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(SkinnedVertex, normal));
+    }
+    xlSkinningBatch::SetupAttributes(shader, stride, offsetof(SkinnedVertex, boneIDs), offsetof(SkinnedVertex, weights));
+    glBindVertexArray(0);
+
+    OnGLError(OGL_ERR_BUFFER);
+}
+
+void OGLSkinnedMesh::DrawInstanced(GLsizei count)
+{
+    if ( !_VAO || count <= 0 )
+        return;
+
+    glBindVertexArray(_VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, _numVertices, count);
+    OnGLError(OGL_ERR_DRAWING_TRI);
+    glBindVertexArray(0);
+}
 
 // // ----------------------------------------------------------------------------
 // // myOGLString
@@ -970,6 +1297,13 @@ void myOGLCamera::GetViewAndProjection(mat4* view, mat4* proj) {
     *proj = glm::perspective(glm::radians(_fov), _aspect, 0.1, 100.0);
 }
 
+float myOGLCamera::GetPixelsPerUnit(const glm::vec3& point) const
+{
+    // distance along the view direction, that is what the projection divides by
+    float depth = std::max(glm::dot(point - _camPosition, _camFront), 0.1f);
+    return (float)(_winHeight / (2.0 * tan(glm::radians(_fov) * 0.5) * depth));
+}
+
 void myOGLCamera::UpdateCameraPosition() {
     float deltaPos = _deltaT/1000.0f * _camMovementSpeed;
     if (_motion.forward)
@@ -1086,10 +1420,13 @@ void myOGLManager::SetShadersAndTriangles()
     // _pyramidShaders.AddAttrib("aUV");
     _pyramidShaders.AddUnif("projection");
     _pyramidShaders.AddUnif("view");
-    _pyramidShaders.AddUnif("model");
+    _pyramidShaders.AddUnif("objectTransforms");
+    _pyramidShaders.AddUnif("objectBase");
     _pyramidShaders.AddUnif("lightColor");
     _pyramidShaders.AddUnif("lightPos");
     _pyramidShaders.AddUnif("viewPos");
+    // the pyramids and the cube use the compact vertex layout
+    _pyramidShaders.AddDefine("OCT_NORMALS");
     _pyramidShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/SimpleVertexShader.vs", GL_VERTEX_SHADER);
     _pyramidShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/SimpleFragmentShader.fs", GL_FRAGMENT_SHADER);
     _pyramidShaders.Init();
@@ -1099,6 +1436,25 @@ void myOGLManager::SetShadersAndTriangles()
     _lightCubeShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/LightCube.vs", GL_VERTEX_SHADER);
     _lightCubeShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/LightCube.fs", GL_FRAGMENT_SHADER);
     _lightCubeShaders.Init();
+    _skinnedShaders.AddAttrib("aPos");
+    _skinnedShaders.AddAttrib("aColor");
+    _skinnedShaders.AddAttrib("aNormal");
+    _skinnedShaders.AddAttrib("aBoneIDs");
+    _skinnedShaders.AddAttrib("aWeights");
+    _skinnedShaders.AddUnif("projection");
+    _skinnedShaders.AddUnif("view");
+    _skinnedShaders.AddUnif("objectTransforms");
+    _skinnedShaders.AddUnif("objectBase");
+    _skinnedShaders.AddUnif("boneMatrices");
+    _skinnedShaders.AddUnif("boneBase");
+    _skinnedShaders.AddUnif("bonesPerInstance");
+    _skinnedShaders.AddUnif("lightColor");
+    _skinnedShaders.AddUnif("lightPos");
+    _skinnedShaders.AddUnif("viewPos");
+    _skinnedShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/SkinnedVertexShader.vs", GL_VERTEX_SHADER);
+    _skinnedShaders.LoadCode("/Users/chrisschilling/wxwidget/graphics/SimpleFragmentShader.fs", GL_FRAGMENT_SHADER);
+    _skinnedShaders.Init();
+    OnGLError(OGL_ERR_JUSTLOG, xlShaderCache::GetStatistics().c_str());
     // _StringShaders.AddAttrib("in_sPosition");
     // _StringShaders.AddAttrib("in_sNormal");
     // _StringShaders.AddAttrib("in_TextPos");
@@ -1125,9 +1481,54 @@ void myOGLManager::SetShadersAndTriangles()
     // The triangles data
     // _LightCubeMesh.SetBuffers(&_LightCubeShaders, 36, 12, lightCubevVertices, nullptr, nullptr, nullptr, nullptr);
     // _LightCubeMesh.AddPosition(vec3(1.2f, 1.0f, 2.0f));
+    _pyramidMesh.SetCompact(true);
+    _cubeMesh.SetCompact(true);
+    _lightCubeMesh.SetCompact(true);
     _pyramidMesh.SetBuffers(_pyramidShaders, 4, 4, gVerts, gColors, gNormals, gUV, gIndices);
     _cubeMesh.SetBuffers(_pyramidShaders, 36, 6, cubeVerts, cubeColors, cubeNorms, nullptr, nullptr);
     _lightCubeMesh.SetBuffers(_lightCubeShaders, 36, 6, cubeVerts, nullptr, nullptr, nullptr, nullptr);
+
+    // The arms: a lower bone at the base and an upper one at the joint, the
+    // clip swings the upper bone back and forth over one second
+    std::vector<SkinnedVertex> armVertices;
+    BuildArm(armVertices);
+    _armMesh.SetBuffers(_skinnedShaders, armVertices);
+
+    _armSkeleton = xlSkeleton();
+    xlSkeleton::Bone lower;
+    lower.name = "lower";
+    int lowerIdx = _armSkeleton.AddBone(lower);
+    xlSkeleton::Bone upper;
+    upper.name = "upper";
+    upper.parent = lowerIdx;
+    upper.position = glm::vec3(0.0f, 1.0f, 0.0f);
+    upper.inverseBind = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    _armSkeleton.AddBone(upper);
+    _armSkeleton.Flatten();
+
+    const size_t waveFrames = 25;
+    _armWave.reset(new xlAnimationClip(_armSkeleton, 24.0f, waveFrames));
+    int upperBone = _armSkeleton.GetBoneIndex("upper");
+    for (size_t f = 0; f < waveFrames; ++f)
+    {
+        float angle = glm::radians(60.0f) * std::sin(f * glm::radians(360.0f) / (waveFrames - 1));
+        _armWave->SetKey(f, upperBone, upper.position,
+                         glm::vec4(0.0f, 0.0f, std::sin(angle / 2.0f), std::cos(angle / 2.0f)));
+    }
+    _skinning.Clear();
+    for (size_t i = 0; i < sizeof(armPositions) / sizeof(armPositions[0]); ++i)
+        _skinning.AddRig(&_armSkeleton);
+
+    // The scene objects, in the same order as their transforms in Render()
+    _scene.Clear();
+    xlBounds pyramidBounds = xlBounds::FromPoints(gVerts, 4);
+    for (size_t i = 0; i < sizeof(pyramidPositions) / sizeof(pyramidPositions[0]); ++i)
+        _scene.AddObject(pyramidBounds);
+    _scene.AddObject(xlBounds::FromPoints(cubeVerts, 36));
+    // anywhere the upper half can swing to
+    xlBounds armBounds(glm::vec3(-1.5f, -0.5f, -0.5f), glm::vec3(1.5f, 2.5f, 0.5f));
+    for (size_t i = 0; i < sizeof(armPositions) / sizeof(armPositions[0]); ++i)
+        _scene.AddObject(armBounds);
 }
 
 // void myOGLManager::SetStringOnPyr(const unsigned char* strImage, int iWidth, int iHeigh)
@@ -1208,43 +1609,113 @@ void myOGLManager::Render()
     lightPos.y = sin(_frameCnt*.021 / 2.0f) * 1.0f;
     vec3 lightColor(1.0f, 1.0f, 1.0f);
 
-    if ( ! _pyramidShaders.Use() )
-        OnGLError(OGL_ERR_DRAWING_TRI);
+    // All the object matrices at once, the pyramids first, then the cube and
+    // the arms
+    const int numPyramids = 10;
+    const int firstArm = numPyramids + 1;
+    const int numArms = sizeof(armPositions) / sizeof(armPositions[0]);
+    _objectTransforms.Resize(firstArm + numArms);
     float angle = 0.0;
-    for (int i = 0; i<10; ++i) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, pyramidPositions[i]);
+    for (int i = 0; i<numPyramids; ++i) {
+        _objectTransforms.SetPosition(i, pyramidPositions[i]);
         angle += 0.6*_frameCnt;
-        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        _objectTransforms.SetRotation(i, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
         angle += 20.0f;
-        glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("projection"), 1, GL_FALSE, &projection[0][0]);
-        glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("view"), 1, GL_FALSE, &view[0][0]);
-        glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("model"), 1, GL_FALSE, &model[0][0]);
-        glUniform3fv(_pyramidShaders.GetUnifLoc("lightColor"), 1, &lightColor[0]);
-        glUniform3fv(_pyramidShaders.GetUnifLoc("lightPos"), 1, &lightPos[0]);
-        glUniform3fv(_pyramidShaders.GetUnifLoc("viewPos"), 1, &(_Camera.GetCameraPosition())[0]);
-
-        // TODO(experiment with flat color interpolation (uses provoking))
-        // We have a flat shading, and we want the first vertex data as the flat value
-        glProvokingVertex(GL_FIRST_VERTEX_CONVENTION);
-        _pyramidMesh.Draw();
     }
+    for (int i = 0; i < numArms; ++i)
+        _objectTransforms.SetPosition(firstArm + i, armPositions[i]);
+    _objectTransforms.Compute();
+
+    // Only the objects in the view frustum are uploaded and drawn.  The visible
+    // list keeps the batch order, so the pyramids come first.
+    _scene.UpdateTransforms(_objectTransforms);
+    _scene.Cull(xlFrustum(projection * view), _visible);
+    int visiblePyramids = 0;
+    while ( visiblePyramids < (int)_visible.size() && _visible[visiblePyramids] < (unsigned int)numPyramids )
+        ++visiblePyramids;
+    bool cubeVisible = visiblePyramids < (int)_visible.size() && _visible[visiblePyramids] == (unsigned int)numPyramids;
+    int visibleArms = visiblePyramids + (cubeVisible ? 1 : 0);
+
+    // Level of detail of each visible pyramid from its distance, grouped by
+    // level so each level is one instanced draw
+    _pyramidLODs.clear();
+    for (int i = 0; i < visiblePyramids; ++i)
+    {
+        size_t lod = _pyramidMesh.SelectLOD(_Camera.GetPixelsPerUnit(pyramidPositions[_visible[i]]));
+        _pyramidLODs.push_back(std::make_pair(lod, _visible[i]));
+    }
+    std::stable_sort(_pyramidLODs.begin(), _pyramidLODs.end(),
+                     [](const std::pair<size_t, unsigned int>& a, const std::pair<size_t, unsigned int>& b) { return a.first < b.first; });
+    for (int i = 0; i < visiblePyramids; ++i)
+        _visible[i] = _pyramidLODs[i].second;
+    _objectTransforms.UploadSubset(_visible);
 
+    const GLuint transformsUnit = 1;
+    _objectTransforms.Bind(transformsUnit);
 
     if ( ! _pyramidShaders.Use() )
         OnGLError(OGL_ERR_DRAWING_TRI);
-    glm::mat4 model = glm::mat4(1.0f);
     glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("projection"), 1, GL_FALSE, &projection[0][0]);
     glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("view"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(_pyramidShaders.GetUnifLoc("model"), 1, GL_FALSE, &model[0][0]);
+    glUniform1i(_pyramidShaders.GetUnifLoc("objectTransforms"), transformsUnit);
     glUniform3fv(_pyramidShaders.GetUnifLoc("lightColor"), 1, &lightColor[0]);
     glUniform3fv(_pyramidShaders.GetUnifLoc("lightPos"), 1, &lightPos[0]);
     glUniform3fv(_pyramidShaders.GetUnifLoc("viewPos"), 1, &(_Camera.GetCameraPosition())[0]);
-    _cubeMesh.Draw(false);
+
+    // TODO(experiment with flat color interpolation (uses provoking))
+    // We have a flat shading, and we want the first vertex data as the flat value
+    glProvokingVertex(GL_FIRST_VERTEX_CONVENTION);
+    for (int first = 0; first < visiblePyramids; ) {
+        int last = first + 1;
+        while ( last < visiblePyramids && _pyramidLODs[last].first == _pyramidLODs[first].first )
+            ++last;
+        glUniform1i(_pyramidShaders.GetUnifLoc("objectBase"), first);
+        _pyramidMesh.SetLOD(_pyramidLODs[first].first);
+        _pyramidMesh.DrawInstanced(last - first);
+        first = last;
+    }
+
+    if ( cubeVisible ) {
+        glUniform1i(_pyramidShaders.GetUnifLoc("objectBase"), visiblePyramids);
+        _cubeMesh.Draw(false);
+    }
+
+    if ( visibleArms < (int)_visible.size() ) {
+        // each arm plays the wave a little behind the previous one
+        for (int i = 0; i < numArms; ++i)
+            _skinning.SetClip(i, _armWave.get(), _frameCnt / 60.0f + i * 0.25f);
+        _skinning.Compute();
+        _skinning.Upload();
+        const GLuint bonesUnit = 2;
+        _skinning.Bind(bonesUnit);
+
+        if ( ! _skinnedShaders.Use() )
+            OnGLError(OGL_ERR_DRAWING_TRI);
+        glUniformMatrix4fv(_skinnedShaders.GetUnifLoc("projection"), 1, GL_FALSE, &projection[0][0]);
+        glUniformMatrix4fv(_skinnedShaders.GetUnifLoc("view"), 1, GL_FALSE, &view[0][0]);
+        glUniform1i(_skinnedShaders.GetUnifLoc("objectTransforms"), transformsUnit);
+        glUniform1i(_skinnedShaders.GetUnifLoc("boneMatrices"), bonesUnit);
+        glUniform1i(_skinnedShaders.GetUnifLoc("bonesPerInstance"), (GLint)_armSkeleton.GetBoneCount());
+        glUniform3fv(_skinnedShaders.GetUnifLoc("lightColor"), 1, &lightColor[0]);
+        glUniform3fv(_skinnedShaders.GetUnifLoc("lightPos"), 1, &lightPos[0]);
+        glUniform3fv(_skinnedShaders.GetUnifLoc("viewPos"), 1, &(_Camera.GetCameraPosition())[0]);
+
+        // rigs are packed in arm order, so a run of visible arms is one
+        // instanced draw starting at the first one's rig
+        for (int first = visibleArms; first < (int)_visible.size(); ) {
+            int last = first + 1;
+            while ( last < (int)_visible.size() && _visible[last] == _visible[last - 1] + 1 )
+                ++last;
+            glUniform1i(_skinnedShaders.GetUnifLoc("objectBase"), first);
+            glUniform1i(_skinnedShaders.GetUnifLoc("boneBase"), (GLint)_skinning.GetBoneBase(_visible[first] - firstArm));
+            _armMesh.DrawInstanced(last - first);
+            first = last;
+        }
+    }
 
     if ( ! _lightCubeShaders.Use() )
         OnGLError(OGL_ERR_DRAWING_TRI);
-    model = glm::mat4(1.0f);
+    glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, lightPos);
     model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
     mat4 mvp = projection * view * model;
@@ -4,6 +4,7 @@
 // Include GLEW
 #include <GL/glew.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -14,6 +15,9 @@ using namespace glm;
 
 #include "ogl_error.h"
 #include "shader.h"
+#include "xlTransformBatch.h"
+#include "xlSceneGraph.h"
+#include "xlAnimation.h"
 
 /*
   ************  NOTES  *******************************************************
@@ -103,6 +107,8 @@ public:
     // Get View and Projection matrices from camera
     void GetViewAndProjection(glm::mat4* view, glm::mat4* proj);
     vec3 GetCameraPosition() { return _camPosition; }
+    // Pixels covered by one world unit at 'point', for level of detail choices
+    float GetPixelsPerUnit(const glm::vec3& point) const;
 
     // Rotates Camera around the world when the timer is active.
     // Not currently used, but could make a good screensaver
@@ -165,6 +171,13 @@ struct Vertex {
     // // texCoords
     // glm::vec2 texCoord;
 };
+// The compact GPU layout of a Vertex, 16 bytes instead of 40. The normal is
+// octahedral encoded, so the shader needs the OCT_NORMALS define to decode it.
+struct PackedVertex {
+    GLushort position[4]; // half floats, the 4th is padding
+    GLubyte color[4];     // RGBA8
+    GLshort normal[2];    // octahedral, snorm16
+};
 //-----------------------------------------------------------------------------
 // An object for triangle meshes.
 class OGLMesh
@@ -184,15 +197,75 @@ public:
                     const GLfloat* norms, const GLfloat* uvs, const unsigned int* indices);
     //Draw the triangles
     void Draw(bool useIndices = true);
+    // Draw 'count' copies, the shader tells them apart with gl_InstanceID
+    void DrawInstanced(GLsizei count, bool useIndices = true);
+    // Upload PackedVertex instead of Vertex, call before SetBuffers
+    void SetCompact(bool compact) { _compact = compact; }
+
+    // Simplified levels of detail built by SetBuffers for indexed meshes,
+    // level 0 is the full mesh. Draw calls use the current level.
+    size_t GetLODCount() const { return _lods.size(); }
+    void SetLOD(size_t level) { _lod = level < _lods.size() ? level : 0; }
+    // The coarsest level whose error stays under maxPixelError pixels, given
+    // how many pixels one mesh unit covers where it is drawn
+    size_t SelectLOD(float pixelsPerUnit, float maxPixelError = 1.0f) const;
 
 private:
     void SetupMesh(Shader& shader);
+    void OptimizeOrder();
+    void BuildLODs();
+    // range of the current level
+    GLsizei IndexCount() const { return _lods.empty() ? (GLsizei)_indices.size() : (GLsizei)_lods[_lod].count; }
+    GLvoid* IndexOffset() const {
+        size_t start = _lods.empty() ? 0 : _lods[_lod].start;
+        return (GLvoid*)(start * (_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+    }
 
     std::vector<Vertex> _vertices;
     std::vector<unsigned int> _indices;
 
     //GLsizei _numFaces;
     GLuint _VAO, _VBO, _EBO;
+    // GL_UNSIGNED_SHORT when all vertices can be addressed with it
+    GLenum _indexType;
+    bool _compact;
+
+    // ranges of _indices, all levels use the same vertices
+    struct LOD {
+        size_t start;
+        size_t count;
+        float error; // in mesh units
+    };
+    std::vector<LOD> _lods;
+    size_t _lod;
+};
+
+//-----------------------------------------------------------------------------
+// A vertex bent by up to four bones of a rig, see SkinnedVertexShader.vs
+struct SkinnedVertex {
+    glm::vec3 position;
+    glm::vec4 color;
+    glm::vec3 normal;
+    GLubyte boneIDs[4];
+    GLubyte weights[4]; // normalized, adding up to 255
+};
+
+// Unindexed triangles drawn with SkinnedVertexShader.vs, the bones come from
+// an xlSkinningBatch bound by the caller
+class OGLSkinnedMesh
+{
+public:
+    OGLSkinnedMesh();
+    ~OGLSkinnedMesh();
+
+    void Clear();
+    void SetBuffers(Shader& shader, const std::vector<SkinnedVertex>& vertices);
+    // Draw 'count' copies, each with its own rig, see bonesPerInstance
+    void DrawInstanced(GLsizei count);
+
+private:
+    GLuint _VAO, _VBO;
+    GLsizei _numVertices;
 };
 
 //-----------------------------------------------------------------------------
@@ -281,6 +354,7 @@ private:
 
     Shader   _pyramidShaders;
     Shader   _lightCubeShaders;
+    Shader   _skinnedShaders;
     // Shader   _StringShaders;
     // Shader   _ImmutStringSha;
 
@@ -288,6 +362,20 @@ private:
     OGLMesh    _cubeMesh;
     OGLMesh    _lightCubeMesh;
 
+    // Columns bending at the middle, one rig each
+    OGLSkinnedMesh _armMesh;
+    xlSkeleton     _armSkeleton;
+    std::unique_ptr<xlAnimationClip> _armWave;
+    xlSkinningBatch _skinning;
+
+    // Model and normal matrices of the pyramids, the cube and the arms
+    xlTransformBatch _objectTransforms;
+    // Their bounds, to draw only what the camera sees
+    xlSceneGraph     _scene;
+    std::vector<unsigned int> _visible;
+    // level of detail and object index of the visible pyramids
+    std::vector<std::pair<size_t, unsigned int>> _pyramidLODs;
+
     unsigned long _frameCnt;
 };
 
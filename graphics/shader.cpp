@@ -4,6 +4,7 @@
 
 #include "ogl_error.h"
 #include "shader.h"
+#include "xlShaderCache.h"
 
 Shader::Shader()
 {
@@ -33,6 +34,34 @@ void Shader::AddCode(std::string& shaString, GLenum shaType)
     _shaCode.push_back(sv);
 }
 
+void Shader::AddDefine(const std::string& name)
+{
+    _defines.push_back(name);
+}
+
+// GLSL requires #version to come first, so the defines go right after it
+void Shader::InsertDefines()
+{
+    if ( _defines.empty() )
+        return;
+
+    std::string defs;
+    for (std::vector<std::string>::iterator it = _defines.begin(); it != _defines.end(); ++it)
+        defs += "#define " + *it + "\n";
+
+    for (shaShas_v::iterator it = _shaCode.begin(); it != _shaCode.end(); ++it)
+    {
+        size_t pos = 0;
+        if ( it->scode.compare(0, 8, "#version") == 0 )
+        {
+            pos = it->scode.find('\n');
+            pos = pos == std::string::npos ? it->scode.size() : pos + 1;
+        }
+        it->scode.insert(pos, defs);
+    }
+    _defines.clear();
+}
+
 bool Shader::LoadCode(const char* path, GLenum shaType) {
 
 	// Read the Vertex Shader code from the file
@@ -127,7 +156,43 @@ GLuint Shader::GetUnifLoc(const std::string& name)
 void Shader::Init()
 {
     OnGLError(OGL_ERR_CLEAR); //clear error stack
+    InsertDefines();
+
+    // The attribute names are part of the key because their bound locations
+    // are baked into the linked binary
+    std::vector<std::string> keyParts;
+    for (shaShas_v::iterator it = _shaCode.begin(); it != _shaCode.end(); ++it)
+        keyParts.push_back(std::to_string(it->typeSha) + ":" + it->scode);
+    for (shaVars_v::iterator it = _shaAttrib.begin(); it != _shaAttrib.end(); ++it)
+        keyParts.push_back(it->name);
+    std::string cacheKey = xlShaderCache::MakeKey(keyParts);
+
+    _proId = xlShaderCache::Load(cacheKey);
+    if ( _proId )
+    {
+        // Locations were bound when the cached binary was linked, we only
+        // need our copy of them
+        SetAttribLocations();
+        OnGLError(OGL_ERR_JUSTLOG, "Shaders loaded from the program cache.");
+    }
+    else if ( !CompileAndLink() )
+        return;
+    else
+    {
+        xlShaderCache::Store(cacheKey, _proId);
+        // Log that shaders are OK
+        OnGLError(OGL_ERR_JUSTLOG, "Shaders successfully compiled and linked.");
+    }
 
+    // After linking, we can get locations for uniforms
+    _SHAinitializated = AskUnifLocations();
+    if ( !_SHAinitializated )
+        OnGLError(OGL_ERR_SHADERLOCATION, " Unused or unrecognized uniform.");
+}
+
+// Compile the GLSL code and link it into _proId
+bool Shader::CompileAndLink()
+{
     bool resC = false;
     bool resL = false;
 
@@ -154,6 +219,7 @@ void Shader::Init()
         }
 
         SetAttribLocations(); //Before linking
+        xlShaderCache::PrepareForLink(_proId);
 
         resL = LinkProg(_proId);
     }
@@ -168,16 +234,7 @@ void Shader::Init()
         glDeleteShader(it->shaId);
     }
 
-    if ( !resC || !resL )
-        return;
-
-    // Log that shaders are OK
-    OnGLError(OGL_ERR_JUSTLOG, "Shaders successfully compiled and linked.");
-
-    // After linking, we can get locations for uniforms
-    _SHAinitializated = AskUnifLocations();
-    if ( !_SHAinitializated )
-        OnGLError(OGL_ERR_SHADERLOCATION, " Unused or unrecognized uniform.");
+    return resC && resL;
 }
 
 // Useful while developing: show shader compilation errors
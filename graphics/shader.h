@@ -36,6 +36,8 @@ public:
   void CleanUp();
 
   void AddCode(std::string &shaString, GLenum shaType);
+  // "#define name" for every shader, inserted after their #version line
+  void AddDefine(const std::string &name);
   bool LoadCode(const char *path, GLenum shaType);
   void AddAttrib(const std::string &name);
   void AddUnif(const std::string &name);
@@ -44,14 +46,17 @@ public:
   GLuint GetProgramId() { return _proId; }
 
 private:
+  void InsertDefines();
   void SetAttribLocations();
   bool AskUnifLocations();
+  bool CompileAndLink();
   bool Compile(GLuint shaId);
   bool LinkProg(GLuint proId);
 
   shaVars_v _shaAttrib; // 'attributes' names and locations
   shaVars_v _shaUnif;   // 'uniforms' names and locations
   shaShas_v _shaCode;   // shaders code and their types
+  std::vector<std::string> _defines;
   GLuint _proId;        // program Id
 
   bool _SHAinitializated;
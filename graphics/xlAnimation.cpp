@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <cmath>
+
+#include "xlAnimation.h"
+#include "xlSIMD.h"
+#include "shader.h"
+#include "ogl_error.h"
+
+using namespace xlSIMD;
+
+static inline size_t PadTo4(size_t n)
+{
+    return (n + 3) & ~(size_t)3;
+}
+
+// ----------------------------------------------------------------------------
+// xlSkeleton
+// ----------------------------------------------------------------------------
+int xlSkeleton::AddBone(const Bone& bone)
+{
+    _flatIndex.push_back((int)_bones.size());
+    _bones.push_back(bone);
+    return (int)_bones.size() - 1;
+}
+
+bool xlSkeleton::Flatten()
+{
+    size_t count = _bones.size();
+    std::vector<int> depth(count, -1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if ( _bones[i].parent >= (int)count )
+            return false;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        // walk up until a bone with a known depth, more steps than bones is a cycle
+        int d = 0;
+        int b = (int)i;
+        while ( b >= 0 && depth[b] < 0 )
+        {
+            b = _bones[b].parent;
+            if ( ++d > (int)count )
+                return false;
+        }
+        int base = b >= 0 ? depth[b] + 1 : 0;
+        b = (int)i;
+        for (int k = d - 1; k >= 0; --k)
+        {
+            depth[b] = base + k;
+            b = _bones[b].parent;
+        }
+    }
+
+    std::vector<int> order(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&depth](int a, int b) { return depth[a] < depth[b]; });
+
+    std::vector<int> newIndex(count);
+    for (size_t i = 0; i < count; ++i)
+        newIndex[order[i]] = (int)i;
+
+    std::vector<Bone> sorted(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        sorted[i] = _bones[order[i]];
+        if ( sorted[i].parent >= 0 )
+            sorted[i].parent = newIndex[sorted[i].parent];
+    }
+    _bones.swap(sorted);
+    for (int& idx : _flatIndex)
+        idx = newIndex[idx];
+    return true;
+}
+
+int xlSkeleton::GetBoneIndex(const std::string& name) const
+{
+    for (size_t i = 0; i < _bones.size(); ++i)
+    {
+        if ( _bones[i].name == name )
+            return (int)i;
+    }
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// xlAnimationClip
+// ----------------------------------------------------------------------------
+xlAnimationClip::xlAnimationClip(const xlSkeleton& skeleton, float framesPerSecond, size_t frameCount)
+    : _fps(framesPerSecond > 0.0f ? framesPerSecond : 30.0f), _frameCount(frameCount),
+      _boneCount(skeleton.GetBoneCount()), _padded(PadTo4(skeleton.GetBoneCount()))
+{
+    _keys.resize(_frameCount * CHANNELS * _padded, 0.0f);
+    for (size_t f = 0; f < _frameCount; ++f)
+    {
+        // padding lanes get an identity transform
+        std::fill(Channel(f, QW), Channel(f, QW) + _padded, 1.0f);
+        std::fill(Channel(f, SX), Channel(f, SX) + _padded * 3, 1.0f);
+        for (size_t b = 0; b < _boneCount; ++b)
+        {
+            const xlSkeleton::Bone& bone = skeleton.GetBone(b);
+            SetKey(f, b, bone.position, bone.rotation, bone.scale);
+        }
+    }
+}
+
+void xlAnimationClip::SetKey(size_t frame, size_t bone, const glm::vec3& position,
+                             const glm::vec4& rotation, const glm::vec3& scale)
+{
+    Channel(frame, TX)[bone] = position.x;
+    Channel(frame, TY)[bone] = position.y;
+    Channel(frame, TZ)[bone] = position.z;
+    Channel(frame, QX)[bone] = rotation.x;
+    Channel(frame, QY)[bone] = rotation.y;
+    Channel(frame, QZ)[bone] = rotation.z;
+    Channel(frame, QW)[bone] = rotation.w;
+    Channel(frame, SX)[bone] = scale.x;
+    Channel(frame, SY)[bone] = scale.y;
+    Channel(frame, SZ)[bone] = scale.z;
+}
+
+void xlAnimationClip::FindFrames(float time, bool loop, size_t& f0, size_t& f1, float& alpha) const
+{
+    f0 = f1 = 0;
+    alpha = 0.0f;
+    float duration = GetDuration();
+    if ( duration <= 0.0f )
+        return;
+
+    if ( loop )
+    {
+        time = std::fmod(time, duration);
+        if ( time < 0.0f )
+            time += duration;
+    }
+    else
+        time = std::clamp(time, 0.0f, duration);
+
+    float pos = time * _fps;
+    f0 = std::min((size_t)pos, _frameCount - 1);
+    f1 = std::min(f0 + 1, _frameCount - 1);
+    alpha = pos - (float)f0;
+}
+
+// ----------------------------------------------------------------------------
+// xlSkinningBatch
+// ----------------------------------------------------------------------------
+typedef xlAnimationClip AC;
+
+// out = lerp of positions and scales, nlerp of the rotations, four bones at a
+// time. out may be the same arrays as a.
+static void Interpolate(const float* const* a, const float* const* b, float t,
+                        float* const* out, size_t count)
+{
+    const float4 vt = Set4(t);
+    for (size_t i = 0; i < count; i += 4)
+    {
+        for (int c : { AC::TX, AC::TY, AC::TZ, AC::SX, AC::SY, AC::SZ })
+        {
+            float4 va = Load4(a[c] + i);
+            Store4(out[c] + i, Add(va, Mul(Sub(Load4(b[c] + i), va), vt)));
+        }
+
+        float4 ax = Load4(a[AC::QX] + i), ay = Load4(a[AC::QY] + i);
+        float4 az = Load4(a[AC::QZ] + i), aw = Load4(a[AC::QW] + i);
+        float4 bx = Load4(b[AC::QX] + i), by = Load4(b[AC::QY] + i);
+        float4 bz = Load4(b[AC::QZ] + i), bw = Load4(b[AC::QW] + i);
+
+        // q and -q are the same rotation, take the short way around
+        float4 d = Add(Add(Mul(ax, bx), Mul(ay, by)), Add(Mul(az, bz), Mul(aw, bw)));
+        bx = FlipSign(bx, d);
+        by = FlipSign(by, d);
+        bz = FlipSign(bz, d);
+        bw = FlipSign(bw, d);
+
+        float4 x = Add(ax, Mul(Sub(bx, ax), vt));
+        float4 y = Add(ay, Mul(Sub(by, ay), vt));
+        float4 z = Add(az, Mul(Sub(bz, az), vt));
+        float4 w = Add(aw, Mul(Sub(bw, aw), vt));
+        float4 len = Sqrt(Add(Add(Mul(x, x), Mul(y, y)), Add(Mul(z, z), Mul(w, w))));
+        Store4(out[AC::QX] + i, Div(x, len));
+        Store4(out[AC::QY] + i, Div(y, len));
+        Store4(out[AC::QZ] + i, Div(z, len));
+        Store4(out[AC::QW] + i, Div(w, len));
+    }
+}
+
+xlSkinningBatch::xlSkinningBatch()
+    : _boneCount(0), _poseCount(0), _buffer(0), _texture(0), _gpuCapacity(0)
+{
+}
+
+xlSkinningBatch::~xlSkinningBatch()
+{
+    if ( _texture )
+        glDeleteTextures(1, &_texture);
+    if ( _buffer )
+        glDeleteBuffers(1, &_buffer);
+}
+
+void xlSkinningBatch::Clear()
+{
+    _rigs.clear();
+    _boneCount = _poseCount = 0;
+}
+
+size_t xlSkinningBatch::AddRig(const xlSkeleton* skeleton)
+{
+    Rig rig;
+    rig.skeleton = skeleton;
+    rig.base = _boneCount;
+    rig.poseBase = _poseCount;
+    _boneCount += skeleton->GetBoneCount();
+    _poseCount += PadTo4(skeleton->GetBoneCount());
+    _rigs.push_back(rig);
+
+    for (int c = 0; c < AC::CHANNELS; ++c)
+    {
+        _pose[c].resize(_poseCount, 0.0f);
+        _blend[c].resize(_poseCount, 0.0f);
+    }
+    _local.resize(_poseCount * 16);
+    _world.resize(_boneCount * 16);
+    _packed.resize(_boneCount * FLOATS_PER_BONE);
+    return _rigs.size() - 1;
+}
+
+void xlSkinningBatch::SetClip(size_t rig, const xlAnimationClip* clip, float time, bool loop)
+{
+    Rig& r = _rigs[rig];
+    r.clip = clip;
+    r.time = time;
+    r.loop = loop;
+}
+
+void xlSkinningBatch::SetBlend(size_t rig, const xlAnimationClip* clip, float time, float weight, bool loop)
+{
+    Rig& r = _rigs[rig];
+    r.blendClip = clip;
+    r.blendTime = time;
+    r.blendWeight = weight;
+    r.blendLoop = loop;
+}
+
+void xlSkinningBatch::BindPose(const Rig& rig, float* const* out)
+{
+    size_t count = rig.skeleton->GetBoneCount();
+    for (size_t b = 0; b < PadTo4(count); ++b)
+    {
+        xlSkeleton::Bone identity;
+        const xlSkeleton::Bone& bone = b < count ? rig.skeleton->GetBone(b) : identity;
+        out[AC::TX][b] = bone.position.x;
+        out[AC::TY][b] = bone.position.y;
+        out[AC::TZ][b] = bone.position.z;
+        out[AC::QX][b] = bone.rotation.x;
+        out[AC::QY][b] = bone.rotation.y;
+        out[AC::QZ][b] = bone.rotation.z;
+        out[AC::QW][b] = bone.rotation.w;
+        out[AC::SX][b] = bone.scale.x;
+        out[AC::SY][b] = bone.scale.y;
+        out[AC::SZ][b] = bone.scale.z;
+    }
+}
+
+void xlSkinningBatch::Sample(const Rig& rig, const xlAnimationClip* clip, float time, bool loop, float* const* out)
+{
+    size_t count = rig.skeleton->GetBoneCount();
+    if ( !clip || clip->GetBoneCount() != count || clip->GetFrameCount() == 0 )
+    {
+        BindPose(rig, out);
+        return;
+    }
+    size_t f0, f1;
+    float alpha;
+    clip->FindFrames(time, loop, f0, f1, alpha);
+
+    const float* a[AC::CHANNELS];
+    const float* b[AC::CHANNELS];
+    for (int c = 0; c < AC::CHANNELS; ++c)
+    {
+        a[c] = clip->GetChannel(f0, c);
+        b[c] = clip->GetChannel(f1, c);
+    }
+    Interpolate(a, b, alpha, out, PadTo4(count));
+}
+
+// One column of four local matrices, 16 floats apart
+static inline void StoreColumn(float* out, float4 a, float4 b, float4 c, float4 d)
+{
+    Transpose4(a, b, c, d);
+    Store4(out, a);
+    Store4(out + 16, b);
+    Store4(out + 32, c);
+    Store4(out + 48, d);
+}
+
+void xlSkinningBatch::Compute()
+{
+    // local poses
+    for (const Rig& rig : _rigs)
+    {
+        float* pose[AC::CHANNELS];
+        float* blend[AC::CHANNELS];
+        for (int c = 0; c < AC::CHANNELS; ++c)
+        {
+            pose[c] = &_pose[c][rig.poseBase];
+            blend[c] = &_blend[c][rig.poseBase];
+        }
+        Sample(rig, rig.clip, rig.time, rig.loop, pose);
+        if ( rig.blendClip && rig.blendWeight > 0.0f )
+        {
+            Sample(rig, rig.blendClip, rig.blendTime, rig.blendLoop, blend);
+            Interpolate(pose, blend, std::min(rig.blendWeight, 1.0f), pose,
+                        PadTo4(rig.skeleton->GetBoneCount()));
+        }
+    }
+
+    // local matrices = translate * rotate * scale, for all rigs at once
+    const float4 one = Set4(1.0f);
+    const float4 two = Set4(2.0f);
+    const float4 zero = Set4(0.0f);
+    for (size_t i = 0; i < _poseCount; i += 4)
+    {
+        float4 x = Load4(&_pose[AC::QX][i]);
+        float4 y = Load4(&_pose[AC::QY][i]);
+        float4 z = Load4(&_pose[AC::QZ][i]);
+        float4 w = Load4(&_pose[AC::QW][i]);
+        float4 k = Div(two, Add(Add(Mul(x, x), Mul(y, y)), Add(Mul(z, z), Mul(w, w))));
+
+        float4 xx = Mul(Mul(x, x), k), yy = Mul(Mul(y, y), k), zz = Mul(Mul(z, z), k);
+        float4 xy = Mul(Mul(x, y), k), xz = Mul(Mul(x, z), k), yz = Mul(Mul(y, z), k);
+        float4 wx = Mul(Mul(w, x), k), wy = Mul(Mul(w, y), k), wz = Mul(Mul(w, z), k);
+
+        float4 sx = Load4(&_pose[AC::SX][i]);
+        float4 sy = Load4(&_pose[AC::SY][i]);
+        float4 sz = Load4(&_pose[AC::SZ][i]);
+
+        float* out = &_local[i * 16];
+        StoreColumn(out,      Mul(Sub(one, Add(yy, zz)), sx), Mul(Add(xy, wz), sx), Mul(Sub(xz, wy), sx), zero);
+        StoreColumn(out + 4,  Mul(Sub(xy, wz), sy), Mul(Sub(one, Add(xx, zz)), sy), Mul(Add(yz, wx), sy), zero);
+        StoreColumn(out + 8,  Mul(Add(xz, wy), sz), Mul(Sub(yz, wx), sz), Mul(Sub(one, Add(xx, yy)), sz), zero);
+        StoreColumn(out + 12, Load4(&_pose[AC::TX][i]), Load4(&_pose[AC::TY][i]), Load4(&_pose[AC::TZ][i]), one);
+    }
+
+    // resolve the hierarchy, parents always come first
+    float skin[16];
+    for (const Rig& rig : _rigs)
+    {
+        size_t count = rig.skeleton->GetBoneCount();
+        for (size_t b = 0; b < count; ++b)
+        {
+            const xlSkeleton::Bone& bone = rig.skeleton->GetBone(b);
+            const float* local = &_local[(rig.poseBase + b) * 16];
+            float* world = &_world[(rig.base + b) * 16];
+            if ( bone.parent >= 0 )
+                MultiplyMat4(&_world[(rig.base + bone.parent) * 16], local, world);
+            else
+                std::copy(local, local + 16, world);
+
+            MultiplyMat4(world, &bone.inverseBind[0][0], skin);
+            // rows of the affine part, the shader does dot(row, vec4(p, 1))
+            float* out = &_packed[(rig.base + b) * FLOATS_PER_BONE];
+            for (int r = 0; r < 3; ++r)
+            {
+                out[r * 4]     = skin[r];
+                out[r * 4 + 1] = skin[4 + r];
+                out[r * 4 + 2] = skin[8 + r];
+                out[r * 4 + 3] = skin[12 + r];
+            }
+        }
+    }
+}
+
+void xlSkinningBatch::Upload()
+{
+    if ( _boneCount == 0 )
+        return;
+
+    OnGLError(OGL_ERR_CLEAR); //clear error stack
+
+    if ( !_buffer )
+        glGenBuffers(1, &_buffer);
+    if ( !_texture )
+        glGenTextures(1, &_texture);
+
+    GLsizeiptr bytes = _boneCount * FLOATS_PER_BONE * sizeof(GLfloat);
+    glBindBuffer(GL_TEXTURE_BUFFER, _buffer);
+    if ( _boneCount > _gpuCapacity )
+    {
+        _gpuCapacity = _boneCount;
+        glBufferData(GL_TEXTURE_BUFFER, bytes, &_packed[0], GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, _texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    else
+    {
+        // Orphan the old store so we don't wait for draws still reading it
+        glBufferData(GL_TEXTURE_BUFFER, _gpuCapacity * FLOATS_PER_BONE * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, &_packed[0]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    OnGLError(OGL_ERR_BUFFER);
+}
+
+void xlSkinningBatch::Bind(GLuint textureUnit)
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void xlSkinningBatch::SetupAttributes(Shader& shader, GLsizei stride, size_t boneIdOffset, size_t weightOffset)
+{
+    GLuint loc = shader.GetAttribLoc("aBoneIDs");
+    if ( loc != (GLuint)-1 )
+    {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribIPointer(loc, 4, GL_UNSIGNED_BYTE, stride, (void*)boneIdOffset);
+    }
+    loc = shader.GetAttribLoc("aWeights");
+    if ( loc != (GLuint)-1 )
+    {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)weightOffset);
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef XLANIMATION_H
+#define XLANIMATION_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+class Shader;
+
+//-----------------------------------------------------------------------------
+// Bone hierarchy of a rig. Bones are added in any order, a parent may be
+// referenced before it is added, and then flattened once so every parent comes
+// before its children, which lets a pose be resolved in one linear pass. Bone
+// indexes used by clips and vertices are the flattened ones, see GetBoneIndex.
+class xlSkeleton
+{
+public:
+    struct Bone {
+        std::string name;
+        int parent = -1; // as returned by AddBone, -1 for a root
+        // bind pose relative to the parent
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec4 rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // quaternion xyzw
+        glm::vec3 scale = glm::vec3(1.0f);
+        // model space to bone space at bind time
+        glm::mat4 inverseBind = glm::mat4(1.0f);
+    };
+
+    // Returns the index of the bone before flattening
+    int AddBone(const Bone& bone);
+    // Sort the bones parents first, returns false if a parent is unknown or
+    // the parents form a cycle
+    bool Flatten();
+
+    size_t GetBoneCount() const { return _bones.size(); }
+    const Bone& GetBone(size_t idx) const { return _bones[idx]; }
+    // flattened index of a bone by name, -1 if unknown
+    int GetBoneIndex(const std::string& name) const;
+    // flattened index of a bone by the index AddBone returned
+    int GetFlattenedIndex(int added) const { return _flatIndex[added]; }
+
+private:
+    std::vector<Bone> _bones;
+    std::vector<int> _flatIndex;
+};
+
+//-----------------------------------------------------------------------------
+// Keyframes sampled at a fixed rate for every bone of a skeleton, stored per
+// frame as separate component arrays so four bones are interpolated at once.
+class xlAnimationClip
+{
+public:
+    xlAnimationClip(const xlSkeleton& skeleton, float framesPerSecond, size_t frameCount);
+
+    // Every frame starts at the skeleton bind pose
+    void SetKey(size_t frame, size_t bone, const glm::vec3& position,
+                const glm::vec4& rotation, const glm::vec3& scale = glm::vec3(1.0f));
+
+    float GetDuration() const { return _frameCount > 1 ? (_frameCount - 1) / _fps : 0.0f; }
+    size_t GetBoneCount() const { return _boneCount; }
+    size_t GetFrameCount() const { return _frameCount; }
+
+    // Component arrays of one frame, each _padded floats long
+    enum Channel { TX, TY, TZ, QX, QY, QZ, QW, SX, SY, SZ, CHANNELS };
+    const float* GetChannel(size_t frame, int channel) const
+        { return &_keys[(frame * CHANNELS + channel) * _padded]; }
+
+    // The two frames around 'time' and how far between them it is
+    void FindFrames(float time, bool loop, size_t& f0, size_t& f1, float& alpha) const;
+
+private:
+    float* Channel(size_t frame, int channel) { return &_keys[(frame * CHANNELS + channel) * _padded]; }
+
+    float _fps;
+    size_t _frameCount;
+    size_t _boneCount;
+    size_t _padded; // bone count rounded up to a multiple of four
+    std::vector<float> _keys;
+};
+
+//-----------------------------------------------------------------------------
+// Poses many animated rigs and sends their skinning matrices to the GPU.
+// Clip sampling, blending and building the bone matrices work on four bones at
+// a time across all rigs, the hierarchy is then resolved per rig.
+// The result is a texture buffer of TEXELS_PER_BONE RGBA32F texels per bone,
+// the first three rows of (bone world matrix * inverse bind matrix), read by
+// SkinnedVertexShader.vs at (GetBoneBase(rig) + bone) * TEXELS_PER_BONE.
+class xlSkinningBatch
+{
+public:
+    static const int TEXELS_PER_BONE = 3;
+    static const int FLOATS_PER_BONE = TEXELS_PER_BONE * 4;
+
+    xlSkinningBatch();
+    ~xlSkinningBatch();
+
+    void Clear();
+    // The skeleton must outlive the batch, returns the rig index
+    size_t AddRig(const xlSkeleton* skeleton);
+    size_t GetRigCount() const { return _rigs.size(); }
+    // First bone of the rig in the uploaded buffer
+    size_t GetBoneBase(size_t rig) const { return _rigs[rig].base; }
+
+    // Play 'clip' at 'time' seconds, a null clip shows the bind pose
+    void SetClip(size_t rig, const xlAnimationClip* clip, float time, bool loop = true);
+    // Blend a second clip over the first one, weight 0 is only the first
+    void SetBlend(size_t rig, const xlAnimationClip* clip, float time, float weight, bool loop = true);
+
+    // Sample, blend and resolve the hierarchy of every rig
+    void Compute();
+    // Skinning matrix rows of a bone, valid after Compute()
+    const float* GetBoneData(size_t rig, size_t bone) const
+        { return &_packed[(_rigs[rig].base + bone) * FLOATS_PER_BONE]; }
+
+    void Upload();
+    void Bind(GLuint textureUnit);
+
+    // Bone indexes (4 x GLubyte) and weights (4 x normalized GLubyte) of a
+    // vertex layout, for the aBoneIDs and aWeights attributes of the shader
+    static void SetupAttributes(Shader& shader, GLsizei stride, size_t boneIdOffset, size_t weightOffset);
+
+private:
+    struct Rig {
+        const xlSkeleton* skeleton = nullptr;
+        size_t base = 0;     // first bone in the packed output
+        size_t poseBase = 0; // first bone in the pose arrays, a multiple of four
+        const xlAnimationClip* clip = nullptr;
+        float time = 0.0f;
+        bool loop = true;
+        const xlAnimationClip* blendClip = nullptr;
+        float blendTime = 0.0f;
+        float blendWeight = 0.0f;
+        bool blendLoop = true;
+    };
+
+    void Sample(const Rig& rig, const xlAnimationClip* clip, float time, bool loop, float* const* out);
+    void BindPose(const Rig& rig, float* const* out);
+
+    std::vector<Rig> _rigs;
+    size_t _boneCount;
+    size_t _poseCount; // bones in the pose arrays, each rig padded to four
+
+    // local pose of every bone, one array per xlAnimationClip::Channel
+    std::vector<float> _pose[xlAnimationClip::CHANNELS];
+    std::vector<float> _blend[xlAnimationClip::CHANNELS];
+    std::vector<float> _local; // local matrices, 16 floats per bone
+    std::vector<float> _world;
+    std::vector<float> _packed;
+
+    GLuint _buffer;
+    GLuint _texture;
+    size_t _gpuCapacity;
+};
+
+#endif // XLANIMATION_H
@@ -0,0 +1,121 @@
+#include "xlDecimatedSeries.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "xlGraphicsAccumulators.h"
+
+void xlDecimatedSeries::Clear() {
+    levels.clear();
+}
+
+void xlDecimatedSeries::SetSamples(const float *samples, size_t count) {
+    Clear();
+    AddSamples(samples, count);
+}
+
+void xlDecimatedSeries::AddSamples(const float *samples, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    size_t old = GetCount();
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    levels[0].reserve(old + count);
+    for (size_t i = 0; i < count; i++) {
+        levels[0].push_back({ samples[i], samples[i] });
+    }
+    for (size_t l = 1; levels[l - 1].size() > 1; l++) {
+        if (levels.size() <= l) {
+            levels.emplace_back();
+        }
+        const std::vector<Extremes> &below = levels[l - 1];
+        std::vector<Extremes> &level = levels[l];
+        level.resize((below.size() + 1) / 2);
+        // the block holding the first new sample, and everything after it
+        for (size_t i = old >> l; i < level.size(); i++) {
+            Extremes e = below[i * 2];
+            if (i * 2 + 1 < below.size()) {
+                e.mn = std::min(e.mn, below[i * 2 + 1].mn);
+                e.mx = std::max(e.mx, below[i * 2 + 1].mx);
+            }
+            level[i] = e;
+        }
+    }
+}
+
+void xlDecimatedSeries::GetRange(size_t first, size_t last, float &mn, float &mx) const {
+    mn = std::numeric_limits<float>::max();
+    mx = std::numeric_limits<float>::lowest();
+    last = std::min(last, GetCount());
+    // take the odd blocks at each end, the even pairs between them are
+    // single blocks a level up
+    for (size_t l = 0; first < last; l++) {
+        const std::vector<Extremes> &level = levels[l];
+        if (first & 1) {
+            mn = std::min(mn, level[first].mn);
+            mx = std::max(mx, level[first].mx);
+            first++;
+        }
+        if (last & 1) {
+            last--;
+            mn = std::min(mn, level[last].mn);
+            mx = std::max(mx, level[last].mx);
+        }
+        first >>= 1;
+        last >>= 1;
+    }
+    if (mn > mx) {
+        mn = mx = 0.0f;
+    }
+}
+
+size_t xlDecimatedSeries::AddToAccumulator(xlVertexAccumulator &vac, double firstSample, double lastSample,
+                                           float x1, float x2, int columns, float y, float yScale) const {
+    size_t count = GetCount();
+    if (count == 0 || columns <= 0 || lastSample <= firstSample) {
+        return 0;
+    }
+    double xPerSample = (x2 - x1) / (lastSample - firstSample);
+    double samplesPerColumn = (lastSample - firstSample) / columns;
+    size_t added = 0;
+
+    if (samplesPerColumn <= 2.0) {
+        if (firstSample >= count || lastSample < 0.0) {
+            return 0;
+        }
+        size_t first = (size_t)std::max(0.0, std::floor(firstSample));
+        size_t last = (size_t)std::min((double)count - 1, std::ceil(lastSample));
+        first = std::min(first, last);
+        vac.PreAlloc(last - first + 1);
+        for (size_t i = first; i <= last; i++) {
+            vac.AddVertex(x1 + (i - firstSample) * xPerSample, y + levels[0][i].mn * yScale);
+            added++;
+        }
+        return added;
+    }
+
+    vac.PreAlloc(columns * 2);
+    float columnWidth = (x2 - x1) / columns;
+    float previous = 0.0f;
+    for (int c = 0; c < columns; c++) {
+        double s = std::floor(firstSample + c * samplesPerColumn);
+        double e = std::floor(firstSample + (c + 1) * samplesPerColumn);
+        if (e <= 0.0 || s >= count) {
+            continue;
+        }
+        float mn, mx;
+        GetRange((size_t)std::max(0.0, s), (size_t)e, mn, mx);
+        float x = x1 + (c + 0.5f) * columnWidth;
+        // go to the nearer extreme first so the strip doesn't zig zag
+        // across the whole range between columns
+        bool minFirst = added == 0 || std::abs(previous - mn) <= std::abs(previous - mx);
+        vac.AddVertex(x, y + (minFirst ? mn : mx) * yScale);
+        vac.AddVertex(x, y + (minFirst ? mx : mn) * yScale);
+        previous = minFirst ? mx : mn;
+        added += 2;
+    }
+    return added;
+}
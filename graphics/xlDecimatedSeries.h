@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class xlVertexAccumulator;
+
+// A long run of evenly spaced samples, such as an audio envelope, drawn as a
+// line strip of about two vertices per screen column however many samples
+// the view covers.
+//
+// Keeps the minimum and maximum of every aligned block of 2^level samples for
+// each level, so the extremes of any range of samples come from a handful of
+// blocks and zooming out over millions of samples costs no more than the
+// columns drawn.
+class xlDecimatedSeries {
+public:
+    void Clear();
+    void SetSamples(const float *samples, size_t count);
+    // Appends, only the blocks at the end of each level are recalculated
+    void AddSamples(const float *samples, size_t count);
+    size_t GetCount() const { return levels.empty() ? 0 : levels[0].size(); }
+
+    // Smallest and largest sample in [first, last)
+    void GetRange(size_t first, size_t last, float &mn, float &mx) const;
+
+    // Adds a line strip for the samples from firstSample to lastSample
+    // spread over x1 - x2 in 'columns' screen columns.  Sample values are
+    // drawn at y + value * yScale.  While the view holds fewer samples than
+    // columns every sample is drawn, otherwise each column gets the smallest
+    // and largest of its samples.  Returns the number of vertices added.
+    size_t AddToAccumulator(xlVertexAccumulator &vac, double firstSample, double lastSample,
+                            float x1, float x2, int columns, float y, float yScale) const;
+
+private:
+    struct Extremes {
+        float mn;
+        float mx;
+    };
+    // levels[0] are the samples, levels[l][i] covers samples i << l to (i + 1) << l
+    std::vector<std::vector<Extremes>> levels;
+};
@@ -79,26 +79,34 @@ static const int DEPTH_BUFFER_BITS[] = {32, 24, 16, 12, 10, 8};
 
 wxGLContext *xlGLCanvas::m_sharedContext = nullptr;
 
-static wxGLAttributes GetAttributes(int &zdepth, bool only2d) {
+static wxGLAttributes GetAttributes(int &zdepth, int &stencil, bool only2d) {
     DrawGLUtils::SetupDebugLogging();
     
     static log4cpp::Category &logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
     
     wxGLAttributes atts;
+    stencil = 0;
     for (size_t x = only2d ? 5 : 0; x < 6; ++x) {
-        atts.Reset();
-        atts.PlatformDefaults()
-            .RGBA()
-            .MinRGBA(8, 8, 8, 8)
-            .DoubleBuffer();
-        if (!only2d) {
-            atts.Depth(DEPTH_BUFFER_BITS[x]);
-        }
-        atts.EndList();
-        if (wxGLCanvas::IsDisplaySupported(atts)) {
-            logger_opengl.debug("Depth of %d supported, using it", DEPTH_BUFFER_BITS[x]);
-            zdepth = DEPTH_BUFFER_BITS[x];
-            return atts;
+        // a stencil buffer if there is one, filled paths need it
+        for (int stencilBits : { 8, 0 }) {
+            atts.Reset();
+            atts.PlatformDefaults()
+                .RGBA()
+                .MinRGBA(8, 8, 8, 8)
+                .DoubleBuffer();
+            if (!only2d) {
+                atts.Depth(DEPTH_BUFFER_BITS[x]);
+            }
+            if (stencilBits) {
+                atts.Stencil(stencilBits);
+            }
+            atts.EndList();
+            if (wxGLCanvas::IsDisplaySupported(atts)) {
+                logger_opengl.debug("Depth of %d with %d stencil bits supported, using it", DEPTH_BUFFER_BITS[x], stencilBits);
+                zdepth = DEPTH_BUFFER_BITS[x];
+                stencil = stencilBits;
+                return atts;
+            }
         }
         logger_opengl.debug("Depth of %d not supported", DEPTH_BUFFER_BITS[x]);
     }
@@ -148,10 +156,11 @@ static wxGLAttributes GetAttributes(int &zdepth, bool only2d) {
 
 
 static int tempZDepth = 0;
+static int tempStencilBits = 0;
 xlGLCanvas::xlGLCanvas(wxWindow* parent, wxWindowID id, const wxPoint& pos,
     const wxSize& size, long style, const wxString& name,
     bool only2d)
-    : wxGLCanvas(parent, GetAttributes(tempZDepth, only2d), id, pos, size, wxFULL_REPAINT_ON_RESIZE | wxCLIP_CHILDREN | wxCLIP_SIBLINGS | style, name),
+    : wxGLCanvas(parent, GetAttributes(tempZDepth, tempStencilBits, only2d), id, pos, size, wxFULL_REPAINT_ON_RESIZE | wxCLIP_CHILDREN | wxCLIP_SIBLINGS | style, name),
     mWindowWidth(0),
     mWindowHeight(0),
     mWindowResized(false),
@@ -159,6 +168,7 @@ xlGLCanvas::xlGLCanvas(wxWindow* parent, wxWindowID id, const wxPoint& pos,
     m_context(nullptr),
     _name(name.ToStdString()),
     m_zDepth(only2d ? 0 : tempZDepth),
+    m_stencilBits(tempStencilBits),
     is3d(!only2d)
 {
     log4cpp::Category& logger_base = log4cpp::Category::getInstance(std::string("log_base"));
@@ -219,6 +229,7 @@ xlGLCanvas::xlGLCanvas(wxWindow* parent, wxWindowID id, const wxPoint& pos,
         if (!only2d) {
             m_zDepth = 16;
         }
+        m_stencilBits = 0;
 
         SetPixelFormat(m_hDC, iPixelFormat, &pfd);
     }
@@ -469,6 +480,146 @@ wxImage* xlGLCanvas::GrabImage(wxSize size /*=wxSize(0,0)*/)
     return new wxImage(dstSize.GetWidth(), dstSize.GetHeight(), buf, false);
 }
 
+// Writes an RGB image top row first without ever holding more than the rows
+// handed to it.  Binary PPM is used as it needs no compression state between bands.
+class StreamingImageWriter {
+public:
+    StreamingImageWriter(const std::string &filename, int w, int h) : width(w), height(h) {
+        if (file.Create(filename, true)) {
+            std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+            ok = file.Write(header.c_str(), header.size()) == header.size();
+        }
+    }
+    ~StreamingImageWriter() {
+        if (file.IsOpened()) {
+            file.Close();
+        }
+    }
+    bool IsOk() const { return ok; }
+
+    bool WriteRows(const uint8_t *rgb, int rows) {
+        size_t len = (size_t)width * 3 * rows;
+        ok = ok && file.Write(rgb, len) == len;
+        rowsWritten += rows;
+        return ok;
+    }
+    bool IsComplete() const { return ok && rowsWritten == height; }
+private:
+    wxFile file;
+    int width;
+    int height;
+    int rowsWritten = 0;
+    bool ok = false;
+};
+
+bool xlGLCanvas::GrabImageTiled(const std::string &filename, int width, int height, int tileSize) {
+    static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+    // keeps the band buffer (width * tile * 3) bounded, 16K wide is ~48MB at this size
+    static const int MAX_TILE_SIZE = 1024;
+
+    if (m_context == nullptr || width <= 0 || height <= 0)
+        return false;
+
+    if (!m_context->SetCurrent(*this))
+        return false;
+
+    if (!hasOpenGL3FramebufferObjects() || !IsCoreProfile()) {
+        logger_opengl.error("Tiled image grab requires framebuffer objects and a core profile context.");
+        return false;
+    }
+
+    GLint maxRenderbuffer = 0;
+    GLint maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    int tile = std::min(maxRenderbuffer, std::min(maxViewport[0], maxViewport[1]));
+    tile = std::min(tile, tileSize > 0 ? tileSize : MAX_TILE_SIZE);
+    if (tile <= 0) {
+        return false;
+    }
+    int tileW = std::min(tile, width);
+    int tileH = std::min(tile, height);
+
+    StreamingImageWriter writer(filename, width, height);
+    if (!writer.IsOk()) {
+        logger_opengl.error("Could not create %s for tiled image grab.", filename.c_str());
+        return false;
+    }
+    logger_opengl.debug("Grabbing %dx%d image as %dx%d tiles.", width, height, tileW, tileH);
+
+    GLuint fbID = 0, rbID = 0, dbID = 0;
+    glGenRenderbuffers(1, &rbID);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tileW, tileH);
+    glGenRenderbuffers(1, &dbID);
+    glBindRenderbuffer(GL_RENDERBUFFER, dbID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, tileW, tileH);
+
+    glGenFramebuffers(1, &fbID);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbID);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbID);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, dbID);
+
+    GLint currentPackAlignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &currentPackAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    std::vector<uint8_t> tileBuf((size_t)tileW * tileH * 4);
+    std::vector<uint8_t> bandBuf((size_t)width * tileH * 3);
+
+    bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    // walk the bands top down so rows can be written in file order
+    for (int top = 0; ok && top < height; top += tileH) {
+        int bandH = std::min(tileH, height - top);
+        for (int left = 0; left < width; left += tileW) {
+            int w = std::min(tileW, width - left);
+
+            renderTile.active = true;
+            renderTile.fullWidth = width;
+            renderTile.fullHeight = height;
+            renderTile.x = left;
+            renderTile.y = height - top - bandH;
+            renderTile.width = w;
+            renderTile.height = bandH;
+
+            glBindFramebuffer(GL_FRAMEBUFFER, fbID);
+            render();
+            glBindFramebuffer(GL_FRAMEBUFFER, fbID);
+            glReadPixels(0, 0, w, bandH, GL_RGBA, GL_UNSIGNED_BYTE, &tileBuf[0]);
+
+            // flip vertically while dropping the alpha channel
+            for (int y = 0; y < bandH; ++y) {
+                const uint8_t *src = &tileBuf[(size_t)(bandH - 1 - y) * w * 4];
+                uint8_t *dst = &bandBuf[((size_t)y * width + left) * 3];
+                for (int x = 0; x < w; ++x, src += 4, dst += 3) {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                }
+            }
+        }
+        ok = writer.WriteRows(&bandBuf[0], bandH);
+    }
+    renderTile.active = false;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, currentPackAlignment);
+
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbID);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glDeleteRenderbuffers(1, &rbID);
+    glDeleteRenderbuffers(1, &dbID);
+
+    if (!writer.IsComplete()) {
+        logger_opengl.error("Tiled image grab of %s failed.", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
 void xlGLCanvas::SetCurrentGLContext()
 {
     static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
@@ -642,15 +793,24 @@ xlGraphicsContext* xlGLCanvas::PrepareContextForDrawing(const xlColor &bg) {
         LOG_GL_ERRORV(glEnable(GL_DEPTH_TEST));
     }
     LOG_GL_ERRORV(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-    LOG_GL_ERRORV(glClear(GL_COLOR_BUFFER_BIT | (is3d ? GL_DEPTH_BUFFER_BIT : 0)));
+    LOG_GL_ERRORV(glClear(GL_COLOR_BUFFER_BIT | (is3d ? GL_DEPTH_BUFFER_BIT : 0) | (m_stencilBits ? GL_STENCIL_BUFFER_BIT : 0)));
 
     return new xlOGL3GraphicsContext(this);
 }
 void xlGLCanvas::FinishDrawing(xlGraphicsContext* ctx, bool display) {
-    if (display) {
+    // tiles are read back from the offscreen framebuffer, nothing to present
+    if (display && !renderTile.active) {
         SwapBuffers();
     }
     delete ctx;
+
+    // once something is on screen, start building the 3D programs the first
+    // frame didn't need so later use doesn't stall
+    static bool shadersWarmedUp = false;
+    if (is3d && !shadersWarmedUp) {
+        shadersWarmedUp = true;
+        xlOGL3GraphicsContext::WarmUpShaders();
+    }
 }
 
 bool xlGLCanvas::getFrameForExport(int w, int h, AVFrame *, uint8_t *buffer, int bufferSize) {
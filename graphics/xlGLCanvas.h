@@ -52,12 +52,18 @@ class xlGLCanvas
 		// Grab a copy of the front buffer (at window dimensions by default); it's the
 		// caller's responsibility to delete the image when done with it
 		wxImage *GrabImage( wxSize size = wxSize(0,0) );
+        // Render at an arbitrary resolution by splitting the frame into tiles that fit
+        // in a single renderbuffer.  Each band of tiles is streamed to a binary PPM file
+        // so the full frame is never held in memory.  tileSize of 0 picks the largest
+        // size the driver supports (capped to keep the band buffer small)
+        bool GrabImageTiled(const std::string &filename, int width, int height, int tileSize = 0);
         void captureNextFrame(int w, int h) {}
         bool getFrameForExport(int w, int h, AVFrame *, uint8_t *buffer, int bufferSize);
 
         virtual void render() {};
     
         int GetZDepth() const { return m_zDepth;}
+        int GetStencilBits() const { return m_stencilBits;}
         bool IsCoreProfile() const { return isCoreProfile;}
         static wxGLContext *GetSharedContext() { return m_sharedContext; }
 
@@ -75,6 +81,19 @@ class xlGLCanvas
 
     
         bool bindVertexArrayID(GLuint pid);
+
+        // While a tiled grab is in progress, the region of the full output frame
+        // currently being rendered.  y is measured from the bottom like glViewport.
+        struct RenderTile {
+            bool active = false;
+            int fullWidth = 0;
+            int fullHeight = 0;
+            int x = 0;
+            int y = 0;
+            int width = 0;
+            int height = 0;
+        };
+        const RenderTile &GetRenderTile() const { return renderTile; }
     protected:
       	DECLARE_EVENT_TABLE()
 
@@ -94,8 +113,10 @@ class xlGLCanvas
         std::string _name;
         wxGLContext* m_context = nullptr;
         int  m_zDepth = 0;
+        int  m_stencilBits = 0;
         bool isCoreProfile = false;
         std::map<GLuint, GLuint> vertexArrayIds;
-    
+        RenderTile renderTile;
+
         static wxGLContext *m_sharedContext;
 };
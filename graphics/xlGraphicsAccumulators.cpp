@@ -4,8 +4,27 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
 
 #include "xlGraphicsContext.h"
+#include "xlSIMD.h"
+
+static const int MIN_ADAPTIVE_SEGMENTS = 6;
+static const int MAX_ADAPTIVE_SEGMENTS = 512;
+
+// The chords stay within maxError pixels of the circle, an arc of angle a is
+// r * (1 - cos(a / 2)) from its chord
+int xlTessellationScale::AdaptiveSegments(float radius, int fallback) const {
+    if (!HasPixelsPerUnit()) {
+        return fallback;
+    }
+    double r = radius * pixelsPerUnit;
+    if (r <= maxPixelError) {
+        return MIN_ADAPTIVE_SEGMENTS;
+    }
+    int n = std::ceil(M_PI / std::acos(1.0 - maxPixelError / r));
+    return std::min(std::max(n, MIN_ADAPTIVE_SEGMENTS), MAX_ADAPTIVE_SEGMENTS);
+}
 
 void xlVertexAccumulator::AddRectAsLines(float x1, float y1, float x2, float y2) {
     PreAlloc(8);
@@ -48,9 +67,10 @@ void xlVertexAccumulator::AddRectAsTriangles(float x1, float y1, float x2, float
     AddVertex(x1, y1);
 }
 void xlVertexAccumulator::AddCircleAsLines(float cx, float cy, float r) {
-    static const int steps = 24;
-    static const double inc = 2.0 * 3.14159 / float(steps);
+    int steps = AdaptiveSegments(r, 24);
+    double inc = 2.0 * M_PI / float(steps);
     double d = 0;
+    PreAlloc(steps + 1);
     for (int x = 0; x <= steps; x++, d += inc) {
         AddVertex(std::cos(d) * r + cx, std::sin(d) * r + cy);
     }
@@ -67,13 +87,8 @@ void xlVertexColorAccumulator::AddRectAsTriangles(float x1, float y1,
                                                   float x2, float y2,
                                                   float z,
                                                   const xlColor &color) {
-    PreAlloc(6);
-    AddVertex(x1, y1, z, color);
-    AddVertex(x1, y2, z, color);
-    AddVertex(x2, y2, z, color);
-    AddVertex(x2, y2, z, color);
-    AddVertex(x2, y1, z, color);
-    AddVertex(x1, y1, z, color);
+    float rect[4] = { x1, y1, x2, y2 };
+    AddRectsAsTriangles(1, rect, z, &color);
 }
 void xlVertexColorAccumulator::AddRectAsLines(float x1, float y1, float x2, float y2,
                                               const xlColor &color) {
@@ -154,11 +169,15 @@ void xlVertexColorAccumulator::AddHBlendedRectangleAsTriangles(float x1, float y
     AddVertex(x1, y1, 0, left);
 }
 void xlVertexColorAccumulator::AddCircleAsLines(float cx, float cy, float r, const xlColor &color) {
-    static const int steps = 24;
-    static const double inc = 2.0 * 3.14159 / float(steps);
+    AddCircleAsLines(cx, cy, 0.0f, r, color);
+}
+void xlVertexColorAccumulator::AddCircleAsLines(float cx, float cy, float cz, float r, const xlColor &color) {
+    int steps = AdaptiveSegments(r, 24);
+    double inc = 2.0 * M_PI / float(steps);
     double d = 0;
+    PreAlloc(steps + 1);
     for (int x = 0; x <= steps; x++, d += inc) {
-        AddVertex(std::cos(d) * r + cx, std::sin(d) * r + cy, color);
+        AddVertex(std::cos(d) * r + cx, std::sin(d) * r + cy, cz, color);
     }
 }
 
@@ -178,11 +197,15 @@ void xlVertexColorAccumulator::AddCircleAsTriangles(float cx, float cy, float cz
 }
 void xlVertexColorAccumulator::AddCircleAsTriangles(float cx, float cy, float cz, float radius, const xlColor& center, const xlColor& edge, float depthRatio, int numSegments) {
     int num_segments = numSegments;
-    if (num_segments == -1) {
-        num_segments = radius;
-    }
-    if (num_segments < 16) {
-        num_segments = 16;
+    if (num_segments == -1 && HasPixelsPerUnit()) {
+        num_segments = AdaptiveSegments(radius, 16);
+    } else {
+        if (num_segments == -1) {
+            num_segments = radius;
+        }
+        if (num_segments < 16) {
+            num_segments = 16;
+        }
     }
     PreAlloc(num_segments * 4);
     float theta = 2 * 3.1415926 / float(num_segments);
@@ -212,11 +235,15 @@ void xlVertexColorAccumulator::AddCircleAsTriangles(float cx, float cy, float cz
 }
 void xlVertexIndexedColorAccumulator::AddCircleAsTriangles(float cx, float cy, float cz, float radius, uint32_t center, uint32_t edge, int numSegments) {
     int num_segments = numSegments;
-    if (num_segments == -1) {
-        num_segments = radius;
-    }
-    if (num_segments < 16) {
-        num_segments = 16;
+    if (num_segments == -1 && HasPixelsPerUnit()) {
+        num_segments = AdaptiveSegments(radius, 16);
+    } else {
+        if (num_segments == -1) {
+            num_segments = radius;
+        }
+        if (num_segments < 16) {
+            num_segments = 16;
+        }
     }
     PreAlloc(num_segments * 4);
     float theta = 2 * 3.1415926 / float(num_segments);
@@ -244,69 +271,387 @@ void xlVertexIndexedColorAccumulator::AddCircleAsTriangles(float cx, float cy, f
     }
 }
 
-void xlVertexColorAccumulator::AddCubeAsTriangles(float x, float y, float z, float width, const xlColor &color) {
-    float halfwidth = width / 2.0f;
+// out = unit * scale + offset for interleaved xyz, four vertices (three
+// float4s) per step with the xyz pattern repeating every three
+static void ScaleAndOffsetXYZ(float *out, const float *unit, size_t vertexCount,
+                              const float offset[3], const float scale[3]) {
+    using namespace xlSIMD;
+    size_t floats = vertexCount * 3;
+    size_t i = 0;
+    const float o[12] = { offset[0], offset[1], offset[2], offset[0], offset[1], offset[2],
+                          offset[0], offset[1], offset[2], offset[0], offset[1], offset[2] };
+    const float m[12] = { scale[0], scale[1], scale[2], scale[0], scale[1], scale[2],
+                          scale[0], scale[1], scale[2], scale[0], scale[1], scale[2] };
+    const float4 o0 = Load4(o), o1 = Load4(o + 4), o2 = Load4(o + 8);
+    const float4 m0 = Load4(m), m1 = Load4(m + 4), m2 = Load4(m + 8);
+    for (; i + 12 <= floats; i += 12) {
+        Store4(out + i, Add(Mul(Load4(unit + i), m0), o0));
+        Store4(out + i + 4, Add(Mul(Load4(unit + i + 4), m1), o1));
+        Store4(out + i + 8, Add(Mul(Load4(unit + i + 8), m2), o2));
+    }
+    for (; i < floats; i++) {
+        out[i] = unit[i] * m[i % 3] + o[i % 3];
+    }
+}
 
-    // front
-    AddVertex(x - halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z + halfwidth, color);
+// Emits 'count' copies of a unit shape, params(i, offset, scale) places copy i.
+// Straight into the accumulator storage when it supports ReserveVertices.
+template<class F>
+static void AddShapes(xlVertexColorAccumulator &acc, size_t count, const std::vector<float> &unit,
+                      const xlColor *colors, F params) {
+    uint32_t per = unit.size() / 3;
+    if (count == 0 || per == 0) {
+        return;
+    }
+    float offset[3];
+    float scale[3];
+    uint32_t *rgba = nullptr;
+    float *out = acc.ReserveVertices(per * count, rgba);
+    if (out) {
+        for (size_t i = 0; i < count; i++) {
+            params(i, offset, scale);
+            ScaleAndOffsetXYZ(out + i * per * 3, &unit[0], per, offset, scale);
+            std::fill(rgba + i * per, rgba + (i + 1) * per, colors[i].GetRGBA());
+        }
+        return;
+    }
+    acc.PreAlloc(per * count);
+    for (size_t i = 0; i < count; i++) {
+        params(i, offset, scale);
+        for (uint32_t v = 0; v < per * 3; v += 3) {
+            acc.AddVertex(unit[v] * scale[0] + offset[0], unit[v + 1] * scale[1] + offset[1],
+                          unit[v + 2] * scale[2] + offset[2], colors[i]);
+        }
+    }
+}
 
-    AddVertex(x - halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z + halfwidth, color);
+// Unit circles for a segment count, as triangle fans (edge, next edge, center)
+// or as line segments (edge, next edge).  Built once per count.
+static const std::vector<float> &GetUnitCircle(int segments, bool triangles) {
+    static std::mutex lock;
+    static std::map<int, std::vector<float>> fans;
+    static std::map<int, std::vector<float>> outlines;
+    segments = std::max(segments, 3);
+
+    std::unique_lock<std::mutex> locker(lock);
+    std::vector<float> &unit = (triangles ? fans : outlines)[segments];
+    if (unit.empty()) {
+        std::vector<float> cs(segments + 1), sn(segments + 1);
+        for (int i = 0; i < segments; i++) {
+            double a = 2.0 * M_PI * i / segments;
+            cs[i] = std::cos(a);
+            sn[i] = std::sin(a);
+        }
+        cs[segments] = cs[0];
+        sn[segments] = sn[0];
+        unit.reserve(segments * (triangles ? 9 : 6));
+        for (int i = 0; i < segments; i++) {
+            float seg[9] = { cs[i], sn[i], 0.0f,  cs[i + 1], sn[i + 1], 0.0f,  0.0f, 0.0f, 0.0f };
+            unit.insert(unit.end(), seg, seg + (triangles ? 9 : 6));
+        }
+    }
+    return unit;
+}
 
-    // back
-    AddVertex(x - halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z - halfwidth, color);
+static const std::vector<float> UNIT_RECT = {
+    0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+    1.0f, 1.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 0.0f
+};
+// front, back, left, right, top, bottom
+static const std::vector<float> UNIT_CUBE = {
+    -0.5f, 0.5f, 0.5f,  0.5f, 0.5f, 0.5f,  0.5f, -0.5f, 0.5f,
+    -0.5f, 0.5f, 0.5f,  -0.5f, -0.5f, 0.5f,  0.5f, -0.5f, 0.5f,
+    -0.5f, 0.5f, -0.5f,  0.5f, 0.5f, -0.5f,  0.5f, -0.5f, -0.5f,
+    -0.5f, 0.5f, -0.5f,  -0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f,
+    -0.5f, 0.5f, 0.5f,  -0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, -0.5f,
+    -0.5f, 0.5f, 0.5f,  -0.5f, 0.5f, -0.5f,  -0.5f, -0.5f, -0.5f,
+    0.5f, 0.5f, 0.5f,  0.5f, -0.5f, 0.5f,  0.5f, -0.5f, -0.5f,
+    0.5f, 0.5f, 0.5f,  0.5f, 0.5f, -0.5f,  0.5f, -0.5f, -0.5f,
+    -0.5f, 0.5f, 0.5f,  0.5f, 0.5f, 0.5f,  -0.5f, 0.5f, -0.5f,
+    -0.5f, 0.5f, -0.5f,  0.5f, 0.5f, 0.5f,  0.5f, 0.5f, -0.5f,
+    -0.5f, -0.5f, 0.5f,  0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, -0.5f,
+    0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f
+};
+
+// Adaptive counts are rounded up to a multiple of four so few unit circles
+// get cached, and consecutive circles with the same count go out together
+static void AddCircles(xlVertexColorAccumulator &acc, size_t count, const float *centers, const float *radii,
+                       const xlColor *colors, int numSegments, bool triangles) {
+    auto segments = [&acc, numSegments, radii, triangles](size_t i) {
+        if (numSegments >= 0) {
+            return numSegments;
+        }
+        if (!acc.HasPixelsPerUnit()) {
+            return triangles ? 16 : 24;
+        }
+        return (acc.AdaptiveSegments(radii[i], 0) + 3) & ~3;
+    };
+    size_t first = 0;
+    while (first < count) {
+        int n = segments(first);
+        size_t end = first + 1;
+        while (end < count && segments(end) == n) {
+            end++;
+        }
+        const float *c = centers + first * 3;
+        const float *r = radii + first;
+        AddShapes(acc, end - first, GetUnitCircle(n, triangles), colors + first, [c, r](size_t i, float *o, float *s) {
+            o[0] = c[i * 3];
+            o[1] = c[i * 3 + 1];
+            o[2] = c[i * 3 + 2];
+            s[0] = s[1] = s[2] = r[i];
+        });
+        first = end;
+    }
+}
 
-    AddVertex(x - halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z - halfwidth, color);
+void xlVertexColorAccumulator::AddCirclesAsTriangles(size_t count, const float *centers, const float *radii,
+                                                     const xlColor *colors, int numSegments) {
+    AddCircles(*this, count, centers, radii, colors, numSegments, true);
+}
+void xlVertexColorAccumulator::AddCirclesAsLines(size_t count, const float *centers, const float *radii,
+                                                 const xlColor *colors, int numSegments) {
+    AddCircles(*this, count, centers, radii, colors, numSegments, false);
+}
+void xlVertexColorAccumulator::AddRectsAsTriangles(size_t count, const float *rects, float z, const xlColor *colors) {
+    AddShapes(*this, count, UNIT_RECT, colors, [rects, z](size_t i, float *o, float *s) {
+        const float *r = rects + i * 4;
+        o[0] = r[0];
+        o[1] = r[1];
+        o[2] = z;
+        s[0] = r[2] - r[0];
+        s[1] = r[3] - r[1];
+        s[2] = 1.0f;
+    });
+}
+void xlVertexColorAccumulator::AddCubesAsTriangles(size_t count, const float *centers, const float *widths, const xlColor *colors) {
+    AddShapes(*this, count, UNIT_CUBE, colors, [centers, widths](size_t i, float *o, float *s) {
+        o[0] = centers[i * 3];
+        o[1] = centers[i * 3 + 1];
+        o[2] = centers[i * 3 + 2];
+        s[0] = s[1] = s[2] = widths[i];
+    });
+}
 
-    // left side
-    AddVertex(x - halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z - halfwidth, color);
+void xlVertexColorAccumulator::AddCubeAsTriangles(float x, float y, float z, float width, const xlColor &color) {
+    float center[3] = { x, y, z };
+    AddCubesAsTriangles(1, center, &width, &color);
+}
 
-    AddVertex(x - halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z - halfwidth, color);
+static const int MAX_SPHERE_SUBDIVISIONS = 4;
+
+// Unit icospheres as plain triangle lists, built once for all levels
+static const std::vector<float> &GetUnitIcosphere(int level) {
+    static const std::vector<std::vector<float>> spheres = []() {
+        const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+        std::vector<float> v = {
+            -1, t, 0,  1, t, 0,  -1, -t, 0,  1, -t, 0,
+            0, -1, t,  0, 1, t,  0, -1, -t,  0, 1, -t,
+            t, 0, -1,  t, 0, 1,  -t, 0, -1,  -t, 0, 1
+        };
+        static const int faces[20][3] = {
+            {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+            {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+            {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+            {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+        };
+        auto normalized = [](float *p) {
+            float l = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            p[0] /= l;
+            p[1] /= l;
+            p[2] /= l;
+        };
+        std::vector<std::vector<float>> levels(MAX_SPHERE_SUBDIVISIONS + 1);
+        for (auto &f : faces) {
+            for (int c = 0; c < 3; c++) {
+                float p[3] = { v[f[c] * 3], v[f[c] * 3 + 1], v[f[c] * 3 + 2] };
+                normalized(p);
+                levels[0].insert(levels[0].end(), p, p + 3);
+            }
+        }
+        // split every triangle in four, pushing the new corners out to the sphere
+        for (int l = 1; l <= MAX_SPHERE_SUBDIVISIONS; l++) {
+            const std::vector<float> &prev = levels[l - 1];
+            std::vector<float> &cur = levels[l];
+            cur.reserve(prev.size() * 4);
+            for (size_t i = 0; i < prev.size(); i += 9) {
+                const float *a = &prev[i];
+                const float *b = &prev[i + 3];
+                const float *c = &prev[i + 6];
+                float ab[3], bc[3], ca[3];
+                for (int x = 0; x < 3; x++) {
+                    ab[x] = a[x] + b[x];
+                    bc[x] = b[x] + c[x];
+                    ca[x] = c[x] + a[x];
+                }
+                normalized(ab);
+                normalized(bc);
+                normalized(ca);
+                const float *corners[12] = { a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca };
+                for (const float *p : corners) {
+                    cur.insert(cur.end(), p, p + 3);
+                }
+            }
+        }
+        return levels;
+    }();
+    return spheres[std::clamp(level, 0, MAX_SPHERE_SUBDIVISIONS)];
+}
 
-    // right side
-    AddVertex(x + halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z - halfwidth, color);
+void xlVertexColorAccumulator::AddSphereAsTriangles(float x, float y, float z, float radius, const xlColor &color) {
+    // the smallest level whose flat triangles stay within half a unit (or the
+    // pixel error) of the sphere, the icosahedron edges span 1.107 radians and
+    // halve every level
+    float tolerance = pixelsPerUnit > 0.0f ? maxPixelError / pixelsPerUnit : 0.5f;
+    int level = 0;
+    float angle = 1.10715f;
+    while (level < MAX_SPHERE_SUBDIVISIONS && radius * (1.0f - std::cos(angle * 0.5f)) > tolerance) {
+        level++;
+        angle *= 0.5f;
+    }
+    AddSphereAsTriangles(x, y, z, radius, color, level);
+}
 
-    AddVertex(x + halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z - halfwidth, color);
+void xlVertexColorAccumulator::AddSphereAsTriangles(float x, float y, float z, float radius, const xlColor &color, int subdivisions) {
+    const std::vector<float> &unit = GetUnitIcosphere(subdivisions);
+    uint32_t count = unit.size() / 3;
+    float *out = ReserveVertices(count, color);
+    if (out) {
+        float offset[3] = { x, y, z };
+        float scale[3] = { radius, radius, radius };
+        ScaleAndOffsetXYZ(out, &unit[0], count, offset, scale);
+        return;
+    }
+    PreAlloc(count);
+    for (uint32_t i = 0; i < count * 3; i += 3) {
+        AddVertex(unit[i] * radius + x, unit[i + 1] * radius + y, unit[i + 2] * radius + z, color);
+    }
+}
 
-    // top side
-    AddVertex(x - halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y + halfwidth, z - halfwidth, color);
 
-    AddVertex(x - halfwidth, y + halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y + halfwidth, z - halfwidth, color);
+void xlPolylineAccumulator::AddLine(float x1, float y1, float x2, float y2, const xlColor &c) {
+    StartLine();
+    AddPoint(x1, y1, c);
+    AddPoint(x2, y2, c);
+}
+void xlPolylineAccumulator::AddRectAsLines(float x1, float y1, float x2, float y2, const xlColor &c) {
+    StartLine(true);
+    AddPoint(x1, y1, c);
+    AddPoint(x2, y1, c);
+    AddPoint(x2, y2, c);
+    AddPoint(x1, y2, c);
+}
 
-    // bottom side
-    AddVertex(x - halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z - halfwidth, color);
+void xlGradientAccumulator::AddHorizontalGradient(float x1, float y1, float x2, float y2, const xlColorVector &colors) {
+    AddGradient(LINEAR_GRADIENT, x1, y1, x2, y2, 0.0f, x1, y1, x2, y1, colors);
+}
+void xlGradientAccumulator::AddLinearGradient(float x1, float y1, float x2, float y2, float z,
+                                              float gx1, float gy1, float gx2, float gy2, const xlColorVector &colors) {
+    AddGradient(LINEAR_GRADIENT, x1, y1, x2, y2, z, gx1, gy1, gx2, gy2, colors);
+}
+void xlGradientAccumulator::AddRadialGradient(float x1, float y1, float x2, float y2, float z,
+                                              float cx, float cy, float radius, const xlColorVector &colors) {
+    AddGradient(RADIAL_GRADIENT, x1, y1, x2, y2, z, cx, cy, radius, 0.0f, colors);
+}
+void xlGradientAccumulator::AddAngularGradient(float x1, float y1, float x2, float y2, float z,
+                                               float cx, float cy, float startAngle, const xlColorVector &colors) {
+    AddGradient(ANGULAR_GRADIENT, x1, y1, x2, y2, z, cx, cy, startAngle, 0.0f, colors);
+}
+
+static const int DEFAULT_CURVE_SEGMENTS = 16;
+static const int MAX_CURVE_SEGMENTS = 256;
 
-    AddVertex(x + halfwidth, y - halfwidth, z + halfwidth, color);
-    AddVertex(x - halfwidth, y - halfwidth, z - halfwidth, color);
-    AddVertex(x + halfwidth, y - halfwidth, z - halfwidth, color);
+// Segments for a curve whose second derivative is at most d2 so the chords
+// stay within tolerance of it, a step of h in t strays at most d2 h^2 / 8
+static int CurveSegments(float d2, float pixelsPerUnit, float maxError) {
+    if (pixelsPerUnit <= 0.0f) {
+        return DEFAULT_CURVE_SEGMENTS;
+    }
+    float tolerance = maxError / pixelsPerUnit;
+    int n = (int)std::ceil(std::sqrt(d2 / (8.0f * tolerance)));
+    return std::clamp(n, 1, MAX_CURVE_SEGMENTS);
 }
 
-void xlVertexColorAccumulator::AddSphereAsTriangles(float x, float y, float z, float radius, const xlColor &color) {
-    // FIXME:  draw a square until I get a good sphere routine
-    AddCubeAsTriangles(x, y, z, radius*2, color);
+void xlPathAccumulator::MoveTo(float x, float y) {
+    StartContour(x, y);
+    startX = penX = x;
+    startY = penY = y;
+}
+void xlPathAccumulator::LineTo(float x, float y) {
+    AddContourPoint(x, y);
+    penX = x;
+    penY = y;
+}
+void xlPathAccumulator::QuadTo(float cx, float cy, float x, float y) {
+    // B'' = 2 (p0 - 2 c + p1)
+    float d2 = 2.0f * std::hypot(penX - 2.0f * cx + x, penY - 2.0f * cy + y);
+    int n = CurveSegments(d2, pixelsPerUnit, maxPixelError);
+    float x0 = penX, y0 = penY;
+    for (int i = 1; i < n; i++) {
+        float t = (float)i / n;
+        float u = 1.0f - t;
+        AddContourPoint(u * u * x0 + 2.0f * u * t * cx + t * t * x,
+                        u * u * y0 + 2.0f * u * t * cy + t * t * y);
+    }
+    LineTo(x, y);
+}
+void xlPathAccumulator::CubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y) {
+    // B'' = 6 ((1 - t) (p0 - 2 c1 + c2) + t (c1 - 2 c2 + p1)), largest at an end
+    float d2 = 6.0f * std::max(std::hypot(penX - 2.0f * c1x + c2x, penY - 2.0f * c1y + c2y),
+                               std::hypot(c1x - 2.0f * c2x + x, c1y - 2.0f * c2y + y));
+    int n = CurveSegments(d2, pixelsPerUnit, maxPixelError);
+    float x0 = penX, y0 = penY;
+    for (int i = 1; i < n; i++) {
+        float t = (float)i / n;
+        float u = 1.0f - t;
+        float a = u * u * u, b = 3.0f * u * u * t, c = 3.0f * u * t * t, d = t * t * t;
+        AddContourPoint(a * x0 + b * c1x + c * c2x + d * x,
+                        a * y0 + b * c1y + c * c2y + d * y);
+    }
+    LineTo(x, y);
+}
+void xlPathAccumulator::Close() {
+    EndContour();
+    penX = startX;
+    penY = startY;
 }
 
+static float SRGBToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+static float LinearToSRGB(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+void xlGradientAccumulator::FillRamp(const xlColorVector &colors, bool linearLight, uint32_t *ramp) {
+    if (colors.empty()) {
+        std::fill(ramp, ramp + RAMP_WIDTH, 0);
+        return;
+    }
+    int last = colors.size() - 1;
+    for (int i = 0; i < RAMP_WIDTH; i++) {
+        float pos = (float)i / (RAMP_WIDTH - 1) * last;
+        int a = std::min((int)pos, last);
+        int b = std::min(a + 1, last);
+        float f = pos - a;
+        const xlColor &ca = colors[a];
+        const xlColor &cb = colors[b];
+        float from[3] = { ca.red / 255.0f, ca.green / 255.0f, ca.blue / 255.0f };
+        float to[3] = { cb.red / 255.0f, cb.green / 255.0f, cb.blue / 255.0f };
+        uint8_t rgb[3];
+        for (int c = 0; c < 3; c++) {
+            float v;
+            if (linearLight) {
+                v = LinearToSRGB(SRGBToLinear(from[c]) * (1.0f - f) + SRGBToLinear(to[c]) * f);
+            } else {
+                v = from[c] * (1.0f - f) + to[c] * f;
+            }
+            rgb[c] = (uint8_t)std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f);
+        }
+        uint8_t alpha = (uint8_t)std::lround(ca.alpha * (1.0f - f) + cb.alpha * f);
+        ramp[i] = xlColor(rgb[0], rgb[1], rgb[2], alpha).GetRGBA();
+    }
+}
 
 void xlDisplayList::addToAccumulator(float xOffset, float yOffset,
                                      float width, float height,
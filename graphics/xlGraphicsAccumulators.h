@@ -9,7 +9,24 @@
 
 class xlGraphicsContext;
 
-class xlVertexAccumulator {
+// How finely the shape helpers of an accumulator tessellate.  The scale comes
+// from xlGraphicsContext::GetPixelsPerUnit, once it is set curved shapes
+// without an explicit segment count get just enough segments to stay within
+// maxError pixels of the true outline.  0 turns it off.
+class xlTessellationScale {
+public:
+    void SetPixelsPerUnit(float ppu, float maxError = 0.5f) { pixelsPerUnit = ppu; maxPixelError = maxError; }
+    bool HasPixelsPerUnit() const { return pixelsPerUnit > 0.0f; }
+
+    // Segments for a whole circle of the radius, 'fallback' if no scale is set
+    int AdaptiveSegments(float radius, int fallback) const;
+
+protected:
+    float pixelsPerUnit = 0.0f;
+    float maxPixelError = 0.5f;
+};
+
+class xlVertexAccumulator : public xlTessellationScale {
 public:
     xlVertexAccumulator() {}
     virtual ~xlVertexAccumulator() {}
@@ -48,7 +65,7 @@ protected:
     std::string name;
 };
 
-class xlVertexColorAccumulator {
+class xlVertexColorAccumulator : public xlTessellationScale {
 public:
     xlVertexColorAccumulator() {}
     virtual ~xlVertexColorAccumulator() {}
@@ -62,6 +79,12 @@ public:
     virtual void AddVertex(float x, float y, const xlColor &c) { AddVertex(x, y, 0.0f, c);};
     virtual uint32_t getCount() { return 0; }
 
+    // Appends count vertices of one color and returns their xyz storage for
+    // the caller to fill, or nullptr if not supported (then use AddVertex)
+    virtual float *ReserveVertices(uint32_t count, const xlColor &c) { return nullptr; }
+    // Same, with a color per vertex: 'colors' receives their GetRGBA() storage
+    virtual float *ReserveVertices(uint32_t count, uint32_t *&colors) { colors = nullptr; return nullptr; }
+
 
     // mark this as ready to be copied to graphics card, after finalize,
     // vertices cannot be added, but if mayChange is set, the vertex/color
@@ -95,12 +118,25 @@ public:
     void AddCircleAsTriangles(float cx, float cy, float cz, float radius, const xlColor& center, const xlColor& edge, float depthRatio, int numSegments = -1);
 
     void AddCubeAsTriangles(float x, float y, float z, float width, const xlColor &color);
+
+    // Many shapes at once, one color each, centers are xyz triples and rects
+    // x1, y1, x2, y2.  The shapes are scaled copies of cached unit shapes, so
+    // there is no trigonometry or virtual call per vertex.  The lines variant
+    // emits separate segments for GL_LINES, not a strip.  numSegments -1 picks
+    // them per circle from the pixels per unit.
+    void AddCirclesAsTriangles(size_t count, const float *centers, const float *radii, const xlColor *colors, int numSegments = 16);
+    void AddCirclesAsLines(size_t count, const float *centers, const float *radii, const xlColor *colors, int numSegments = 24);
+    void AddRectsAsTriangles(size_t count, const float *rects, float z, const xlColor *colors);
+    void AddCubesAsTriangles(size_t count, const float *centers, const float *widths, const xlColor *colors);
+    // subdivided icosahedron, the level is picked from the radius like the
+    // circle segment count, or given (0-4, 20 * 4^level triangles)
     void AddSphereAsTriangles(float x, float y, float z, float radius, const xlColor &color);
+    void AddSphereAsTriangles(float x, float y, float z, float radius, const xlColor &color, int subdivisions);
     
 protected:
     std::string name;
 };
-class xlVertexIndexedColorAccumulator {
+class xlVertexIndexedColorAccumulator : public xlTessellationScale {
 public:
     xlVertexIndexedColorAccumulator() {}
     virtual ~xlVertexIndexedColorAccumulator() {}
@@ -135,13 +171,314 @@ public:
         AddCircleAsTriangles(cx, cy, cz, radius, cIdx, cIdx, -1);
     }
     void AddCircleAsTriangles(float cx, float cy, float cz, float radius, uint32_t cIdx, uint32_t eIdx, int numSegments = -1);
-
     
 protected:
     std::string name;
 };
 
 
+// Filled circles and rings, each drawn as one quad with the shape cut out by
+// a distance test in the fragment shader, so a circle costs four vertices and
+// the edge is anti-aliased at any size.  Like AddCircleAsTriangles the circles
+// lie in the xy plane of the model.
+class xlCircleAccumulator {
+public:
+    xlCircleAccumulator() {}
+    virtual ~xlCircleAccumulator() {}
+
+    xlCircleAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    virtual void Reset() {}
+    virtual void PreAlloc(unsigned int i) {};
+    // innerRadius > 0 makes a ring, softness is the width of the edge in pixels
+    virtual void AddCircle(float x, float y, float z, float radius, const xlColor &c,
+                           float innerRadius = 0.0f, float softness = 1.0f) {};
+    virtual uint32_t getCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // circles cannot be added, but if mayChange is set, they can change
+    // via SetCircle and then flushed to push the new data to the graphics card
+    virtual void Finalize(bool mayChange) {}
+    virtual void SetCircle(uint32_t idx, float x, float y, float z, float radius, const xlColor &c,
+                           float innerRadius = 0.0f, float softness = 1.0f) {};
+    virtual void SetColor(uint32_t idx, const xlColor &c) {};
+    virtual void FlushRange(uint32_t start, uint32_t len) {}
+    virtual xlCircleAccumulator* Flush() { FlushRange(0, getCount()); return this; }
+
+protected:
+    std::string name;
+};
+
+
+// Connected lines drawn with a width in pixels, joins, anti-aliased edges
+// and optional dashes.  Each segment is expanded into a quad on the GPU from
+// the point data, so any number of lines is one draw.
+class xlPolylineAccumulator {
+public:
+    enum JoinStyle {
+        MITER_JOIN, // sharp corners, beveled when longer than the miter limit
+        ROUND_JOIN, // round joins and round line ends
+        BEVEL_JOIN
+    };
+
+    xlPolylineAccumulator() {}
+    virtual ~xlPolylineAccumulator() {}
+
+    xlPolylineAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    virtual void Reset() {}
+    virtual void PreAlloc(unsigned int points) {};
+    // The following points form a new line, closed lines also join the last
+    // point back to the first
+    virtual void StartLine(bool closed = false) {};
+    virtual void AddPoint(float x, float y, float z, const xlColor &c) {};
+    virtual void AddPoint(float x, float y, const xlColor &c) { AddPoint(x, y, 0.0f, c); }
+    // number of points
+    virtual uint32_t getCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // lines cannot be added, but if mayChange is set, the points can
+    // change via SetPoint and then flushed to push the new data to the graphics card
+    virtual void Finalize(bool mayChange) {}
+    virtual void SetPoint(uint32_t idx, float x, float y, float z, const xlColor &c) {};
+    virtual void FlushRange(uint32_t start, uint32_t len) {}
+    virtual xlPolylineAccumulator* Flush() { FlushRange(0, getCount()); return this; }
+
+    void AddLine(float x1, float y1, float x2, float y2, const xlColor &c);
+    void AddRectAsLines(float x1, float y1, float x2, float y2, const xlColor &c);
+
+protected:
+    std::string name;
+};
+
+
+// Rectangles filled with a gradient through any number of evenly spaced
+// colors.  Each fill is a single quad, the colors are baked into a row of a
+// lookup texture shared by all the fills with the same colors.
+class xlGradientAccumulator {
+public:
+    enum GradientType {
+        LINEAR_GRADIENT,  // along the line p0,p1 - p2,p3
+        RADIAL_GRADIENT,  // out from the center p0,p1 to radius p2
+        ANGULAR_GRADIENT  // counter clockwise around the center p0,p1 from angle p2 in radians
+    };
+    // texels in a lookup row
+    static const int RAMP_WIDTH = 256;
+
+    xlGradientAccumulator() {}
+    virtual ~xlGradientAccumulator() {}
+
+    xlGradientAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    // blend the colors of the gradients added afterwards in linear light
+    // rather than between the sRGB values, which avoids the dark band
+    // between saturated colors
+    void SetLinearLight(bool b) { linearLight = b; }
+
+    virtual void Reset() {}
+    virtual void PreAlloc(unsigned int i) {};
+    // Fills the rectangle x1,y1 - x2,y2 at depth z, past the ends of the
+    // gradient the end colors continue
+    virtual void AddGradient(GradientType type, float x1, float y1, float x2, float y2, float z,
+                             float p0, float p1, float p2, float p3, const xlColorVector &colors) {};
+    virtual uint32_t getCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // gradients cannot be added, but if mayChange is set, their colors can
+    // change via SetColors and then flushed to push the new data to the graphics card
+    virtual void Finalize(bool mayChange) {}
+    virtual void SetColors(uint32_t idx, const xlColorVector &colors) {};
+    virtual void FlushRange(uint32_t start, uint32_t len) {}
+    virtual xlGradientAccumulator* Flush() { FlushRange(0, getCount()); return this; }
+
+    // left to right across the rectangle, like AddHBlendedRectangleAsTriangles
+    void AddHorizontalGradient(float x1, float y1, float x2, float y2, const xlColorVector &colors);
+    void AddLinearGradient(float x1, float y1, float x2, float y2, float z,
+                           float gx1, float gy1, float gx2, float gy2, const xlColorVector &colors);
+    void AddRadialGradient(float x1, float y1, float x2, float y2, float z,
+                           float cx, float cy, float radius, const xlColorVector &colors);
+    void AddAngularGradient(float x1, float y1, float x2, float y2, float z,
+                            float cx, float cy, float startAngle, const xlColorVector &colors);
+
+    // The lookup row for the colors, RAMP_WIDTH RGBA values
+    static void FillRamp(const xlColorVector &colors, bool linearLight, uint32_t *ramp);
+
+protected:
+    std::string name;
+    bool linearLight = false;
+};
+
+
+// Pixels whose positions and sizes are set once and whose colors change
+// every frame, such as the nodes of a model preview.  Only the colors are
+// sent to the graphics card after the first draw, three bytes a pixel.
+class xlPixelGridAccumulator {
+public:
+    enum PixelShape {
+        SQUARE_PIXELS,
+        ROUND_PIXELS,  // anti-aliased circles
+        BLURRED_PIXELS // fading out from the center
+    };
+
+    xlPixelGridAccumulator() {}
+    virtual ~xlPixelGridAccumulator() {}
+
+    xlPixelGridAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    virtual void Reset() {}
+    virtual void PreAlloc(unsigned int i) {};
+    // size is the width of the pixel in screen pixels, the pixel starts black
+    virtual void AddPixel(float x, float y, float z, float size) {};
+    virtual uint32_t getCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // pixels cannot be added, but if mayChange is set, they can move
+    // via SetPixel.  The colors can always change.
+    virtual void Finalize(bool mayChange) {}
+    virtual void SetPixel(uint32_t idx, float x, float y, float z, float size) {};
+
+    virtual void SetColor(uint32_t idx, const xlColor &c) {};
+    // count tightly packed RGB colors for the pixels from start on
+    virtual void SetColors(const uint8_t *rgb, uint32_t start, uint32_t count) {};
+
+protected:
+    std::string name;
+};
+
+
+// Filled shapes outlined by lines and curves in the xy plane.  Curves are
+// flattened here, to within the tessellation scale when one is set, and the shapes are filled on the graphics card through the stencil
+// buffer so they are never triangulated.  Contours may cross themselves and
+// each other, the fill rule decides what's inside.
+class xlPathAccumulator : public xlTessellationScale {
+public:
+    enum FillRule {
+        NONZERO_FILL,
+        EVEN_ODD_FILL
+    };
+
+    xlPathAccumulator() {}
+    virtual ~xlPathAccumulator() {}
+
+    xlPathAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    virtual void Reset() {}
+    // The following contours form a new shape
+    virtual void StartPath(const xlColor &c, FillRule rule = NONZERO_FILL, float z = 0.0f) {};
+    // number of paths
+    virtual uint32_t getCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // paths cannot be added, but if mayChange is set, their colors can
+    // change via SetColor
+    virtual void Finalize(bool mayChange) {}
+    virtual void SetColor(uint32_t idx, const xlColor &c) {};
+
+    // Contours are always closed.  MoveTo starts the next one, as does
+    // drawing on after Close, from the start point of the closed one
+    void MoveTo(float x, float y);
+    void LineTo(float x, float y);
+    void QuadTo(float cx, float cy, float x, float y);
+    void CubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y);
+    void Close();
+
+protected:
+    // the flattened outline
+    virtual void StartContour(float x, float y) {};
+    virtual void AddContourPoint(float x, float y) {};
+    virtual void EndContour() {};
+
+    std::string name;
+    float startX = 0.0f;
+    float startY = 0.0f;
+    float penX = 0.0f;
+    float penY = 0.0f;
+};
+
+
+// Triangles or lines sorted into square tiles of the xy plane, each with its
+// own range of the vertex buffer and bounds, so a draw only sends the tiles
+// that are in view and a change only sends the tiles it touches.  Meant for
+// large layouts that are panned and zoomed.  Vertices are added and changed
+// as for xlVertexColorAccumulator, each triangle or line goes in the tile
+// holding its center.
+class xlChunkedColorAccumulator {
+public:
+    enum PrimitiveType {
+        CHUNKED_TRIANGLES,
+        CHUNKED_LINES
+    };
+
+    xlChunkedColorAccumulator() {}
+    virtual ~xlChunkedColorAccumulator() {}
+
+    xlChunkedColorAccumulator *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    virtual void Reset() {}
+    virtual void PreAlloc(unsigned int i) {};
+    virtual void AddVertex(float x, float y, float z, const xlColor &c) {};
+    void AddVertex(float x, float y, const xlColor &c) { AddVertex(x, y, 0.0f, c); }
+    virtual uint32_t getCount() { return 0; }
+    // tiles holding anything, once drawn or finalized
+    virtual uint32_t getTileCount() { return 0; }
+
+    // mark this as ready to be copied to graphics card, after finalize,
+    // vertices cannot be added, but if mayChange is set, they can change
+    // via SetVertex.  Vertices stay in the tile they were first put in.
+    virtual void Finalize(bool mayChangeVertices, bool mayChangeColors) {}
+    virtual void SetVertex(uint32_t vertex, float x, float y, float z, const xlColor &c) {};
+    virtual void SetVertex(uint32_t vertex, const xlColor &c) {};
+
+protected:
+    std::string name;
+};
+
+
+// Many small accumulators that don't change, such as backgrounds, grids and
+// outlines, copied into one vertex buffer and drawn with one call per kind of
+// primitive instead of one call each.  Members must be finalized with
+// mayChange off, others are logged and draw nothing.  The members are only
+// read when the batch is rebuilt, on the next draw after a member is added,
+// replaced or removed, so they must stay alive while in the batch.
+class xlStaticBatch {
+public:
+    enum PrimitiveType {
+        BATCH_TRIANGLES,
+        BATCH_TRIANGLE_STRIP,
+        BATCH_LINES,
+        BATCH_LINE_STRIP
+    };
+
+    xlStaticBatch() {}
+    virtual ~xlStaticBatch() {}
+
+    xlStaticBatch *SetName(const std::string &n) { name = n; return this; }
+    const std::string &GetName() const { return name; }
+
+    // Returns the index of the member
+    virtual uint32_t Add(xlVertexColorAccumulator *vac, PrimitiveType type) { return 0; }
+    // vertices without colors take the color given
+    virtual uint32_t Add(xlVertexAccumulator *vac, const xlColor &c, PrimitiveType type) { return 0; }
+    virtual void Replace(uint32_t idx, xlVertexColorAccumulator *vac) {}
+    virtual void Replace(uint32_t idx, xlVertexAccumulator *vac, const xlColor &c) {}
+    // the member draws nothing, its index stays valid
+    virtual void Remove(uint32_t idx) {}
+    // hidden members stay in the buffer, only the draw ranges change
+    virtual void SetVisible(uint32_t idx, bool visible) {}
+    virtual void Clear() {}
+    virtual uint32_t getCount() { return 0; }
+
+protected:
+    std::string name;
+};
+
+
 class xlVertexTextureAccumulator {
 public:
     xlVertexTextureAccumulator() {}
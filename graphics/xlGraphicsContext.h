@@ -9,7 +9,7 @@
 #include "xlGraphicsAccumulators.h"
 //#include "xlFontInfo.h"
 
-//class xlMesh;
+class xlMesh;
 class wxWindow;
 
 class xlGraphicsContext {
@@ -27,13 +27,20 @@ public:
     virtual xlVertexColorAccumulator *createVertexColorAccumulator() = 0;
     virtual xlVertexTextureAccumulator *createVertexTextureAccumulator() = 0;
     virtual xlVertexIndexedColorAccumulator *createVertexIndexedColorAccumulator() = 0;
+    virtual xlCircleAccumulator *createCircleAccumulator() = 0;
+    virtual xlPolylineAccumulator *createPolylineAccumulator() = 0;
+    virtual xlGradientAccumulator *createGradientAccumulator() = 0;
+    virtual xlPixelGridAccumulator *createPixelGridAccumulator() = 0;
+    virtual xlPathAccumulator *createPathAccumulator() = 0;
+    virtual xlChunkedColorAccumulator *createChunkedColorAccumulator(xlChunkedColorAccumulator::PrimitiveType type, float tileSize) = 0;
+    virtual xlStaticBatch *createStaticBatch() = 0;
     virtual xlTexture *createTextureMipMaps(const std::vector<wxBitmap> &bitmaps) = 0;
     virtual xlTexture *createTextureMipMaps(const std::vector<wxImage> &images) = 0;
     virtual xlTexture *createTexture(const wxImage &image) = 0;
     virtual xlTexture *createTexture(int w, int h, bool bgr, bool alpha) = 0;
     //virtual xlTexture *createTextureForFont(const xlFontInfo &font) = 0;
     virtual xlGraphicsProgram *createGraphicsProgram() = 0;
-    // virtual xlMesh *loadMeshFromObjFile(const std::string &file) = 0;
+    virtual xlMesh *loadMeshFromObjFile(const std::string &file) = 0;
 
 
     //manipulating the matrices
@@ -49,6 +56,10 @@ public:
     virtual xlGraphicsContext* ScaleViewMatrix(float w, float h, float z) = 0;
     virtual xlGraphicsContext* TranslateViewMatrix(float x, float y, float z) = 0;
 
+    // Pixels covered by one model unit at the model origin with the current
+    // matrices, for sizing tessellation to the view (see xlTessellationScale)
+    virtual float GetPixelsPerUnit() = 0;
+
     
 
     //setters for various states
@@ -67,6 +78,9 @@ public:
     virtual xlGraphicsContext* drawTriangles(xlVertexColorAccumulator *vac, int start = 0, int count = -1) = 0;
     virtual xlGraphicsContext* drawTriangleStrip(xlVertexColorAccumulator *vac, int start = 0, int count = -1) = 0;
     virtual xlGraphicsContext* drawPoints(xlVertexColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) = 0;
+    // drawPoints without the points that are black or fully transparent, for
+    // frames where most of the pixels are off
+    virtual xlGraphicsContext* drawVisiblePoints(xlVertexColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) = 0;
 
     virtual xlGraphicsContext* drawLines(xlVertexIndexedColorAccumulator *vac, int start = 0, int count = -1) = 0;
     virtual xlGraphicsContext* drawLineStrip(xlVertexIndexedColorAccumulator *vac, int start = 0, int count = -1) = 0;
@@ -74,6 +88,22 @@ public:
     virtual xlGraphicsContext* drawTriangleStrip(xlVertexIndexedColorAccumulator *vac, int start = 0, int count = -1) = 0;
     virtual xlGraphicsContext* drawPoints(xlVertexIndexedColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) = 0;
 
+    virtual xlGraphicsContext* drawCircles(xlCircleAccumulator *cac, int start = 0, int count = -1) = 0;
+    // width in pixels, dashLength > 0 dashes the lines (lengths in model units)
+    virtual xlGraphicsContext* drawPolylines(xlPolylineAccumulator *pac, float width,
+                                             xlPolylineAccumulator::JoinStyle join = xlPolylineAccumulator::MITER_JOIN,
+                                             float dashLength = 0.0f, float gapLength = 0.0f) = 0;
+    virtual xlGraphicsContext* drawGradients(xlGradientAccumulator *gac, int start = 0, int count = -1) = 0;
+    // hideBlack skips the pixels that are off
+    virtual xlGraphicsContext* drawPixelGrid(xlPixelGridAccumulator *pac,
+                                             xlPixelGridAccumulator::PixelShape shape = xlPixelGridAccumulator::SQUARE_PIXELS,
+                                             bool hideBlack = false, int start = 0, int count = -1) = 0;
+    // fills through the stencil buffer, without one only convex paths fill correctly
+    virtual xlGraphicsContext* drawPaths(xlPathAccumulator *pac, int start = 0, int count = -1) = 0;
+    // only the tiles inside the view
+    virtual xlGraphicsContext* drawChunks(xlChunkedColorAccumulator *cac) = 0;
+    virtual xlGraphicsContext* drawStaticBatch(xlStaticBatch *batch) = 0;
+
     
     virtual xlGraphicsContext* drawTexture(xlTexture *texture,
                              float x, float y, float x2, float y2,
@@ -86,9 +116,9 @@ public:
     virtual xlGraphicsContext* drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, const xlColor &c, int start = 0, int count = -1) = 0;
     virtual xlGraphicsContext* drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, int brightness, uint8_t alpha, int start, int count) = 0;
     
-    // virtual xlGraphicsContext* drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) = 0;
-    // virtual xlGraphicsContext* drawMeshTransparents(xlMesh *mesh, int brightness) = 0;
-    // virtual xlGraphicsContext* drawMeshWireframe(xlMesh *mesh, int brightness) = 0;
+    virtual xlGraphicsContext* drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) = 0;
+    virtual xlGraphicsContext* drawMeshTransparents(xlMesh *mesh, int brightness) = 0;
+    virtual xlGraphicsContext* drawMeshWireframe(xlMesh *mesh, int brightness) = 0;
     
     
     virtual xlGraphicsContext* pushDebugContext(const std::string &label) { return this; }
@@ -0,0 +1,251 @@
+#include "xlMeshOptimizer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+xlMeshOptimizer::CacheStats xlMeshOptimizer::AnalyzeVertexCache(const uint32_t *indexes, size_t indexCount, size_t vertexCount, int cacheSize) {
+    CacheStats stats;
+    if (indexCount < 3 || vertexCount == 0) {
+        return stats;
+    }
+    // time stamp of when each vertex entered the FIFO, it is still in it while
+    // fewer than cacheSize misses happened since
+    std::vector<int64_t> stamp(vertexCount, INT64_MIN / 2);
+    std::vector<bool> used(vertexCount, false);
+    int64_t misses = 0;
+    size_t unique = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t v = indexes[i];
+        if (v >= vertexCount) {
+            continue;
+        }
+        if (misses - stamp[v] >= cacheSize) {
+            stamp[v] = misses;
+            misses++;
+        }
+        if (!used[v]) {
+            used[v] = true;
+            unique++;
+        }
+    }
+    stats.acmr = (float)misses / (float)(indexCount / 3);
+    stats.atvr = unique ? (float)misses / (float)unique : 0.0f;
+    return stats;
+}
+
+void xlMeshOptimizer::OptimizeVertexCache(uint32_t *indexes, size_t indexCount, size_t vertexCount,
+                                          int cacheSize, std::vector<uint32_t> *clusters) {
+    size_t triCount = indexCount / 3;
+    if (clusters) {
+        clusters->clear();
+        clusters->push_back(0);
+    }
+    if (triCount < 2 || vertexCount == 0) {
+        return;
+    }
+
+    // vertex -> triangles adjacency, as offsets into one array
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < triCount * 3; i++) {
+        live[indexes[i]]++;
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(triCount * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triCount; t++) {
+            for (int c = 0; c < 3; c++) {
+                adjacency[fill[indexes[t * 3 + c]]++] = t;
+            }
+        }
+    }
+
+    std::vector<int64_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> out;
+    out.reserve(triCount * 3);
+
+    int64_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = indexes[0];
+    bool jumped = false;
+
+    while (fanning >= 0) {
+        candidates.clear();
+        // emit every remaining triangle around the fanning vertex
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            if (jumped && clusters && !out.empty()) {
+                clusters->push_back(out.size() / 3);
+            }
+            jumped = false;
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = indexes[t * 3 + c];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time;
+                    time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate still in cache the longest that
+        // won't be pushed out while its own remaining triangles are emitted
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * (int64_t)live[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+        if (best < 0) {
+            // dead end, go back through the recently used vertices and
+            // finally to the next vertex in input order
+            while (!deadEnd.empty() && best < 0) {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) {
+                    best = v;
+                    jumped = true;
+                }
+            }
+            while (best < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0) {
+                    best = cursor;
+                    jumped = true;
+                }
+                cursor++;
+            }
+        }
+        fanning = best;
+    }
+    std::copy(out.begin(), out.end(), indexes);
+}
+
+void xlMeshOptimizer::OptimizeOverdraw(uint32_t *indexes, size_t indexCount, const float *positions, size_t stride,
+                                       size_t vertexCount, const std::vector<uint32_t> &clusters,
+                                       int cacheSize, float threshold) {
+    size_t triCount = indexCount / 3;
+    if (clusters.size() < 2 || triCount < 2) {
+        return;
+    }
+
+    struct Cluster {
+        uint32_t start;
+        uint32_t count;
+        float sortKey;
+    };
+    std::vector<Cluster> info(clusters.size());
+
+    // centroid of the whole mesh, triangles weighted by area
+    float meshCenter[3] = { 0, 0, 0 };
+    float meshArea = 0;
+    std::vector<float> clusterCenter(clusters.size() * 3, 0.0f);
+    std::vector<float> clusterNormal(clusters.size() * 3, 0.0f);
+    std::vector<float> clusterArea(clusters.size(), 0.0f);
+    for (size_t c = 0; c < clusters.size(); c++) {
+        info[c].start = clusters[c];
+        info[c].count = (c + 1 < clusters.size() ? clusters[c + 1] : triCount) - clusters[c];
+        for (uint32_t t = info[c].start; t < info[c].start + info[c].count; t++) {
+            const float *p0 = positions + indexes[t * 3] * stride;
+            const float *p1 = positions + indexes[t * 3 + 1] * stride;
+            const float *p2 = positions + indexes[t * 3 + 2] * stride;
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int x = 0; x < 3; x++) {
+                float center = (p0[x] + p1[x] + p2[x]) / 3.0f;
+                clusterCenter[c * 3 + x] += center * area;
+                clusterNormal[c * 3 + x] += n[x];
+                meshCenter[x] += center * area;
+            }
+            clusterArea[c] += area;
+            meshArea += area;
+        }
+    }
+    if (meshArea <= 0.0f) {
+        return;
+    }
+    for (int x = 0; x < 3; x++) {
+        meshCenter[x] /= meshArea;
+    }
+    // clusters facing away from the center are likely in front of the others
+    // from most view directions, draw them first
+    for (size_t c = 0; c < clusters.size(); c++) {
+        float key = 0.0f;
+        if (clusterArea[c] > 0.0f) {
+            float len = std::sqrt(clusterNormal[c * 3] * clusterNormal[c * 3]
+                                  + clusterNormal[c * 3 + 1] * clusterNormal[c * 3 + 1]
+                                  + clusterNormal[c * 3 + 2] * clusterNormal[c * 3 + 2]);
+            if (len > 0.0f) {
+                for (int x = 0; x < 3; x++) {
+                    key += (clusterCenter[c * 3 + x] / clusterArea[c] - meshCenter[x]) * clusterNormal[c * 3 + x] / len;
+                }
+            }
+        }
+        info[c].sortKey = key;
+    }
+    std::stable_sort(info.begin(), info.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(triCount * 3);
+    for (auto &c : info) {
+        sorted.insert(sorted.end(), indexes + c.start * 3, indexes + (c.start + c.count) * 3);
+    }
+    // the cluster boundaries are where the cache was cold anyway, but keep the
+    // cache order if the new order costs noticeably more vertex work
+    CacheStats before = AnalyzeVertexCache(indexes, triCount * 3, vertexCount, cacheSize);
+    CacheStats after = AnalyzeVertexCache(&sorted[0], sorted.size(), vertexCount, cacheSize);
+    if (after.acmr <= before.acmr * threshold) {
+        std::copy(sorted.begin(), sorted.end(), indexes);
+    }
+}
+
+void xlMeshOptimizer::OptimizeVertexFetch(uint32_t *indexes, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap) {
+    const uint32_t unused = UINT32_MAX;
+    remap.assign(vertexCount, unused);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t &r = remap[indexes[i]];
+        if (r == unused) {
+            r = next++;
+        }
+        indexes[i] = r;
+    }
+    for (auto &r : remap) {
+        if (r == unused) {
+            r = next++;
+        }
+    }
+}
+
+void xlMeshOptimizer::OptimizeTriangles(uint32_t *indexes, size_t indexCount, const float *positions, size_t stride,
+                                        size_t vertexCount, int cacheSize) {
+    std::vector<uint32_t> clusters;
+    OptimizeVertexCache(indexes, indexCount, vertexCount, cacheSize, &clusters);
+    if (positions) {
+        OptimizeOverdraw(indexes, indexCount, positions, stride, vertexCount, clusters, cacheSize);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Load time reordering of indexed triangle lists so the GPU does less work.
+//
+//  - OptimizeVertexCache reorders triangles for the post transform vertex
+//    cache (Tipsify, Sander et al. 2007).
+//  - OptimizeOverdraw then reorders the clusters Tipsify produced so triangles
+//    facing out of the mesh are drawn first, as long as that doesn't cost more
+//    than 'threshold' times the cache efficiency.
+//  - OptimizeVertexFetch renumbers the vertices in the order they are first
+//    used, so the vertex fetch walks the buffers mostly sequentially.
+//
+// Index arrays are triangle lists.  Only the order of triangles changes, never
+// which vertices a triangle uses or its winding.
+class xlMeshOptimizer {
+public:
+    struct CacheStats {
+        float acmr = 0.0f; // average cache miss ratio, transformed vertices per triangle
+        float atvr = 0.0f; // average transform to vertex ratio, 1.0 is ideal
+    };
+    // FIFO cache simulation, the model most GPUs are close to
+    static CacheStats AnalyzeVertexCache(const uint32_t *indexes, size_t indexCount, size_t vertexCount, int cacheSize = 16);
+
+    // 'clusters' (if not null) receives the triangle offsets where the order had
+    // to jump to an unrelated part of the mesh, the first is always 0
+    static void OptimizeVertexCache(uint32_t *indexes, size_t indexCount, size_t vertexCount,
+                                    int cacheSize = 16, std::vector<uint32_t> *clusters = nullptr);
+
+    // positions are xyz floats 'stride' floats apart
+    static void OptimizeOverdraw(uint32_t *indexes, size_t indexCount, const float *positions, size_t stride,
+                                 size_t vertexCount, const std::vector<uint32_t> &clusters,
+                                 int cacheSize = 16, float threshold = 1.05f);
+
+    // Fills remap with the new index of every old vertex and rewrites the
+    // indexes.  Vertices never used by the indexes keep their relative order
+    // after the used ones.
+    static void OptimizeVertexFetch(uint32_t *indexes, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap);
+
+    // Moves 'components' values per vertex to their new place
+    template<class T>
+    static void RemapVertices(std::vector<T> &data, size_t components, const std::vector<uint32_t> &remap) {
+        std::vector<T> out(data.size());
+        for (size_t v = 0; v < remap.size() && (v + 1) * components <= data.size(); v++) {
+            for (size_t c = 0; c < components; c++) {
+                out[remap[v] * components + c] = data[v * components + c];
+            }
+        }
+        data.swap(out);
+    }
+
+    // The cache and overdraw passes on one triangle range
+    static void OptimizeTriangles(uint32_t *indexes, size_t indexCount, const float *positions, size_t stride,
+                                  size_t vertexCount, int cacheSize = 16);
+};
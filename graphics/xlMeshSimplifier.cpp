@@ -0,0 +1,282 @@
+#include "xlMeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    // Sum of squared distances to a set of planes, weighted by triangle area:
+    // Q(p) = p.A.p + 2 b.p + c, A symmetric
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double weight = 0;
+
+        void AddPlane(const double n[3], double d, double w) {
+            a00 += w * n[0] * n[0];
+            a01 += w * n[0] * n[1];
+            a02 += w * n[0] * n[2];
+            a11 += w * n[1] * n[1];
+            a12 += w * n[1] * n[2];
+            a22 += w * n[2] * n[2];
+            b0 += w * n[0] * d;
+            b1 += w * n[1] * d;
+            b2 += w * n[2] * d;
+            c += w * d * d;
+            weight += w;
+        }
+        void Add(const Quadric &q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+        // mean squared distance of p to the planes
+        double Error(const float *p) const {
+            double x = p[0], y = p[1], z = p[2];
+            double e = a00 * x * x + a11 * y * y + a22 * z * z
+                     + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                     + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    static inline void Normal(const float *p0, const float *p1, const float *p2, double n[3]) {
+        double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+        double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    struct PositionHash {
+        const float *positions;
+        size_t stride;
+        size_t operator()(uint32_t v) const {
+            uint32_t h[3];
+            memcpy(h, positions + v * stride, sizeof(h));
+            return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+        }
+    };
+    struct PositionEqual {
+        const float *positions;
+        size_t stride;
+        bool operator()(uint32_t a, uint32_t b) const {
+            const float *pa = positions + a * stride;
+            const float *pb = positions + b * stride;
+            return pa[0] == pb[0] && pa[1] == pb[1] && pa[2] == pb[2];
+        }
+    };
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        float cost;
+    };
+}
+
+float xlMeshSimplifier::GetExtent(const float *positions, size_t stride, size_t vertexCount) {
+    if (vertexCount == 0) {
+        return 0.0f;
+    }
+    float mn[3] = { positions[0], positions[1], positions[2] };
+    float mx[3] = { mn[0], mn[1], mn[2] };
+    for (size_t v = 1; v < vertexCount; v++) {
+        for (int x = 0; x < 3; x++) {
+            mn[x] = std::min(mn[x], positions[v * stride + x]);
+            mx[x] = std::max(mx[x], positions[v * stride + x]);
+        }
+    }
+    return std::max(mx[0] - mn[0], std::max(mx[1] - mn[1], mx[2] - mn[2]));
+}
+
+size_t xlMeshSimplifier::Simplify(uint32_t *out, const uint32_t *indexes, size_t indexCount,
+                                  const float *positions, size_t stride, size_t vertexCount,
+                                  size_t targetIndexCount, float maxError, float *error) {
+    indexCount -= indexCount % 3;
+    std::copy(indexes, indexes + indexCount, out);
+    if (error) {
+        *error = 0.0f;
+    }
+    if (indexCount <= targetIndexCount || vertexCount == 0) {
+        return indexCount;
+    }
+
+    // vertices sharing a position, the first one stands for all of them
+    std::vector<uint32_t> wedge(vertexCount);
+    std::vector<uint32_t> wedgeCount(vertexCount, 0);
+    {
+        std::unordered_map<uint32_t, uint32_t, PositionHash, PositionEqual> first(vertexCount,
+            PositionHash{ positions, stride }, PositionEqual{ positions, stride });
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            wedge[v] = first.emplace(v, v).first->second;
+            wedgeCount[wedge[v]]++;
+        }
+    }
+
+    // open or non manifold edges, counted between positions
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            for (int e = 0; e < 3; e++) {
+                uint64_t a = wedge[out[i + e]];
+                uint64_t b = wedge[out[i + (e + 1) % 3]];
+                if (a != b) {
+                    edges[a < b ? (a << 32) | b : (b << 32) | a]++;
+                }
+            }
+        }
+        for (auto &e : edges) {
+            if (e.second != 2) {
+                locked[e.first >> 32] = true;
+                locked[e.first & 0xffffffff] = true;
+            }
+        }
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            if (wedgeCount[wedge[v]] > 1 || locked[wedge[v]]) {
+                locked[v] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indexCount; i += 3) {
+        const float *p0 = positions + out[i] * stride;
+        double n[3];
+        Normal(p0, positions + out[i + 1] * stride, positions + out[i + 2] * stride, n);
+        double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len <= 0.0) {
+            continue;
+        }
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int c = 0; c < 3; c++) {
+            quadrics[wedge[out[i + c]]].AddPlane(n, d, len * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> offsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    const float maxCost = maxError * maxError;
+    float maxUsed = 0.0f;
+
+    while (indexCount > targetIndexCount) {
+        // vertex -> triangles
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (size_t i = 0; i < indexCount; i++) {
+            offsets[out[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(indexCount);
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indexCount; i++) {
+                adjacency[fill[out[i]]++] = (uint32_t)(i / 3);
+            }
+        }
+
+        // every edge, in both directions where the start may move
+        collapses.clear();
+        for (size_t i = 0; i < indexCount; i += 3) {
+            for (int e = 0; e < 3; e++) {
+                uint32_t a = out[i + e];
+                uint32_t b = out[i + (e + 1) % 3];
+                for (int dir = 0; dir < 2; dir++) {
+                    if (!locked[a]) {
+                        Quadric q = quadrics[wedge[a]];
+                        q.Add(quadrics[wedge[b]]);
+                        collapses.push_back({ a, b, (float)q.Error(positions + b * stride) });
+                    }
+                    std::swap(a, b);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        // each collapse removes about two triangles, don't overshoot the target
+        size_t limit = std::max((size_t)1, (indexCount - targetIndexCount) / 6);
+        size_t applied = 0;
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        for (const Collapse &c : collapses) {
+            if (applied >= limit || c.cost > maxCost) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+            // the triangles around 'from' that stay must not flip over
+            const float *pt = positions + c.to * stride;
+            bool flips = false;
+            for (uint32_t a = offsets[c.from]; a < offsets[c.from + 1] && !flips; a++) {
+                const uint32_t *tri = out + adjacency[a] * 3;
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    continue;
+                }
+                const float *p[3];
+                const float *q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = positions + tri[k] * stride;
+                    q[k] = tri[k] == c.from ? pt : p[k];
+                }
+                double n0[3], n1[3];
+                Normal(p[0], p[1], p[2], n0);
+                Normal(q[0], q[1], q[2], n1);
+                // also refuse large turns, small ones add up over the passes
+                double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+                double len2 = (n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2])
+                            * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+                flips = dot <= 0.0 || dot * dot < 0.25 * len2;
+            }
+            if (flips) {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            quadrics[wedge[c.to]].Add(quadrics[wedge[c.from]]);
+            // the neighbourhood changed, leave it alone until the next pass
+            for (uint32_t a = offsets[c.from]; a < offsets[c.from + 1]; a++) {
+                const uint32_t *tri = out + adjacency[a] * 3;
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+            maxUsed = std::max(maxUsed, std::sqrt(c.cost));
+            applied++;
+        }
+        if (applied == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            uint32_t a = remap[out[i]];
+            uint32_t b = remap[out[i + 1]];
+            uint32_t c = remap[out[i + 2]];
+            if (a != b && b != c && a != c) {
+                out[write++] = a;
+                out[write++] = b;
+                out[write++] = c;
+            }
+        }
+        indexCount = write;
+    }
+
+    if (error) {
+        *error = maxUsed;
+    }
+    return indexCount;
+}
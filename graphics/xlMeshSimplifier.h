@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Quadric error metric simplification (Garland and Heckbert 1997) for building
+// levels of detail of indexed triangle lists.
+//
+// Collapses only move a vertex onto one of its neighbours, so every level
+// indexes the original vertex buffer and can share it with the full mesh.
+// Vertices on open borders and on attribute seams (several vertices at the
+// same position with different normals, uvs or colors) never move, which keeps
+// the silhouette of open meshes and the texture/normal seams intact.
+class xlMeshSimplifier {
+public:
+    // Writes the simplified triangles of indexes to out (at least indexCount
+    // long, may not be indexes) and returns their index count.  Stops at about
+    // targetIndexCount or when the next collapse would move the surface more
+    // than maxError, in position units.  'error' receives the largest error of
+    // the collapses made.  Positions are xyz floats 'stride' floats apart.
+    static size_t Simplify(uint32_t *out, const uint32_t *indexes, size_t indexCount,
+                           const float *positions, size_t stride, size_t vertexCount,
+                           size_t targetIndexCount, float maxError, float *error = nullptr);
+
+    // Largest side of the bounding box, to turn relative errors into position units
+    static float GetExtent(const float *positions, size_t stride, size_t vertexCount);
+};
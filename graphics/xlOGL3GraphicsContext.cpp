@@ -11,10 +11,14 @@
 
 #include "xlOGL3GraphicsContext.h"
 
+#include <limits>
 #include <log4cpp/Category.hh>
 
 #include "DrawGLUtils.h"
-// #include "../xlMesh.h"
+#include "xlShaderCache.h"
+#include "xlSceneGraph.h"
+#include "xlSIMD.h"
+#include "../xlMesh.h"
 
 #include <glm/mat4x4.hpp>
 #include <glm/glm.hpp>
@@ -174,6 +178,24 @@
 
 
 
+// uniform buffer binding point of the FrameData block
+static const GLuint FRAME_DATA_BINDING = 0;
+// The FrameData uniform buffer is shared by every context, it's only rewritten
+// when the matrices change or a different context last filled it.
+static GLuint frameDataBuffer = 0;
+static uint64_t frameDataOwner = 0;
+static uint64_t nextContextSerial = 1;
+
+// std140 layout shared by all core profile programs, must match OGLFrameData
+#define FRAME_DATA_BLOCK \
+    "layout(std140) uniform FrameData {\n" \
+    "    mat4 MVP;\n" \
+    "    mat4 modelMatrix;\n" \
+    "    mat4 viewMatrix;\n" \
+    "    mat4 perspectiveMatrix;\n" \
+    "    vec4 viewport;\n" \
+    "};\n"
+
 class ShaderProgram {
 public:
     ShaderProgram() {}
@@ -186,7 +208,8 @@ public:
         }
     }
 
-    void UseProgram() const {
+    void UseProgram() {
+        EnsureReady();
         LOG_GL_ERRORV(glUseProgram(ProgramID));
     }
 
@@ -194,54 +217,130 @@ public:
         LOG_GL_ERRORV(glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(m)));
     }
 
-    void SetRenderType(int i) {
-        LOG_GL_ERRORV(glUniform1i(RenderTypeID, i));
-    }
-
     void UnbindBuffer(int idx) const {
         LOG_GL_ERRORV(glDisableVertexAttribArray(idx));
         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
     }
 
-    bool Init(const char * vs, const char * fs) {
-        GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-        if (VertexShaderID != 0) {
-            GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-            if (FragmentShaderID != 0) {
-                valid = CompileShader(vs, VertexShaderID);
-                valid &= CompileShader(fs, FragmentShaderID);
-                ProgramID = CreateProgram(VertexShaderID, FragmentShaderID);
-                valid &= ProgramID != 0;
-
-                if (ProgramID == 0)
-                {
-                    DrawGLUtils::DoLogGLError(__FILE__, __LINE__, "Failed to create program from vertex and fragment shader");
-                }
+    // Remember the sources but don't build anything until the program is first used
+    void Defer(const std::string &vs, const std::string &fs) {
+        vertexSource = vs;
+        fragmentSource = fs;
+        state = DEFERRED;
+    }
+
+    // Issue the compile and link without querying any status so the driver can
+    // work on several programs at once.  Results are checked in Resolve()
+    bool Submit(const std::string &vs, const std::string &fs) {
+        Defer(vs, fs);
+        return Submit();
+    }
+
+    bool Submit() {
+        if (state != DEFERRED) {
+            return valid;
+        }
+        cacheKey = xlShaderCache::MakeKey({ vertexSource, fragmentSource });
+        ProgramID = xlShaderCache::Load(cacheKey);
+        if (ProgramID != 0) {
+            fromCache = true;
+            state = SUBMITTED;
+            return true;
+        }
+
+        VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+        FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+        ProgramID = glCreateProgram();
+        if (VertexShaderID == 0 || FragmentShaderID == 0 || ProgramID == 0) {
+            DrawGLUtils::DoLogGLError(__FILE__, __LINE__, "Failed to create shaders or program");
+            ReleaseShaders();
+            valid = false;
+            state = READY;
+            return false;
+        }
+        const char *src = vertexSource.c_str();
+        LOG_GL_ERRORV(glShaderSource(VertexShaderID, 1, &src, NULL));
+        LOG_GL_ERRORV(glCompileShader(VertexShaderID));
+        src = fragmentSource.c_str();
+        LOG_GL_ERRORV(glShaderSource(FragmentShaderID, 1, &src, NULL));
+        LOG_GL_ERRORV(glCompileShader(FragmentShaderID));
+
+        LOG_GL_ERRORV(glAttachShader(ProgramID, VertexShaderID));
+        LOG_GL_ERRORV(glAttachShader(ProgramID, FragmentShaderID));
+        xlShaderCache::PrepareForLink(ProgramID);
+        LOG_GL_ERRORV(glLinkProgram(ProgramID));
+        state = SUBMITTED;
+        return true;
+    }
+
+    bool IsPending() const {
+        return state == SUBMITTED;
+    }
+    bool HasSource() const {
+        return state != NONE;
+    }
+
+    // True if Resolve() would not stall waiting on the driver.  Without
+    // KHR_parallel_shader_compile there is no way to ask, so assume it would.
+    bool IsComplete() const {
+        if (state != SUBMITTED) {
+            return state == READY;
+        }
+        if (fromCache || !GLEW_KHR_parallel_shader_compile) {
+            return fromCache;
+        }
+        GLint done = GL_FALSE;
+        LOG_GL_ERRORV(glGetProgramiv(ProgramID, GL_COMPLETION_STATUS_KHR, &done));
+        return done == GL_TRUE;
+    }
 
-                glDeleteShader(FragmentShaderID);
+    // Wait for the link, report any errors and look up the uniforms
+    bool Resolve() {
+        if (state != SUBMITTED) {
+            return valid;
+        }
+        if (!fromCache) {
+            valid = CheckProgram(ProgramID);
+            if (!valid) {
+                // the link log rarely says which stage failed, the compile logs do
+                CheckShader(VertexShaderID);
+                CheckShader(FragmentShaderID);
             }
-            else
-            {
-                DrawGLUtils::DoLogGLError(__FILE__, __LINE__, "Failed to create fragment shader");
+            LOG_GL_ERRORV(glDetachShader(ProgramID, VertexShaderID));
+            LOG_GL_ERRORV(glDetachShader(ProgramID, FragmentShaderID));
+            ReleaseShaders();
+            if (valid) {
+                xlShaderCache::Store(cacheKey, ProgramID);
             }
-            glDeleteShader(VertexShaderID);
-        }
-        else
-        {
-            DrawGLUtils::DoLogGLError(__FILE__, __LINE__, "Failed to create vertex shader");
         }
 
         if (valid) {
             LOG_GL_ERRORV(glUseProgram(ProgramID));
+            // core profile programs read the matrices from the shared FrameData block,
+            // the binding isn't guaranteed to survive a program binary so always set it
+            GLuint blockIndex = GL_INVALID_INDEX;
+            if (GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object) {
+                LOG_GL_ERRORV(blockIndex = glGetUniformBlockIndex(ProgramID, "FrameData"));
+            }
+            UsesFrameDataBlock = blockIndex != GL_INVALID_INDEX;
+            if (UsesFrameDataBlock) {
+                LOG_GL_ERRORV(glUniformBlockBinding(ProgramID, blockIndex, FRAME_DATA_BINDING));
+            }
             LOG_GL_ERRORV(MatrixID = glGetUniformLocation(ProgramID, "MVP"));
             LOG_GL_ERRORV(PointSmoothMinID = glGetUniformLocation(ProgramID, "PointSmoothMin"));
             LOG_GL_ERRORV(PointSmoothMaxID = glGetUniformLocation(ProgramID, "PointSmoothMax"));
-            LOG_GL_ERRORV(RenderTypeID = glGetUniformLocation(ProgramID, "RenderType"));
         }
-
+        state = READY;
         return valid;
     }
 
+    bool EnsureReady() {
+        if (state == DEFERRED) {
+            Submit();
+        }
+        return Resolve();
+    }
+
     void CalcSmoothPointParams(float ps) {
         LOG_GL_ERRORV(glPointSize(ps+1));
         float delta = 1.0 / (ps+1);
@@ -255,56 +354,34 @@ public:
         LOG_GL_ERRORV(glUniform1f(PointSmoothMaxID, max));
     }
 
-    float CalcSmoothPointParams() {
-        float ps;
-        LOG_GL_ERRORV(glGetFloatv(GL_POINT_SIZE, &ps));
-        CalcSmoothPointParams(ps);
-        return ps;
-    }
-
-    static GLuint CreateProgram(GLuint vs, GLuint fs) {
+    static bool CheckProgram(GLuint ProgramID) {
         static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
 
-        GLuint ProgramID = glCreateProgram();
-        if (ProgramID != 0) {
-            LOG_GL_ERRORV(glAttachShader(ProgramID, vs));
-            LOG_GL_ERRORV(glAttachShader(ProgramID, fs));
-            LOG_GL_ERRORV(glLinkProgram(ProgramID));
-
-            GLint Result = GL_FALSE;
-            int InfoLogLength;
-
-            LOG_GL_ERRORV(glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result));
-            LOG_GL_ERRORV(glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength));
-            if (!Result) {
-                logger_opengl.error("ShaderProgram::CreateProgram failed.");
-                if (InfoLogLength > 0) {
-                    std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-                    glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-                    wxString l = &ProgramErrorMessage[0];
-                    l.Trim();
-                    if (l.length() > 0) {
-                        printf("Program Log: %s\n", &ProgramErrorMessage[0]);
-                        logger_opengl.error(std::string(&ProgramErrorMessage[0]));
-                    }
+        GLint Result = GL_FALSE;
+        int InfoLogLength;
+
+        LOG_GL_ERRORV(glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result));
+        LOG_GL_ERRORV(glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength));
+        if (!Result) {
+            logger_opengl.error("ShaderProgram::CreateProgram failed.");
+            if (InfoLogLength > 0) {
+                std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+                glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+                wxString l = &ProgramErrorMessage[0];
+                l.Trim();
+                if (l.length() > 0) {
+                    printf("Program Log: %s\n", &ProgramErrorMessage[0]);
+                    logger_opengl.error(std::string(&ProgramErrorMessage[0]));
                 }
             }
-            LOG_GL_ERRORV(glDetachShader(ProgramID, vs));
-            LOG_GL_ERRORV(glDetachShader(ProgramID, fs));
-        }
-        else
-        {
-            DrawGLUtils::DoLogGLError(__FILE__, __LINE__, "glCreateProgram failed.");
+            return false;
         }
-        return ProgramID;
+        return true;
     }
 
-    static bool CompileShader(const char *sourcePointer, GLuint shaderID) {
+    static bool CheckShader(GLuint shaderID) {
         static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
 
-        LOG_GL_ERRORV(glShaderSource(shaderID, 1, &sourcePointer , NULL));
-        LOG_GL_ERRORV(glCompileShader(shaderID));
-
         GLint Result = GL_FALSE;
         int InfoLogLength;
 
@@ -332,15 +409,142 @@ public:
     GLuint MatrixID = 0;
     GLuint PointSmoothMinID = 0;
     GLuint PointSmoothMaxID = 0;
-    GLuint RenderTypeID = 0;
+    bool UsesFrameDataBlock = false;
 
     bool valid = true;
+
+private:
+    void ReleaseShaders() {
+        if (VertexShaderID != 0) {
+            glDeleteShader(VertexShaderID);
+            VertexShaderID = 0;
+        }
+        if (FragmentShaderID != 0) {
+            glDeleteShader(FragmentShaderID);
+            FragmentShaderID = 0;
+        }
+    }
+
+    enum BuildState {
+        NONE,
+        DEFERRED,
+        SUBMITTED,
+        READY
+    };
+    BuildState state = NONE;
+    std::string vertexSource;
+    std::string fragmentSource;
+    std::string cacheKey;
+    bool fromCache = false;
+    GLuint VertexShaderID = 0;
+    GLuint FragmentShaderID = 0;
+};
+
+// Feature bits selecting a shader variant
+enum ShaderFeature {
+    SHADER_SMOOTH_POINTS = 0x1, // round anti-aliased GL_POINTS
+    SHADER_ALPHA_TEXTURE = 0x2, // texture supplies only alpha, color comes from inColor
+    SHADER_UNIFORM_COLOR = 0x4, // ignore the per vertex colors and use inColor
+    SHADER_PIXEL_RADIUS = 0x8,  // circle radii are in pixels instead of model units
+    SHADER_ROUND_JOINS = 0x10,  // polylines with round joins and ends
+    SHADER_DASHED = 0x20,       // polylines dashed along their length
+    SHADER_BLURRED = 0x40,      // pixels fading out from their centers
+    SHADER_FEATURE_COUNT = 7
+};
+
+// One templated GLSL source compiled into a separate program per combination of
+// features, each enabled by a #define, so the shaders never branch per fragment
+// on a uniform.  Variants are built the first time they're requested.
+class ShaderPermutations {
+public:
+    static const int MAX_VARIANTS = 1 << SHADER_FEATURE_COUNT;
+
+    void Defer(const char * vs, const char * fs) {
+        vertexTemplate = vs;
+        fragmentTemplate = fs;
+    }
+
+    bool Submit(uint32_t key) {
+        if (!IsAvailable()) {
+            return false;
+        }
+        return Variant(key).Submit();
+    }
+
+    // false if the profile has no source for these programs
+    bool IsAvailable() const {
+        return !vertexTemplate.empty();
+    }
+
+    ShaderProgram *Get(uint32_t key) {
+        ShaderProgram &p = Variant(key);
+        p.EnsureReady();
+        return &p;
+    }
+
+    // every variant that has been requested or submitted
+    template <class F>
+    void ForEachVariant(F f) {
+        for (auto &v : variants) {
+            if (v.HasSource()) {
+                f(v);
+            }
+        }
+    }
+
+private:
+    ShaderProgram &Variant(uint32_t key) {
+        ShaderProgram &p = variants[key & (MAX_VARIANTS - 1)];
+        if (!p.HasSource()) {
+            p.Defer(ApplyDefines(vertexTemplate, key), ApplyDefines(fragmentTemplate, key));
+        }
+        return p;
+    }
+
+    static std::string ApplyDefines(const std::string &src, uint32_t key) {
+        std::string defines;
+        if (key & SHADER_SMOOTH_POINTS) {
+            defines += "#define SMOOTH_POINTS\n";
+        }
+        if (key & SHADER_ALPHA_TEXTURE) {
+            defines += "#define ALPHA_TEXTURE\n";
+        }
+        if (key & SHADER_UNIFORM_COLOR) {
+            defines += "#define UNIFORM_COLOR\n";
+        }
+        if (key & SHADER_PIXEL_RADIUS) {
+            defines += "#define PIXEL_RADIUS\n";
+        }
+        if (key & SHADER_ROUND_JOINS) {
+            defines += "#define ROUND_JOINS\n";
+        }
+        if (key & SHADER_DASHED) {
+            defines += "#define DASHED\n";
+        }
+        if (key & SHADER_BLURRED) {
+            defines += "#define BLURRED\n";
+        }
+        // #version has to stay the first line
+        size_t eol = src.find('\n');
+        if (eol == std::string::npos) {
+            return src;
+        }
+        return src.substr(0, eol + 1) + defines + src.substr(eol + 1);
+    }
+
+    std::string vertexTemplate;
+    std::string fragmentTemplate;
+    ShaderProgram variants[MAX_VARIANTS];
 };
 
 
-ShaderProgram texture3Program;
-ShaderProgram singleColor3Program;
-ShaderProgram normal3Program;
+ShaderPermutations texture3Program;
+ShaderPermutations singleColor3Program;
+ShaderPermutations normal3Program;
+ShaderPermutations circleProgram;
+ShaderPermutations polylineProgram;
+ShaderPermutations gradientProgram;
+ShaderPermutations pixelGridProgram;
 
 ShaderProgram meshSolidProgram;
 ShaderProgram meshTextureProgram;
@@ -353,13 +557,21 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
     
     const GLubyte* str = glGetString(GL_VERSION);
     bool cp = str[0] > '3' || (str[0] == '3' && str[2] >= '3');
-    
+
+    if (GLEW_KHR_parallel_shader_compile) {
+        // let the driver pick how many threads to compile on
+        LOG_GL_ERRORV(glMaxShaderCompilerThreadsKHR(0xFFFFFFFF));
+    }
+
+    // The programs every canvas needs are submitted now and checked on first use,
+    // the rest (3D lighting and meshes) are only built when something uses them
+    // or WarmUpShaders() is called.
     if (cp) {
-        valid = valid && singleColor3Program.Init(
+        singleColor3Program.Defer(
                                  "#version 330 core\n"
                                  "layout(location = 0) in vec3 vertexPosition_modelspace;\n"
                                  "out vec4 fragmentColor;\n"
-                                 "uniform mat4 MVP;\n"
+                                 FRAME_DATA_BLOCK
                                  "uniform vec4 inColor;\n"
                                  "void main(){\n"
                                  "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
@@ -368,27 +580,28 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                                  "#version 330 core\n"
                                  "in vec4 fragmentColor;\n"
                                  "out vec4 color;\n"
-                                 "uniform int RenderType = 0;\n"
+                                 "#ifdef SMOOTH_POINTS\n"
                                  "uniform float PointSmoothMin = 0.4;\n"
                                  "uniform float PointSmoothMax = 0.5;\n"
+                                 "#endif\n"
                                  "void main(){\n"
-                                 "    if (RenderType == 0) {\n"
-                                 "        color = fragmentColor;\n"
-                                 "    } else {\n"
-                                 "        float dist = distance(gl_PointCoord, vec2(0.5));\n"
-                                 "        float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
-                                 "        if (alpha == 0.0) discard;\n"
-                                 "        alpha = alpha * fragmentColor.a;\n"
-                                 "        color = vec4(fragmentColor.rgb, alpha);\n"
-                                 "    }\n"
+                                 "#ifdef SMOOTH_POINTS\n"
+                                 "    float dist = distance(gl_PointCoord, vec2(0.5));\n"
+                                 "    float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
+                                 "    if (alpha == 0.0) discard;\n"
+                                 "    alpha = alpha * fragmentColor.a;\n"
+                                 "    color = vec4(fragmentColor.rgb, alpha);\n"
+                                 "#else\n"
+                                 "    color = fragmentColor;\n"
+                                 "#endif\n"
                                  "}\n");
-        valid = valid && texture3Program.Init(
+        texture3Program.Defer(
                              "#version 330 core\n"
                              "layout(location = 0) in vec3 vertexPosition_modelspace;\n"
                              "layout(location = 1) in vec2 vertexUV;\n"
                              "out vec4 fragmentColor;\n"
                              "out vec2 UV;\n"
-                             "uniform mat4 MVP;\n"
+                             FRAME_DATA_BLOCK
                              "uniform vec4 inColor;\n"
                              "void main(){\n"
                              "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
@@ -401,53 +614,315 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                              "in vec2 UV;\n"
                              "out vec4 color;\n"
                              "uniform sampler2D tex;\n"
-                             "uniform int RenderType = 0;\n"
                              "void main(){\n"
                              "    vec4 c = texture(tex, UV);\n"
-                             "    if (RenderType == 0) {\n"
-                             "        color = vec4(c.r*fragmentColor.r, c.g*fragmentColor.g, c.b*fragmentColor.b, c.a*fragmentColor.a);\n"
-                             "    } else {\n"
-                             "        color = vec4(fragmentColor.rgb, c.a * fragmentColor.a);\n"
-                             "    }\n"
+                             "#ifdef ALPHA_TEXTURE\n"
+                             "    color = vec4(fragmentColor.rgb, c.a * fragmentColor.a);\n"
+                             "#else\n"
+                             "    color = vec4(c.r*fragmentColor.r, c.g*fragmentColor.g, c.b*fragmentColor.b, c.a*fragmentColor.a);\n"
+                             "#endif\n"
                              "}\n");
-        valid = valid && normal3Program.Init(
+        normal3Program.Defer(
                             "#version 330 core\n"
                             "layout(location = 0) in vec3 vertexPosition_modelspace;\n"
                             "layout(location = 1) in vec4 vertexColor;\n"
                             "out vec4 fragmentColor;\n"
-                            "uniform int RenderType;\n"
-                            "uniform mat4 MVP;\n"
+                            FRAME_DATA_BLOCK
                             "uniform vec4 inColor;\n"
                             "void main(){\n"
                             "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
-                            "    if (RenderType == -2) {\n"
-                            "        fragmentColor = inColor;\n"
-                            "    } else if (RenderType == -1) {\n"
-                            "        fragmentColor = inColor;\n"
-                            "    } else {\n"
-                            "        fragmentColor = vertexColor;\n"
-                            "    }\n"
+                            "#ifdef UNIFORM_COLOR\n"
+                            "    fragmentColor = inColor;\n"
+                            "#else\n"
+                            "    fragmentColor = vertexColor;\n"
+                            "#endif\n"
                             "}\n",
                             "#version 330 core\n"
                             "in vec4 fragmentColor;\n"
                             "out vec4 color;\n"
-                            "uniform int RenderType;\n"
+                            "#ifdef SMOOTH_POINTS\n"
                             "uniform float PointSmoothMin = 0.4;\n"
                             "uniform float PointSmoothMax = 0.5;\n"
+                            "#endif\n"
                             "void main(){\n"
-                            "    if (RenderType == 0 || RenderType == -2) {\n"
-                            "        color = fragmentColor;\n"
-                            "    } else {\n"
-                            "        float dist = distance(gl_PointCoord, vec2(0.5));\n"
-                            "        float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
-                            "        if (alpha == 0.0) discard;\n"
-                            "        alpha = alpha * fragmentColor.a;\n"
-                            "        color = vec4(fragmentColor.rgb, alpha);\n"
-                            "    }\n"
+                            "#ifdef SMOOTH_POINTS\n"
+                            "    float dist = distance(gl_PointCoord, vec2(0.5));\n"
+                            "    float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
+                            "    if (alpha == 0.0) discard;\n"
+                            "    alpha = alpha * fragmentColor.a;\n"
+                            "    color = vec4(fragmentColor.rgb, alpha);\n"
+                            "#else\n"
+                            "    color = fragmentColor;\n"
+                            "#endif\n"
                             "}\n");
         
         
-        valid = valid && meshTextureProgram.Init(
+        // One instance per circle, the quad corners come from gl_VertexID.
+        // Attributes that aren't arrays (a single color or point size) are
+        // set with glVertexAttrib.
+        circleProgram.Defer(
+                           "#version 330 core\n"
+                           "layout(location = 0) in vec3 center;\n"
+                           "layout(location = 1) in vec4 vertexColor;\n"
+                           "layout(location = 2) in vec3 shape;\n" // radius, inner radius, edge in pixels
+                           "out vec4 fragmentColor;\n"
+                           "out vec2 fromCenter;\n"
+                           "flat out vec3 edges;\n"
+                           FRAME_DATA_BLOCK
+                           "void main(){\n"
+                           "    vec2 corner = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1)) * 2.0 - 1.0;\n"
+                           "    vec4 c = MVP * vec4(center, 1);\n"
+                           "#ifdef PIXEL_RADIUS\n"
+                           "    fromCenter = corner * (shape.x + shape.z);\n"
+                           "    gl_Position = c + vec4(fromCenter * viewport.zw * c.w, 0.0, 0.0);\n"
+                           "#else\n"
+                           // grow the quad by the edge, converted to model units
+                           "    vec4 ex = MVP * vec4(center + vec3(shape.x, 0.0, 0.0), 1);\n"
+                           "    vec4 ey = MVP * vec4(center + vec3(0.0, shape.x, 0.0), 1);\n"
+                           "    vec2 cs = c.xy / c.w;\n"
+                           "    float pixels = min(length((ex.xy / ex.w - cs) * viewport.xy), length((ey.xy / ey.w - cs) * viewport.xy)) * 0.5;\n"
+                           "    fromCenter = corner * (shape.x + shape.z * shape.x / max(pixels, 0.001));\n"
+                           "    gl_Position = MVP * vec4(center + vec3(fromCenter, 0.0), 1);\n"
+                           "#endif\n"
+                           "    edges = shape;\n"
+                           "    fragmentColor = vertexColor;\n"
+                           "}\n",
+                           "#version 330 core\n"
+                           "in vec4 fragmentColor;\n"
+                           "in vec2 fromCenter;\n"
+                           "flat in vec3 edges;\n"
+                           "out vec4 color;\n"
+                           "void main(){\n"
+                           "    float d = length(fromCenter);\n"
+                           "    float aa = max(fwidth(d) * edges.z, 0.00001);\n"
+                           "    float alpha = clamp((edges.x - d) / aa + 0.5, 0.0, 1.0);\n"
+                           "    if (edges.y > 0.0) {\n"
+                           "        alpha *= clamp((d - edges.y) / aa + 0.5, 0.0, 1.0);\n"
+                           "    }\n"
+                           "    if (alpha == 0.0) discard;\n"
+                           "    color = vec4(fragmentColor.rgb, fragmentColor.a * alpha);\n"
+                           "}\n");
+
+        // One instance per segment: vertices 0-5 are the body, 6-8 fill the
+        // outside of a beveled join with the next segment.  Positions are
+        // worked out in pixels around the projected end points, lineCoord is
+        // the fragment's place along and across the segment in pixels.
+        polylineProgram.Defer(
+                             "#version 330 core\n"
+                             "layout(location = 0) in uvec4 segment;\n" // first, second, previous, next point
+                             "uniform samplerBuffer points;\n"          // xyz, length of the line up to the point
+                             "uniform samplerBuffer pointColors;\n"
+                             "uniform float halfWidth;\n"
+                             "uniform float miterLimit;\n"
+                             FRAME_DATA_BLOCK
+                             "out vec4 fragmentColor;\n"
+                             "out float arc;\n"
+                             "noperspective out vec2 lineCoord;\n"
+                             "flat out float segmentLength;\n"
+                             "vec2 toPixels(vec4 c) {\n"
+                             "    return c.xy / c.w * viewport.xy * 0.5;\n"
+                             "}\n"
+                             "vec2 direction(vec2 a, vec2 b, vec2 fallback) {\n"
+                             "    vec2 d = b - a;\n"
+                             "    float l = length(d);\n"
+                             "    return l > 0.0001 ? d / l : fallback;\n"
+                             "}\n"
+                             "void main(){\n"
+                             "    vec4 a = texelFetch(points, int(segment.x));\n"
+                             "    vec4 b = texelFetch(points, int(segment.y));\n"
+                             "    vec4 ca = MVP * vec4(a.xyz, 1);\n"
+                             "    vec4 cb = MVP * vec4(b.xyz, 1);\n"
+                             "    bool hasPrev = segment.z != segment.x;\n"
+                             "    bool hasNext = segment.w != segment.y;\n"
+                             // cut the segment at the near side of the camera
+                             "    const float nearW = 0.0001;\n"
+                             "    if (ca.w < nearW && cb.w < nearW) {\n"
+                             "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+                             "        return;\n"
+                             "    }\n"
+                             "    if (ca.w < nearW) {\n"
+                             "        float t = (nearW - ca.w) / (cb.w - ca.w);\n"
+                             "        ca = mix(ca, cb, t);\n"
+                             "        a.w = mix(a.w, b.w, t);\n"
+                             "        hasPrev = false;\n"
+                             "    } else if (cb.w < nearW) {\n"
+                             "        float t = (nearW - cb.w) / (ca.w - cb.w);\n"
+                             "        cb = mix(cb, ca, t);\n"
+                             "        b.w = mix(b.w, a.w, t);\n"
+                             "        hasNext = false;\n"
+                             "    }\n"
+                             "    vec2 pa = toPixels(ca);\n"
+                             "    vec2 pb = toPixels(cb);\n"
+                             "    vec2 dir = direction(pa, pb, vec2(1.0, 0.0));\n"
+                             "    vec2 normal = vec2(-dir.y, dir.x);\n"
+                             "    float len = dot(pb - pa, dir);\n"
+                             "    float w = halfWidth + 1.0;\n" // a pixel more for the anti-aliasing
+                             "    vec4 cprev = MVP * vec4(texelFetch(points, int(segment.z)).xyz, 1);\n"
+                             "    vec4 cnext = MVP * vec4(texelFetch(points, int(segment.w)).xyz, 1);\n"
+                             "    hasPrev = hasPrev && cprev.w >= nearW;\n"
+                             "    hasNext = hasNext && cnext.w >= nearW;\n"
+                             "    vec2 dirNext = hasNext ? direction(pb, toPixels(cnext), dir) : dir;\n"
+                             "    int v = gl_VertexID;\n"
+                             "    bool atB = v >= 6 || v == 1 || v == 4 || v == 5;\n"
+                             "    float side = (v == 0 || v == 1 || v == 4) ? -1.0 : 1.0;\n"
+                             "    vec2 p = atB ? pb : pa;\n"
+                             "    vec2 offset = normal * side * w;\n"
+                             "#ifdef ROUND_JOINS\n"
+                             "    if (v >= 6) {\n"
+                             "        offset = vec2(0.0);\n"
+                             "    } else {\n"
+                             "        offset += dir * (atB ? w : -w);\n"
+                             "    }\n"
+                             "#else\n"
+                             "    bool joined = atB ? hasNext : hasPrev;\n"
+                             "    vec2 other = atB ? dirNext : (hasPrev ? direction(toPixels(cprev), pa, dir) : dir);\n"
+                             "    vec2 tangent = atB ? dir + other : other + dir;\n"
+                             "    vec2 miter = length(tangent) > 0.0001 ? normalize(vec2(-tangent.y, tangent.x)) : normal;\n"
+                             "    float miterLength = w / max(dot(miter, normal), 0.0001);\n"
+                             "    bool bevel = joined && miterLength > miterLimit * w;\n"
+                             "    if (v >= 6) {\n"
+                             // outside corner of the turn to the next segment, or nothing
+                             "        float outside = -sign(dir.x * dirNext.y - dir.y * dirNext.x);\n"
+                             "        if (!bevel || v == 6) {\n"
+                             "            offset = vec2(0.0);\n"
+                             "        } else if (v == 7) {\n"
+                             "            offset = normal * outside * w;\n"
+                             "        } else {\n"
+                             "            offset = vec2(-dirNext.y, dirNext.x) * outside * w;\n"
+                             "        }\n"
+                             "    } else if (joined && !bevel) {\n"
+                             "        offset = miter * side * miterLength;\n"
+                             "    }\n"
+                             "#endif\n"
+                             "    vec4 c = atB ? cb : ca;\n"
+                             "    gl_Position = vec4((p + offset) * viewport.zw * c.w, c.z, c.w);\n"
+                             "    vec2 rel = p + offset - pa;\n"
+                             "    lineCoord = vec2(dot(rel, dir), v >= 6 ? length(offset) : dot(rel, normal));\n"
+                             "    segmentLength = len;\n"
+                             "    arc = atB ? b.w : a.w;\n"
+                             "    fragmentColor = texelFetch(pointColors, int(atB ? segment.y : segment.x));\n"
+                             "}\n",
+                             "#version 330 core\n"
+                             "in vec4 fragmentColor;\n"
+                             "in float arc;\n"
+                             "noperspective in vec2 lineCoord;\n"
+                             "flat in float segmentLength;\n"
+                             "uniform float halfWidth;\n"
+                             "#ifdef DASHED\n"
+                             "uniform vec2 dash;\n" // on and off lengths
+                             "#endif\n"
+                             "out vec4 color;\n"
+                             "void main(){\n"
+                             "#ifdef ROUND_JOINS\n"
+                             "    float d = length(vec2(lineCoord.x - clamp(lineCoord.x, 0.0, segmentLength), lineCoord.y));\n"
+                             "#else\n"
+                             "    float d = abs(lineCoord.y);\n"
+                             "#endif\n"
+                             // lines thinner than a pixel fade rather than vanish
+                             "    float alpha = clamp(halfWidth + 0.5 - d, 0.0, 1.0) * min(halfWidth * 2.0, 1.0);\n"
+                             "#ifdef DASHED\n"
+                             "    float m = mod(arc, dash.x + dash.y);\n"
+                             "    float aa = max(fwidth(arc), 0.00001);\n"
+                             "    alpha *= clamp((dash.x - m) / aa + 0.5, 0.0, 1.0);\n"
+                             "#endif\n"
+                             "    if (alpha == 0.0) discard;\n"
+                             "    color = vec4(fragmentColor.rgb, fragmentColor.a * alpha);\n"
+                             "}\n");
+
+        // One instance per fill, the quad corners come from gl_VertexID.  The
+        // gradient kind is constant over the instance so the branch is
+        // coherent, and fills of every kind go in one draw.
+        gradientProgram.Defer(
+                             "#version 330 core\n"
+                             "layout(location = 0) in vec4 rect;\n"
+                             "layout(location = 1) in vec4 params;\n"
+                             "layout(location = 2) in vec3 info;\n" // z, kind, lookup row
+                             "out vec2 position;\n"
+                             "flat out vec4 gradient;\n"
+                             "flat out vec2 ramp;\n"
+                             FRAME_DATA_BLOCK
+                             "void main(){\n"
+                             "    vec2 corner = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1));\n"
+                             "    position = mix(rect.xy, rect.zw, corner);\n"
+                             "    gradient = params;\n"
+                             "    ramp = info.yz;\n"
+                             "    gl_Position = MVP * vec4(position, info.x, 1);\n"
+                             "}\n",
+                             "#version 330 core\n"
+                             "in vec2 position;\n"
+                             "flat in vec4 gradient;\n"
+                             "flat in vec2 ramp;\n"
+                             "uniform sampler2D ramps;\n"
+                             "out vec4 color;\n"
+                             "void main(){\n"
+                             "    float t;\n"
+                             "    if (ramp.x < 0.5) {\n"
+                             "        vec2 d = gradient.zw - gradient.xy;\n"
+                             "        t = dot(position - gradient.xy, d) / max(dot(d, d), 1e-12);\n"
+                             "    } else if (ramp.x < 1.5) {\n"
+                             "        t = length(position - gradient.xy) / max(gradient.z, 1e-6);\n"
+                             "    } else {\n"
+                             "        vec2 d = position - gradient.xy;\n"
+                             "        t = fract((atan(d.y, d.x) - gradient.z) / 6.28318530718);\n"
+                             "    }\n"
+                             // sample between the first and last texel centers of the row
+                             "    vec2 size = vec2(textureSize(ramps, 0));\n"
+                             "    vec2 uv = vec2((clamp(t, 0.0, 1.0) * (size.x - 1.0) + 0.5) / size.x, (ramp.y + 0.5) / size.y);\n"
+                             "    color = texture(ramps, uv);\n"
+                             "}\n");
+
+        // One instance per pixel, the quad corners come from gl_VertexID.  The
+        // colors are three bytes a pixel in a texture buffer, so nothing else
+        // has to be sent again when they change.  Black pixels can be moved
+        // outside the clip volume rather than drawn.
+        pixelGridProgram.Defer(
+                              "#version 330 core\n"
+                              "layout(location = 0) in vec4 pixel;\n" // xyz, size in pixels
+                              "uniform samplerBuffer pixelColors;\n"
+                              "uniform int firstPixel;\n"
+                              "uniform bool hideBlack;\n"
+                              "out vec4 fragmentColor;\n"
+                              "noperspective out vec2 fromCenter;\n"
+                              "flat out float radius;\n"
+                              FRAME_DATA_BLOCK
+                              "void main(){\n"
+                              "    int idx = (gl_InstanceID + firstPixel) * 3;\n"
+                              "    vec3 c = vec3(texelFetch(pixelColors, idx).r, texelFetch(pixelColors, idx + 1).r, texelFetch(pixelColors, idx + 2).r);\n"
+                              "    if (hideBlack && c == vec3(0.0)) {\n"
+                              "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+                              "        return;\n"
+                              "    }\n"
+                              "    vec2 corner = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1)) * 2.0 - 1.0;\n"
+                              "    radius = pixel.w * 0.5;\n"
+                              "#ifdef SMOOTH_POINTS\n"
+                              "    fromCenter = corner * (radius + 0.5);\n" // room for the anti-aliased edge
+                              "#else\n"
+                              "    fromCenter = corner * radius;\n"
+                              "#endif\n"
+                              "    vec4 p = MVP * vec4(pixel.xyz, 1);\n"
+                              "    gl_Position = p + vec4(fromCenter * viewport.zw * p.w, 0.0, 0.0);\n"
+                              "    fragmentColor = vec4(c, 1.0);\n"
+                              "}\n",
+                              "#version 330 core\n"
+                              "in vec4 fragmentColor;\n"
+                              "noperspective in vec2 fromCenter;\n"
+                              "flat in float radius;\n"
+                              "out vec4 color;\n"
+                              "void main(){\n"
+                              "#if defined(SMOOTH_POINTS)\n"
+                              "    float alpha = clamp(radius + 0.5 - length(fromCenter), 0.0, 1.0);\n"
+                              "    if (alpha == 0.0) discard;\n"
+                              "    color = vec4(fragmentColor.rgb, alpha);\n"
+                              "#elif defined(BLURRED)\n"
+                              "    float alpha = 1.0 - smoothstep(0.0, max(radius, 0.5), length(fromCenter));\n"
+                              "    if (alpha == 0.0) discard;\n"
+                              "    color = vec4(fragmentColor.rgb, alpha);\n"
+                              "#else\n"
+                              "    color = fragmentColor;\n"
+                              "#endif\n"
+                              "}\n");
+
+        meshTextureProgram.Defer(
                                 "#version 330 core\n"
                                 "layout(location = 0) in vec3 vertexPosition_modelspace;\n"
                                 "layout(location = 1) in vec3 vertexNormal_modelspace;\n"
@@ -456,7 +931,7 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                                 "out vec2 UV;\n"
                                 "out float cosTheta;\n"
                                 "uniform vec4 inColor;\n"
-                                "uniform mat4 MVP;\n"
+                                FRAME_DATA_BLOCK
                                 "uniform mat4 NM;\n"
                                 "void main(){\n"
                                 "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
@@ -491,13 +966,13 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                                 "    }\n"
                                 "    color = vec4(c.r*brightness, c.g*brightness, c.b*brightness, c.a);\n"
                                 "}\n");
-        valid = valid && meshSolidProgram.Init(
+        meshSolidProgram.Defer(
                               "#version 330 core\n"
                               "layout(location = 0) in vec3 vertexPosition_modelspace;\n"
                               "layout(location = 1) in vec3 vertexNormal_modelspace;\n"
                               "out vec4 fragmentColor;\n"
                               "uniform vec4 inColor;\n"
-                              "uniform mat4 MVP;\n"
+                              FRAME_DATA_BLOCK
                               "uniform mat4 NM;\n"
                               "void main(){\n"
                               "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
@@ -517,7 +992,7 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                               "    color = fragmentColor;\n"
                               "}\n");
     } else {
-        valid = valid && singleColor3Program.Init("#version 120\n"
+        singleColor3Program.Defer("#version 120\n"
                                  "attribute vec3 vertexPosition_modelspace;\n"
                                  "varying vec4 fragmentColor;\n"
                                  "uniform vec4 inColor;\n"
@@ -529,56 +1004,55 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
         
                                  "#version 120\n"
                                  "varying vec4 fragmentColor;\n"
-                                 "uniform int RenderType = 0;\n"
+                                 "#ifdef SMOOTH_POINTS\n"
                                  "uniform float PointSmoothMin = 0.5;\n"
                                  "uniform float PointSmoothMax = 0.75;\n"
+                                 "#endif\n"
                                  "void main(){\n"
-                                 "    if (RenderType == 0) {\n"
-                                 "        gl_FragColor = fragmentColor;\n"
-                                 "    } else {\n"
-                                 "        float dist = distance(gl_PointCoord, vec2(0.5));\n"
-                                 "        float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
-                                 "        if (alpha == 0.0) discard;\n"
-                                 "        alpha = alpha * fragmentColor.a;\n"
-                                 "        gl_FragColor = vec4(fragmentColor.rgb, alpha);\n"
-                                 "    }\n"
+                                 "#ifdef SMOOTH_POINTS\n"
+                                 "    float dist = distance(gl_PointCoord, vec2(0.5));\n"
+                                 "    float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
+                                 "    if (alpha == 0.0) discard;\n"
+                                 "    alpha = alpha * fragmentColor.a;\n"
+                                 "    gl_FragColor = vec4(fragmentColor.rgb, alpha);\n"
+                                 "#else\n"
+                                 "    gl_FragColor = fragmentColor;\n"
+                                 "#endif\n"
                                  "}\n");
-        valid = valid && normal3Program.Init(
+        normal3Program.Defer(
                             "#version 120\n"
                             "attribute vec3 vertexPosition_modelspace;\n"
                             "attribute vec4 vertexColor;\n"
                             "varying vec4 fragmentColor;\n"
                             "uniform mat4 MVP;\n"
-                            "uniform int RenderType;\n"
                             "uniform vec4 inColor;\n"
                             "void main(){\n"
                             "    gl_Position = MVP * vec4(vertexPosition_modelspace,1);\n"
-                            "    if (RenderType == -2) {\n"
-                            "        fragmentColor = inColor;\n"
-                            "    } else if (RenderType == -1) {\n"
-                            "        fragmentColor = inColor;\n"
-                            "    } else {\n"
-                            "        fragmentColor = vertexColor;\n"
-                            "    }\n"
+                            "#ifdef UNIFORM_COLOR\n"
+                            "    fragmentColor = inColor;\n"
+                            "#else\n"
+                            "    fragmentColor = vertexColor;\n"
+                            "#endif\n"
                             "}\n",
                             "#version 120\n"
                             "varying vec4 fragmentColor;\n"
-                            "uniform int RenderType = 0;\n"
+                            "#ifdef SMOOTH_POINTS\n"
                             "uniform float PointSmoothMin = 0.5;\n"
                             "uniform float PointSmoothMax = 0.75;\n"
+                            "#endif\n"
                             "void main(){\n"
-                            "    if (RenderType == 0) {\n"
-                            "        gl_FragColor = fragmentColor;\n"
-                            "    } else {\n"
-                            "        float dist = distance(gl_PointCoord, vec2(0.5));\n"
-                            "        float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
-                            "        if (alpha == 0.0) discard;\n"
-                            "        alpha = alpha * fragmentColor.a;\n"
-                            "        gl_FragColor = vec4(fragmentColor.rgb, alpha);\n"
-                            "    }\n"
+                            "#ifdef SMOOTH_POINTS\n"
+                            "    float dist = distance(gl_PointCoord, vec2(0.5));\n"
+                            "    float alpha = 1.0 - smoothstep(PointSmoothMin, PointSmoothMax, dist);\n"
+                            "    if (alpha == 0.0) discard;\n"
+                            "    alpha = alpha * fragmentColor.a;\n"
+                            "    gl_FragColor = vec4(fragmentColor.rgb, alpha);\n"
+                            "#else\n"
+                            "    gl_FragColor = fragmentColor;\n"
+                            "#endif\n"
                             "}\n");
         
-        valid = valid && texture3Program.Init("#version 120\n"
+        texture3Program.Defer("#version 120\n"
                              "attribute vec3 vertexPosition_modelspace;\n"
                              "attribute vec2 vertexUV;\n"
                              "varying vec2 textCoord;\n"
@@ -594,17 +1068,16 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                              "varying vec2 textCoord;\n"
                              "uniform sampler2D tex;\n"
                              "uniform vec4 inColor;\n"
-                             "uniform int RenderType = 0;\n"
                              "void main(){\n"
                              "    vec4 col = texture2D(tex, textCoord);\n"
-                             "    if (RenderType == 0) {\n"
-                             "        gl_FragColor = vec4(col.r*inColor.r, col.g*inColor.g, col.b*inColor.b, col.a * inColor.a);\n"
-                             "    } else {\n"
-                             "        gl_FragColor = vec4(inColor.rgb, col.a * inColor.a);\n"
-                             "    }\n"
+                             "#ifdef ALPHA_TEXTURE\n"
+                             "    gl_FragColor = vec4(inColor.rgb, col.a * inColor.a);\n"
+                             "#else\n"
+                             "    gl_FragColor = vec4(col.r*inColor.r, col.g*inColor.g, col.b*inColor.b, col.a * inColor.a);\n"
+                             "#endif\n"
                              "}\n");
         
-        valid = valid && meshTextureProgram.Init(
+        meshTextureProgram.Defer(
                                 "#version 120\n"
                                 "attribute vec3 vertexPosition_modelspace;\n"
                                 "attribute vec3 vertexNormal_modelspace;\n"
@@ -649,7 +1122,7 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                                 "    gl_FragColor = vec4(c.r*brightness, c.g*brightness, c.b*brightness, c.a);\n"
                                 "}\n");
          
-        valid = valid && meshSolidProgram.Init(
+        meshSolidProgram.Defer(
                               "#version 120\n"
                               "attribute vec3 vertexPosition_modelspace;\n"
                               "attribute vec3 vertexNormal_modelspace;\n"
@@ -673,10 +1146,56 @@ bool xlOGL3GraphicsContext::InitializeSharedContext() {
                               "}\n"
                               );
     }
+    // the rest build on first use, but these two are needed by everything so
+    // wait for them here and report a failed compile or link to the caller
+    singleColor3Program.Submit(0);
+    texture3Program.Submit(0);
+    valid = valid && singleColor3Program.Get(0)->EnsureReady();
+    valid = valid && texture3Program.Get(0)->EnsureReady();
 
     return valid;
 }
 
+void xlOGL3GraphicsContext::WarmUpShaders() {
+    // the variants a 3D view is likely to hit
+    singleColor3Program.Submit(SHADER_SMOOTH_POINTS);
+    texture3Program.Submit(SHADER_ALPHA_TEXTURE);
+    normal3Program.Submit(0);
+    normal3Program.Submit(SHADER_SMOOTH_POINTS);
+    circleProgram.Submit(SHADER_PIXEL_RADIUS);
+    pixelGridProgram.Submit(0);
+    meshSolidProgram.Submit();
+    meshTextureProgram.Submit();
+}
+
+void xlOGL3GraphicsContext::ResolveCompletedShaders() {
+    static bool reported = false;
+    bool allReady = true;
+    auto resolve = [&allReady](ShaderProgram &p) {
+        if (p.IsPending()) {
+            if (p.IsComplete()) {
+                p.Resolve();
+            } else {
+                allReady = false;
+            }
+        }
+    };
+    singleColor3Program.ForEachVariant(resolve);
+    texture3Program.ForEachVariant(resolve);
+    normal3Program.ForEachVariant(resolve);
+    circleProgram.ForEachVariant(resolve);
+    polylineProgram.ForEachVariant(resolve);
+    gradientProgram.ForEachVariant(resolve);
+    pixelGridProgram.ForEachVariant(resolve);
+    resolve(meshSolidProgram);
+    resolve(meshTextureProgram);
+    if (allReady && !reported) {
+        reported = true;
+        static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+        logger_opengl.info(xlShaderCache::GetStatistics());
+    }
+}
+
 class xlGLTexture : public xlTexture {
 public:
     xlGLTexture(bool cp) : xlTexture(), coreProfile(cp) {}
@@ -811,7 +1330,8 @@ public:
     bool coreProfile = true;
 };
 
-xlOGL3GraphicsContext::xlOGL3GraphicsContext(xlGLCanvas *c) : xlGraphicsContext(c), canvas(c) {
+xlOGL3GraphicsContext::xlOGL3GraphicsContext(xlGLCanvas *c) : xlGraphicsContext(c), canvas(c), contextSerial(nextContextSerial++) {
+    ResolveCompletedShaders();
 }
 xlOGL3GraphicsContext::~xlOGL3GraphicsContext() {}
 
@@ -871,7 +1391,8 @@ public:
         }
     }
     
-    void SetBufferBytes(int idx) {
+    // first skips vertices, for drawing them as instances
+    void SetBufferBytes(int idx, uint32_t first = 0) {
         if (!bufferIdx) {
             LOG_GL_ERRORV(glGenBuffers(1, &bufferIdx));
         }
@@ -881,7 +1402,7 @@ public:
             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 3, &vertices[0], mayChange ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
             changed = false;
         }
-        LOG_GL_ERRORV(glVertexAttribPointer(idx, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glVertexAttribPointer(idx, 3, GL_FLOAT, GL_FALSE, 0, (void*)(first * sizeof(float) * 3)));
     }
     uint32_t count = 0;
     std::vector<float> vertices;
@@ -903,6 +1424,9 @@ public:
         if (cbuffer) {
             LOG_GL_ERRORV(glDeleteBuffers(1, &cbuffer));
         }
+        if (ibuffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &ibuffer));
+        }
     }
     virtual uint32_t getCount() override {
         return count;
@@ -931,6 +1455,32 @@ public:
             count++;
         }
     }
+    virtual float *ReserveVertices(uint32_t n, const xlColor &c) override {
+        if (finalized || n == 0) {
+            return nullptr;
+        }
+        size_t start = vertices.size();
+        vertices.resize(start + n * 3);
+        colors.resize(colors.size() + n, c.GetRGBA());
+        vchanged = true;
+        cchanged = true;
+        count += n;
+        return &vertices[start];
+    }
+    virtual float *ReserveVertices(uint32_t n, uint32_t *&c) override {
+        c = nullptr;
+        if (finalized || n == 0) {
+            return nullptr;
+        }
+        size_t start = vertices.size();
+        vertices.resize(start + n * 3);
+        colors.resize(count + n);
+        c = &colors[count];
+        vchanged = true;
+        cchanged = true;
+        count += n;
+        return &vertices[start];
+    }
 
     virtual void Finalize(bool mcv, bool mcc) override {
         finalized = true;
@@ -989,7 +1539,8 @@ public:
     }
 
 
-    void SetBufferBytes(int indexV, int indexC) {
+    // first skips vertices, for drawing them as instances
+    void SetBufferBytes(int indexV, int indexC, uint32_t first = 0) {
         if (!vbuffer) {
             LOG_GL_ERRORV(glGenBuffers(1, &vbuffer));
         }
@@ -1003,7 +1554,7 @@ public:
             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 3, &vertices[0], mayChangeVertices ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
             vchanged = false;
         }
-        LOG_GL_ERRORV(glVertexAttribPointer(indexV, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glVertexAttribPointer(indexV, 3, GL_FLOAT, GL_FALSE, 0, (void*)(first * sizeof(float) * 3)));
 
         LOG_GL_ERRORV(glEnableVertexAttribArray(indexC));
         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, cbuffer));
@@ -1011,7 +1562,22 @@ public:
             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, count * sizeof(uint32_t), &colors[0], mayChangeColors ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
             cchanged = false;
         }
-        LOG_GL_ERRORV(glVertexAttribPointer(indexC, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glVertexAttribPointer(indexC, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)(first * sizeof(uint32_t))));
+    }
+
+    // Binds the indexes of the vertices from start on that are neither black
+    // nor fully transparent as the element array and returns how many there are
+    uint32_t BindVisibleIndexes(uint32_t start, uint32_t len) {
+        if (!ibuffer) {
+            LOG_GL_ERRORV(glGenBuffers(1, &ibuffer));
+        }
+        visible.resize(len);
+        uint32_t n = len ? xlSIMD::CompactVisible(&colors[start], len, start, &visible[0]) : 0;
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuffer));
+        if (n) {
+            LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * sizeof(uint32_t), &visible[0], GL_STREAM_DRAW));
+        }
+        return n;
     }
 
     uint32_t count = 0;
@@ -1028,6 +1594,9 @@ public:
 
     GLuint vbuffer = 0;
     GLuint cbuffer = 0;
+
+    std::vector<uint32_t> visible;
+    GLuint ibuffer = 0;
 };
 
 
@@ -1243,8 +1812,27 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTriangleStrip(xlVertexAccumulator
     return drawPrimitive(GL_TRIANGLE_STRIP, vac, c, start, count);
 }
 
-xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexAccumulator *vac, const xlColor &c, float pointSize, bool smoothPoints, int start, int count) {
-    LOG_GL_ERRORV(glPointSize(pointSize));
+xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexAccumulator *vac, const xlColor &c, float ps, bool smoothPoints, int start, int count) {
+    xlOGL3VertexAccumulator *v = dynamic_cast<xlOGL3VertexAccumulator*>(vac);
+    int n = count < 0 ? (int)v->count - start : count;
+    if (n <= 0) {
+        return this;
+    }
+    if (smoothPoints || enableCapabilities == GL_POINT_SMOOTH) {
+        ShaderProgram *program = UseCircleProgram(true);
+        if (program) {
+            v->SetBufferBytes(0, start);
+            LOG_GL_ERRORV(glVertexAttribDivisor(0, 1));
+            LOG_GL_ERRORV(glVertexAttrib4f(1, c.Red() / 255.0f, c.Green() / 255.0f, c.Blue() / 255.0f, c.Alpha() / 255.0f));
+            LOG_GL_ERRORV(glVertexAttrib3f(2, ps * 0.5f, 0.0f, 1.0f));
+            LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+            LOG_GL_ERRORV(glVertexAttribDivisor(0, 0));
+            program->UnbindBuffer(0);
+            return this;
+        }
+    }
+    pointSize = ps;
+    LOG_GL_ERRORV(glPointSize(ps));
     drawPrimitive(GL_POINTS, vac, c, start, count);
     return this;
 }
@@ -1264,9 +1852,10 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexAccumu
     if (c <= 0) {
         return this;
     }
-    ShaderProgram *program = &singleColor3Program;
+    bool smoothPoints = type == GL_POINTS && caps == GL_POINT_SMOOTH;
+    ShaderProgram *program = singleColor3Program.Get(smoothPoints ? SHADER_SMOOTH_POINTS : 0);
     program->UseProgram();
-    program->SetMatrix(frameData.MVP);
+    SetFrameData(program);
     int bid = 0;
     if (!canvas->bindVertexArrayID(program->ProgramID)) {
         bid = glGetAttribLocation(program->ProgramID, "vertexPosition_modelspace" );
@@ -1279,17 +1868,14 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexAccumu
                 ((float)color.Blue())/255.0,
                 ((float)color.Alpha())/255.0
                 ));
-    float ps = 0;
-    if (type == GL_POINTS && caps == GL_POINT_SMOOTH) {
-        program->SetRenderType(1);
-        ps = program->CalcSmoothPointParams();
+    if (smoothPoints) {
+        program->CalcSmoothPointParams(pointSize);
     } else if (caps > 0) {
         LOG_GL_ERRORV(glEnable(caps));
     }
     LOG_GL_ERRORV(glDrawArrays(type, start, c));
-    if (type == GL_POINTS && caps == GL_POINT_SMOOTH) {
-        program->SetRenderType(0);
-        LOG_GL_ERRORV(glPointSize(ps));
+    if (smoothPoints) {
+        LOG_GL_ERRORV(glPointSize(pointSize));
     } else if (caps > 0) {
         LOG_GL_ERRORV(glDisable(caps));
     }
@@ -1309,8 +1895,29 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTriangles(xlVertexColorAccumulator
 xlGraphicsContext* xlOGL3GraphicsContext::drawTriangleStrip(xlVertexColorAccumulator *vac, int start, int count) {
     return drawPrimitive(GL_TRIANGLE_STRIP, vac, start, count);
 }
-xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexColorAccumulator *vac, float pointSize, bool smoothPoints, int start, int count) {
-    LOG_GL_ERRORV(glPointSize(pointSize));
+xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexColorAccumulator *vac, float ps, bool smoothPoints, int start, int count) {
+    int n = count < 0 ? (int)vac->getCount() - start : count;
+    if (n <= 0) {
+        return this;
+    }
+    if (smoothPoints || enableCapabilities == GL_POINT_SMOOTH) {
+        ShaderProgram *program = UseCircleProgram(true);
+        if (program) {
+            xlOGL3VertexColorAccumulator *v = dynamic_cast<xlOGL3VertexColorAccumulator*>(vac);
+            v->SetBufferBytes(0, 1, start);
+            LOG_GL_ERRORV(glVertexAttribDivisor(0, 1));
+            LOG_GL_ERRORV(glVertexAttribDivisor(1, 1));
+            LOG_GL_ERRORV(glVertexAttrib3f(2, ps * 0.5f, 0.0f, 1.0f));
+            LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+            LOG_GL_ERRORV(glVertexAttribDivisor(0, 0));
+            LOG_GL_ERRORV(glVertexAttribDivisor(1, 0));
+            program->UnbindBuffer(0);
+            program->UnbindBuffer(1);
+            return this;
+        }
+    }
+    pointSize = ps;
+    LOG_GL_ERRORV(glPointSize(ps));
     int c1 = enableCapabilities;
     if (smoothPoints && c1 != GL_POINT_SMOOTH) {
         enableCapabilities = GL_POINT_SMOOTH;
@@ -1320,7 +1927,21 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexColorAccumulator *v
     return this;
 }
 
-xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexColorAccumulator *vac, int start, int count) {
+xlGraphicsContext* xlOGL3GraphicsContext::drawVisiblePoints(xlVertexColorAccumulator *vac, float ps, bool smoothPoints, int start, int count) {
+    // the instanced circles can't be drawn from an index list, so smooth
+    // points go through the point sprite shader here
+    pointSize = ps;
+    LOG_GL_ERRORV(glPointSize(ps));
+    int c1 = enableCapabilities;
+    if (smoothPoints && c1 != GL_POINT_SMOOTH) {
+        enableCapabilities = GL_POINT_SMOOTH;
+    }
+    drawPrimitive(GL_POINTS, vac, start, count, true);
+    enableCapabilities = c1;
+    return this;
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexColorAccumulator *vac, int start, int count, bool visibleOnly) {
     if (vac->getCount() == 0) {
         return this;
     }
@@ -1331,10 +1952,50 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexColorA
     if (c <= 0) {
         return this;
     }
-    ShaderProgram *program = &normal3Program;
     xlOGL3VertexColorAccumulator *v = dynamic_cast<xlOGL3VertexColorAccumulator*>(vac);
+    drawColored(type, v, [type, v, start, c, visibleOnly]() {
+        if (visibleOnly) {
+            uint32_t n = v->BindVisibleIndexes(start, c);
+            if (n) {
+                LOG_GL_ERRORV(glDrawElements(type, n, GL_UNSIGNED_INT, (void*)0));
+            }
+            LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+        } else {
+            LOG_GL_ERRORV(glDrawArrays(type, start, c));
+        }
+    });
+    return this;
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitiveRuns(int type, xlVertexColorAccumulator *vac,
+                                                            const std::vector<GLint> &firsts, const std::vector<GLsizei> &counts) {
+    if (firsts.empty() || vac->getCount() == 0) {
+        return this;
+    }
+    drawColored(type, dynamic_cast<xlOGL3VertexColorAccumulator*>(vac), [type, &firsts, &counts]() {
+        LOG_GL_ERRORV(glMultiDrawArrays(type, &firsts[0], &counts[0], firsts.size()));
+    });
+    return this;
+}
+
+void xlOGL3GraphicsContext::drawColored(int type, xlOGL3VertexColorAccumulator *v, const std::function<void()> &draw) {
+    int caps = enableCapabilities;
+    if (isBlending && (type == GL_LINES || type == GL_LINE_STRIP)) {
+        caps = GL_LINE_SMOOTH;
+    }
+
+    // negative caps select the uniform color, -1 with smooth points, -2 without
+    uint32_t features = 0;
+    bool smoothPoints = type == GL_POINTS && caps == GL_POINT_SMOOTH;
+    if (smoothPoints || caps == -1) {
+        features |= SHADER_SMOOTH_POINTS;
+    }
+    if (caps < 0) {
+        features |= SHADER_UNIFORM_COLOR;
+    }
+    ShaderProgram *program = normal3Program.Get(features);
     program->UseProgram();
-    program->SetMatrix(frameData.MVP);
+    SetFrameData(program);
     
     
     int bid = 0;
@@ -1345,36 +2006,20 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPrimitive(int type, xlVertexColorA
     }
     v->SetBufferBytes(bid, cid);
 
-    int caps = enableCapabilities;
-    if (isBlending && (type == GL_LINES || type == GL_LINE_STRIP)) {
-        caps = GL_LINE_SMOOTH;
-    }
-
-    float ps = 2.0;
-    if (type == GL_POINTS && caps == GL_POINT_SMOOTH) {
-        program->SetRenderType(1);
-        ps = program->CalcSmoothPointParams();
-    } else {
-        if (caps > 0) {
-            LOG_GL_ERRORV(glEnable(caps));
-        } else if (caps != 0) {
-            program->SetRenderType(caps);
-        }
+    if (smoothPoints) {
+        program->CalcSmoothPointParams(pointSize);
+    } else if (caps > 0) {
+        LOG_GL_ERRORV(glEnable(caps));
     }
-    LOG_GL_ERRORV(glDrawArrays(type, start, c));
-    if (type == GL_POINTS && caps == 0x0B10) {
-        program->SetRenderType(0);
-        LOG_GL_ERRORV(glPointSize(ps));
+    draw();
+    if (smoothPoints) {
+        LOG_GL_ERRORV(glPointSize(pointSize));
     } else if (caps > 0) {
         LOG_GL_ERRORV(glDisable(caps));
-    } else if (caps != 0) {
-        program->SetRenderType(0);
     }
 
     program->UnbindBuffer(bid);
     program->UnbindBuffer(cid);
-    
-    return this;
 }
 
 class glVertexIndexedColorAccumulator : public xlVertexIndexedColorAccumulator {
@@ -1467,55 +2112,1586 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawPoints(xlVertexIndexedColorAccumul
     return this;
 }
 
+class xlOGL3CircleAccumulator : public xlCircleAccumulator {
+public:
+    // one instance, matches the attribute layout in SetBufferBytes
+    struct Circle {
+        float x, y, z;
+        float radius, innerRadius, softness;
+        uint32_t color;
+    };
 
-xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlTexture *texture,
-                         float x, float y, float x2, float y2,
-                         float tx, float ty, float tx2, float ty2,
-                         bool nearest,
-                         int brightness, int alpha) {
-    xlOGL3VertexTextureAccumulator va;
-    va.PreAlloc(6);
-
-    va.AddVertex(x, y, 0, tx, ty);
-    va.AddVertex(x, y2, 0, tx, ty2);
-    va.AddVertex(x2, y2, 0, tx2, ty2);
-    va.AddVertex(x, y, 0, tx, ty);
-    va.AddVertex(x2, y2, 0, tx2, ty2);
-    va.AddVertex(x2, y, 0, tx2, ty);
-    return drawTexture(&va, texture, brightness, alpha, 0, 6);
-}
-xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, int brightness, uint8_t alpha, int start, int count) {
-    xlOGL3VertexTextureAccumulator *va = dynamic_cast<xlOGL3VertexTextureAccumulator*>(vac);
-    xlGLTexture *t = (xlGLTexture*)texture;
-
-    if (va->count == 0) {
-        return this;
+    xlOGL3CircleAccumulator() {}
+    virtual ~xlOGL3CircleAccumulator() {
+        if (buffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &buffer));
+        }
     }
-    int c = count;
-    if (c < 0) {
-        c = va->count - start;
+    virtual uint32_t getCount() override {
+        return circles.size();
     }
-    if (c <= 0) {
-        return this;
+    virtual void Reset() override {
+        if (!finalized) {
+            circles.resize(0);
+            changed = true;
+        }
     }
-    texture3Program.UseProgram();
-    texture3Program.SetMatrix(frameData.MVP);
-    
-    int bid = 0;
-    int vid = 1;
-    if (!canvas->bindVertexArrayID(texture3Program.ProgramID)) {
-        bid = glGetAttribLocation(texture3Program.ProgramID, "vertexPosition_modelspace" );
-        vid = glGetAttribLocation(texture3Program.ProgramID, "vertexUV" );
+    virtual void PreAlloc(unsigned int i) override {
+        circles.reserve(i);
     }
-    va->SetBufferBytes(bid, vid);
-
-    LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
-    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
-    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(texture3Program.ProgramID, "tex"), 0));
-
-    texture3Program.SetRenderType(0);
-    GLuint cid = glGetUniformLocation(texture3Program.ProgramID, "inColor");
-    float b = brightness / 100.0f;
+    virtual void AddCircle(float x, float y, float z, float radius, const xlColor &c,
+                           float innerRadius, float softness) override {
+        if (!finalized) {
+            circles.push_back({ x, y, z, radius, innerRadius, softness, c.GetRGBA() });
+            changed = true;
+        }
+    }
+    virtual void Finalize(bool mc) override {
+        finalized = true;
+        mayChange = mc;
+    }
+    virtual void SetCircle(uint32_t idx, float x, float y, float z, float radius, const xlColor &c,
+                           float innerRadius, float softness) override {
+        if (idx < circles.size() && (!finalized || mayChange)) {
+            circles[idx] = { x, y, z, radius, innerRadius, softness, c.GetRGBA() };
+            changed = true;
+        }
+    }
+    virtual void SetColor(uint32_t idx, const xlColor &c) override {
+        if (idx < circles.size() && (!finalized || mayChange)) {
+            circles[idx].color = c.GetRGBA();
+            changed = true;
+        }
+    }
+    virtual void FlushRange(uint32_t start, uint32_t len) override {
+        if (len && buffer && (!finalized || mayChange) && changed) {
+            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+            if (start == 0 && len == circles.size()) {
+                LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, circles.size() * sizeof(Circle), &circles[0], GL_DYNAMIC_DRAW));
+            } else {
+                LOG_GL_ERRORV(glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(Circle), len * sizeof(Circle), &circles[start]));
+            }
+            changed = false;
+        }
+    }
+
+    // center, color and shape as per instance attributes 0, 1 and 2
+    void SetBufferBytes(uint32_t first) {
+        if (!buffer) {
+            LOG_GL_ERRORV(glGenBuffers(1, &buffer));
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+        if (changed) {
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, circles.size() * sizeof(Circle), &circles[0], mayChange ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
+            changed = false;
+        }
+        size_t base = first * sizeof(Circle);
+        LOG_GL_ERRORV(glEnableVertexAttribArray(0));
+        LOG_GL_ERRORV(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Circle), (void*)(base + offsetof(Circle, x))));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(1));
+        LOG_GL_ERRORV(glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Circle), (void*)(base + offsetof(Circle, color))));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(2));
+        LOG_GL_ERRORV(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Circle), (void*)(base + offsetof(Circle, radius))));
+        for (int x = 0; x < 3; x++) {
+            LOG_GL_ERRORV(glVertexAttribDivisor(x, 1));
+        }
+    }
+
+    // Triangles for profiles without instancing, rebuilt when the circles change,
+    // circle i is the vertices offsets[i] to offsets[i + 1]
+    xlOGL3VertexColorAccumulator *GetTriangles() {
+        if (trianglesValid && !changed) {
+            return &triangles;
+        }
+        triangles.Reset();
+        offsets.resize(circles.size() + 1);
+        for (size_t idx = 0; idx < circles.size(); idx++) {
+            offsets[idx] = triangles.getCount();
+            auto &c = circles[idx];
+            xlColor color(c.color & 0xFF, (c.color >> 8) & 0xFF, (c.color >> 16) & 0xFF, c.color >> 24);
+            if (c.innerRadius <= 0.0f) {
+                triangles.AddCircleAsTriangles(c.x, c.y, c.z, c.radius, color);
+                continue;
+            }
+            int segments = std::max(16, (int)c.radius);
+            float a = 0.0f;
+            for (int i = 0; i < segments; i++) {
+                float b = 2.0f * M_PI * (i + 1) / segments;
+                float ca = std::cos(a), sa = std::sin(a), cb = std::cos(b), sb = std::sin(b);
+                triangles.AddVertex(c.x + ca * c.innerRadius, c.y + sa * c.innerRadius, c.z, color);
+                triangles.AddVertex(c.x + ca * c.radius, c.y + sa * c.radius, c.z, color);
+                triangles.AddVertex(c.x + cb * c.radius, c.y + sb * c.radius, c.z, color);
+                triangles.AddVertex(c.x + cb * c.radius, c.y + sb * c.radius, c.z, color);
+                triangles.AddVertex(c.x + cb * c.innerRadius, c.y + sb * c.innerRadius, c.z, color);
+                triangles.AddVertex(c.x + ca * c.innerRadius, c.y + sa * c.innerRadius, c.z, color);
+                a = b;
+            }
+        }
+        offsets[circles.size()] = triangles.getCount();
+        // the triangle buffer is the one that's current now
+        trianglesValid = true;
+        changed = false;
+        return &triangles;
+    }
+
+    std::vector<Circle> circles;
+    bool finalized = false;
+    bool mayChange = false;
+    bool changed = false;
+    GLuint buffer = 0;
+
+    xlOGL3VertexColorAccumulator triangles;
+    std::vector<uint32_t> offsets;
+    bool trianglesValid = false;
+};
+
+xlCircleAccumulator *xlOGL3GraphicsContext::createCircleAccumulator() {
+    return new xlOGL3CircleAccumulator();
+}
+
+class xlOGL3PolylineAccumulator : public xlPolylineAccumulator {
+public:
+    struct Line {
+        uint32_t first;
+        uint32_t count;
+        bool closed;
+    };
+
+    xlOGL3PolylineAccumulator() {}
+    virtual ~xlOGL3PolylineAccumulator() {
+        if (buffers[0]) {
+            LOG_GL_ERRORV(glDeleteBuffers(3, buffers));
+        }
+        if (textures[0]) {
+            LOG_GL_ERRORV(glDeleteTextures(2, textures));
+        }
+    }
+    virtual uint32_t getCount() override {
+        return colors.size();
+    }
+    virtual void Reset() override {
+        if (!finalized) {
+            points.resize(0);
+            colors.resize(0);
+            lines.resize(0);
+            changed = true;
+        }
+    }
+    virtual void PreAlloc(unsigned int i) override {
+        points.reserve(i * 3);
+        colors.reserve(i);
+    }
+    virtual void StartLine(bool closed) override {
+        if (!finalized) {
+            lines.push_back({ (uint32_t)colors.size(), 0, closed });
+        }
+    }
+    virtual void AddPoint(float x, float y, float z, const xlColor &c) override {
+        if (!finalized) {
+            if (lines.empty()) {
+                StartLine(false);
+            }
+            points.emplace_back(x);
+            points.emplace_back(y);
+            points.emplace_back(z);
+            colors.emplace_back(c.GetRGBA());
+            lines.back().count++;
+            changed = true;
+        }
+    }
+    virtual void Finalize(bool mc) override {
+        finalized = true;
+        mayChange = mc;
+    }
+    virtual void SetPoint(uint32_t idx, float x, float y, float z, const xlColor &c) override {
+        if (idx < colors.size() && (!finalized || mayChange)) {
+            points[idx * 3] = x;
+            points[idx * 3 + 1] = y;
+            points[idx * 3 + 2] = z;
+            colors[idx] = c.GetRGBA();
+            changed = true;
+        }
+    }
+    // the lengths along the lines depend on every earlier point, so any
+    // change sends everything again
+    virtual void FlushRange(uint32_t start, uint32_t len) override {
+        if (len && buffers[0] && (!finalized || mayChange) && changed) {
+            Upload();
+        }
+    }
+
+    // Sends the points, their colors and the segments, binds the point and
+    // color texture buffers to units 0 and 1 and the segments to attribute
+    // 0.  Returns the number of segments
+    uint32_t SetBufferBytes() {
+        if (!buffers[0]) {
+            LOG_GL_ERRORV(glGenBuffers(3, buffers));
+            LOG_GL_ERRORV(glGenTextures(2, textures));
+            changed = true;
+        }
+        if (changed) {
+            Upload();
+        }
+        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE1));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, textures[1]));
+        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, textures[0]));
+
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffers[2]));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(0));
+        LOG_GL_ERRORV(glVertexAttribIPointer(0, 4, GL_UNSIGNED_INT, 0, (void*)0));
+        LOG_GL_ERRORV(glVertexAttribDivisor(0, 1));
+        return segmentCount;
+    }
+
+    // Plain GL_LINES for profiles without texture buffers
+    xlOGL3VertexColorAccumulator *GetLines() {
+        if (linesValid && !changed) {
+            return &lineVertices;
+        }
+        lineVertices.Reset();
+        for (auto &l : lines) {
+            uint32_t segments = l.closed && l.count > 2 ? l.count : l.count - 1;
+            for (uint32_t i = 0; i < segments && l.count > 1; i++) {
+                for (uint32_t p : { l.first + i, l.first + (i + 1) % l.count }) {
+                    xlColor c(colors[p] & 0xFF, (colors[p] >> 8) & 0xFF, (colors[p] >> 16) & 0xFF, colors[p] >> 24);
+                    lineVertices.AddVertex(points[p * 3], points[p * 3 + 1], points[p * 3 + 2], c);
+                }
+            }
+        }
+        linesValid = true;
+        changed = false;
+        return &lineVertices;
+    }
+
+    std::vector<float> points;
+    std::vector<uint32_t> colors;
+    std::vector<Line> lines;
+    bool finalized = false;
+    bool mayChange = false;
+    bool changed = false;
+
+private:
+    // Closed lines get their first point again at the end so the length along
+    // the line keeps growing over the closing segment.
+    void Upload() {
+        std::vector<float> gpuPoints;
+        std::vector<uint32_t> gpuColors;
+        std::vector<uint32_t> segments;
+        gpuPoints.reserve(points.size() / 3 * 4 + lines.size() * 4);
+        gpuColors.reserve(colors.size() + lines.size());
+        segments.reserve(colors.size() * 4);
+        for (auto &l : lines) {
+            if (l.count < 2) {
+                continue;
+            }
+            uint32_t base = gpuColors.size();
+            bool closed = l.closed && l.count > 2;
+            uint32_t count = closed ? l.count + 1 : l.count;
+            float arc = 0.0f;
+            for (uint32_t i = 0; i < count; i++) {
+                const float *p = &points[(l.first + i % l.count) * 3];
+                if (i > 0) {
+                    const float *q = &points[(l.first + (i - 1) % l.count) * 3];
+                    arc += std::sqrt((p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]));
+                }
+                gpuPoints.insert(gpuPoints.end(), { p[0], p[1], p[2], arc });
+                gpuColors.push_back(colors[l.first + i % l.count]);
+            }
+            for (uint32_t i = 0; i + 1 < count; i++) {
+                uint32_t a = base + i;
+                uint32_t b = a + 1;
+                // a closed line continues through its repeated first point
+                uint32_t prev = i > 0 ? a - 1 : (closed ? base + count - 2 : a);
+                uint32_t next = i + 2 < count ? b + 1 : (closed ? base + 1 : b);
+                segments.insert(segments.end(), { a, b, prev, next });
+            }
+        }
+        segmentCount = segments.size() / 4;
+        if (segmentCount == 0) {
+            changed = false;
+            return;
+        }
+        GLenum usage = mayChange ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+        LOG_GL_ERRORV(glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]));
+        LOG_GL_ERRORV(glBufferData(GL_TEXTURE_BUFFER, gpuPoints.size() * sizeof(float), &gpuPoints[0], usage));
+        LOG_GL_ERRORV(glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]));
+        LOG_GL_ERRORV(glBufferData(GL_TEXTURE_BUFFER, gpuColors.size() * sizeof(uint32_t), &gpuColors[0], usage));
+        LOG_GL_ERRORV(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, textures[0]));
+        LOG_GL_ERRORV(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[0]));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, textures[1]));
+        LOG_GL_ERRORV(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, buffers[1]));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, 0));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffers[2]));
+        LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, segments.size() * sizeof(uint32_t), &segments[0], usage));
+        changed = false;
+    }
+
+    GLuint buffers[3] = { 0, 0, 0 }; // points, colors, segments
+    GLuint textures[2] = { 0, 0 };
+    uint32_t segmentCount = 0;
+
+    xlOGL3VertexColorAccumulator lineVertices;
+    bool linesValid = false;
+};
+
+xlPolylineAccumulator *xlOGL3GraphicsContext::createPolylineAccumulator() {
+    return new xlOGL3PolylineAccumulator();
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawPolylines(xlPolylineAccumulator *pac, float width,
+                                                        xlPolylineAccumulator::JoinStyle join,
+                                                        float dashLength, float gapLength) {
+    xlOGL3PolylineAccumulator *p = dynamic_cast<xlOGL3PolylineAccumulator*>(pac);
+    if (p->getCount() < 2) {
+        return this;
+    }
+    if (!canvas->IsCoreProfile() || !polylineProgram.IsAvailable()) {
+        drawLines(p->GetLines());
+        return this;
+    }
+    bool dashed = dashLength > 0.0f && gapLength > 0.0f;
+    uint32_t features = 0;
+    if (join == xlPolylineAccumulator::ROUND_JOIN) {
+        features |= SHADER_ROUND_JOINS;
+    }
+    if (dashed) {
+        features |= SHADER_DASHED;
+    }
+    ShaderProgram *program = polylineProgram.Get(features);
+    if (!program->valid) {
+        return this;
+    }
+    program->UseProgram();
+    SetFrameData(program);
+    canvas->bindVertexArrayID(program->ProgramID);
+    uint32_t segments = p->SetBufferBytes();
+    if (segments == 0) {
+        program->UnbindBuffer(0);
+        return this;
+    }
+
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "points"), 0));
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "pointColors"), 1));
+    LOG_GL_ERRORV(glUniform1f(glGetUniformLocation(program->ProgramID, "halfWidth"), width * 0.5f));
+    // a bevel is a miter cut off as soon as it sticks out
+    float miterLimit = join == xlPolylineAccumulator::BEVEL_JOIN ? 1.0f : 4.0f;
+    LOG_GL_ERRORV(glUniform1f(glGetUniformLocation(program->ProgramID, "miterLimit"), miterLimit));
+    if (dashed) {
+        LOG_GL_ERRORV(glUniform2f(glGetUniformLocation(program->ProgramID, "dash"), dashLength, gapLength));
+    }
+    LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLES, 0, 9, segments));
+
+    LOG_GL_ERRORV(glVertexAttribDivisor(0, 0));
+    program->UnbindBuffer(0);
+    LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE1));
+    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, 0));
+    LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0));
+    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, 0));
+    return this;
+}
+
+ShaderProgram *xlOGL3GraphicsContext::UseCircleProgram(bool pixelRadius) {
+    if (!canvas->IsCoreProfile() || !circleProgram.IsAvailable()) {
+        return nullptr;
+    }
+    ShaderProgram *program = circleProgram.Get(pixelRadius ? SHADER_PIXEL_RADIUS : 0);
+    if (!program->valid) {
+        return nullptr;
+    }
+    program->UseProgram();
+    SetFrameData(program);
+    canvas->bindVertexArrayID(program->ProgramID);
+    return program;
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawCircles(xlCircleAccumulator *cac, int start, int count) {
+    xlOGL3CircleAccumulator *c = dynamic_cast<xlOGL3CircleAccumulator*>(cac);
+    int n = (int)c->getCount() - start;
+    if (count >= 0) {
+        n = std::min(n, count);
+    }
+    if (start < 0 || n <= 0) {
+        return this;
+    }
+    ShaderProgram *program = UseCircleProgram(false);
+    if (!program) {
+        xlOGL3VertexColorAccumulator *tri = c->GetTriangles();
+        uint32_t first = c->offsets[start];
+        drawTriangles(tri, first, c->offsets[start + n] - first);
+        return this;
+    }
+    c->SetBufferBytes(start);
+    LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+    for (int x = 0; x < 3; x++) {
+        LOG_GL_ERRORV(glVertexAttribDivisor(x, 0));
+        program->UnbindBuffer(x);
+    }
+    return this;
+}
+
+
+class xlOGL3GradientAccumulator : public xlGradientAccumulator {
+public:
+    // one instance, matches the attribute layout in SetBufferBytes
+    struct Gradient {
+        float rect[4];
+        float params[4];
+        float z;
+        float type;
+        float row;
+    };
+
+    xlOGL3GradientAccumulator() {}
+    virtual ~xlOGL3GradientAccumulator() {
+        if (buffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &buffer));
+        }
+        if (texture) {
+            LOG_GL_ERRORV(glDeleteTextures(1, &texture));
+        }
+    }
+    virtual uint32_t getCount() override {
+        return gradients.size();
+    }
+    virtual void Reset() override {
+        if (!finalized) {
+            gradients.resize(0);
+            ramps.resize(0);
+            rows.clear();
+            rowKeys.clear();
+            rowUsers.clear();
+            freeRows.clear();
+            changed = true;
+            MarkRows(0, 0);
+        }
+    }
+    virtual void PreAlloc(unsigned int i) override {
+        gradients.reserve(i);
+    }
+    virtual void AddGradient(GradientType type, float x1, float y1, float x2, float y2, float z,
+                             float p0, float p1, float p2, float p3, const xlColorVector &colors) override {
+        if (!finalized) {
+            gradients.push_back({ { x1, y1, x2, y2 }, { p0, p1, p2, p3 }, z, (float)type, (float)GetRow(colors) });
+            changed = true;
+        }
+    }
+    virtual void Finalize(bool mc) override {
+        finalized = true;
+        mayChange = mc;
+    }
+    // A row only this gradient uses is filled again in place, otherwise the
+    // gradient moves to another row and its old one is freed once unused
+    virtual void SetColors(uint32_t idx, const xlColorVector &colors) override {
+        if (idx < gradients.size() && (!finalized || mayChange)) {
+            uint32_t old = (uint32_t)gradients[idx].row;
+            std::vector<uint32_t> key = MakeKey(colors);
+            if (key == rowKeys[old]) {
+                return;
+            }
+            if (rowUsers[old] == 1 && rows.find(key) == rows.end()) {
+                rows.erase(rowKeys[old]);
+                rows[key] = old;
+                rowKeys[old] = key;
+                FillRamp(colors, linearLight, &ramps[old * RAMP_WIDTH]);
+                MarkRows(old, old + 1);
+                // the instances are unchanged, but the triangle fallback
+                // bakes the ramp colors in
+                trianglesValid = false;
+                return;
+            }
+            gradients[idx].row = (float)GetRow(colors);
+            ReleaseRow(old);
+            changed = true;
+        }
+    }
+    virtual void FlushRange(uint32_t start, uint32_t len) override {
+        if (len && buffer && (!finalized || mayChange) && changed) {
+            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+            if (start == 0 && len == gradients.size()) {
+                LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, gradients.size() * sizeof(Gradient), &gradients[0], GL_DYNAMIC_DRAW));
+            } else {
+                LOG_GL_ERRORV(glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(Gradient), len * sizeof(Gradient), &gradients[start]));
+            }
+            changed = false;
+        }
+    }
+
+    // rect, params and info as per instance attributes 0, 1 and 2, the lookup
+    // texture on unit 0
+    void SetBufferBytes(uint32_t first) {
+        if (!buffer) {
+            LOG_GL_ERRORV(glGenBuffers(1, &buffer));
+            LOG_GL_ERRORV(glGenTextures(1, &texture));
+            LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, texture));
+            LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            changed = true;
+            textureRows = 0;
+        }
+        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, texture));
+        UploadRows();
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+        if (changed) {
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, gradients.size() * sizeof(Gradient), &gradients[0], mayChange ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
+            changed = false;
+        }
+        size_t base = first * sizeof(Gradient);
+        LOG_GL_ERRORV(glEnableVertexAttribArray(0));
+        LOG_GL_ERRORV(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Gradient), (void*)(base + offsetof(Gradient, rect))));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(1));
+        LOG_GL_ERRORV(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Gradient), (void*)(base + offsetof(Gradient, params))));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(2));
+        LOG_GL_ERRORV(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Gradient), (void*)(base + offsetof(Gradient, z))));
+        for (int x = 0; x < 3; x++) {
+            LOG_GL_ERRORV(glVertexAttribDivisor(x, 1));
+        }
+    }
+
+    // Each fill as a grid of colored triangles for profiles without
+    // instancing, the colors are read from the same lookup rows.  Fill i is
+    // the TRIANGLE_VERTICES from i * TRIANGLE_VERTICES.
+    static const int CELLS = 16;
+    static const int TRIANGLE_VERTICES = CELLS * CELLS * 6;
+    xlOGL3VertexColorAccumulator *GetTriangles() {
+        if (trianglesValid && !changed) {
+            return &triangles;
+        }
+        triangles.Reset();
+        triangles.PreAlloc(gradients.size() * TRIANGLE_VERTICES);
+        for (auto &g : gradients) {
+            const uint32_t *ramp = &ramps[(size_t)g.row * RAMP_WIDTH];
+            auto colorAt = [&g, ramp](float x, float y) {
+                float t;
+                float dx = x - g.params[0];
+                float dy = y - g.params[1];
+                if ((int)g.type == LINEAR_GRADIENT) {
+                    float gx = g.params[2] - g.params[0];
+                    float gy = g.params[3] - g.params[1];
+                    t = (dx * gx + dy * gy) / std::max(gx * gx + gy * gy, 1e-12f);
+                } else if ((int)g.type == RADIAL_GRADIENT) {
+                    t = std::sqrt(dx * dx + dy * dy) / std::max(g.params[2], 1e-6f);
+                } else {
+                    t = (std::atan2(dy, dx) - g.params[2]) / (2.0f * M_PI);
+                    t -= std::floor(t);
+                }
+                uint32_t c = ramp[std::lround(std::clamp(t, 0.0f, 1.0f) * (RAMP_WIDTH - 1))];
+                return xlColor(c & 0xFF, (c >> 8) & 0xFF, (c >> 16) & 0xFF, c >> 24);
+            };
+            for (int j = 0; j < CELLS; j++) {
+                float ya = g.rect[1] + (g.rect[3] - g.rect[1]) * j / CELLS;
+                float yb = g.rect[1] + (g.rect[3] - g.rect[1]) * (j + 1) / CELLS;
+                for (int i = 0; i < CELLS; i++) {
+                    float xa = g.rect[0] + (g.rect[2] - g.rect[0]) * i / CELLS;
+                    float xb = g.rect[0] + (g.rect[2] - g.rect[0]) * (i + 1) / CELLS;
+                    xlColor caa = colorAt(xa, ya), cba = colorAt(xb, ya);
+                    xlColor cab = colorAt(xa, yb), cbb = colorAt(xb, yb);
+                    triangles.AddVertex(xa, ya, g.z, caa);
+                    triangles.AddVertex(xa, yb, g.z, cab);
+                    triangles.AddVertex(xb, yb, g.z, cbb);
+                    triangles.AddVertex(xb, yb, g.z, cbb);
+                    triangles.AddVertex(xb, ya, g.z, cba);
+                    triangles.AddVertex(xa, ya, g.z, caa);
+                }
+            }
+        }
+        trianglesValid = true;
+        changed = false;
+        return &triangles;
+    }
+
+    std::vector<Gradient> gradients;
+    bool finalized = false;
+    bool mayChange = false;
+    bool changed = false;
+
+private:
+    std::vector<uint32_t> MakeKey(const xlColorVector &colors) const {
+        std::vector<uint32_t> key;
+        key.reserve(colors.size() + 1);
+        key.push_back(linearLight ? 1 : 0);
+        for (auto &c : colors) {
+            key.push_back(c.GetRGBA());
+        }
+        return key;
+    }
+
+    // the lookup row for the colors, filled if no gradient uses them yet.
+    // Freed rows are used first so animated colors don't grow the texture.
+    uint32_t GetRow(const xlColorVector &colors) {
+        std::vector<uint32_t> key = MakeKey(colors);
+        auto it = rows.find(key);
+        if (it != rows.end()) {
+            rowUsers[it->second]++;
+            return it->second;
+        }
+        uint32_t row;
+        if (!freeRows.empty()) {
+            row = freeRows.back();
+            freeRows.pop_back();
+        } else if (maxRows && rowUsers.size() >= maxRows) {
+            // no room for another row, share the last one rather than
+            // making the texture larger than the card allows
+            static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+            logger_opengl.warn("Gradient lookup texture is full at %d rows.", (int)maxRows);
+            row = rowUsers.size() - 1;
+            rowUsers[row]++;
+            return row;
+        } else {
+            row = rowUsers.size();
+            rowUsers.push_back(0);
+            rowKeys.emplace_back();
+            ramps.resize(ramps.size() + RAMP_WIDTH);
+        }
+        FillRamp(colors, linearLight, &ramps[row * RAMP_WIDTH]);
+        rows[key] = row;
+        rowKeys[row] = key;
+        rowUsers[row] = 1;
+        MarkRows(row, row + 1);
+        return row;
+    }
+    void ReleaseRow(uint32_t row) {
+        if (rowUsers[row] > 0 && --rowUsers[row] == 0) {
+            rows.erase(rowKeys[row]);
+            rowKeys[row].clear();
+            freeRows.push_back(row);
+        }
+    }
+
+    void MarkRows(uint32_t first, uint32_t last) {
+        if (dirtyFirst >= dirtyLast) {
+            dirtyFirst = first;
+            dirtyLast = last;
+        } else {
+            dirtyFirst = std::min(dirtyFirst, first);
+            dirtyLast = std::max(dirtyLast, last);
+        }
+    }
+
+    // The texture height doubles as rows are added, up to GL_MAX_TEXTURE_SIZE,
+    // otherwise only the rows that changed are sent
+    void UploadRows() {
+        if (maxRows == 0) {
+            GLint maxSize = 0;
+            LOG_GL_ERRORV(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+            maxRows = std::max(maxSize, 1);
+        }
+        uint32_t rowCount = rowUsers.size();
+        LOG_GL_ERRORV(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        if (rowCount > textureRows || textureRows == 0) {
+            uint32_t height = std::max(textureRows, 16u);
+            while (height < rowCount) {
+                height *= 2;
+            }
+            textureRows = std::min(height, maxRows);
+            LOG_GL_ERRORV(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, RAMP_WIDTH, textureRows, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+            MarkRows(0, rowCount);
+        }
+        dirtyLast = std::min(dirtyLast, std::min(rowCount, textureRows));
+        if (dirtyFirst < dirtyLast) {
+            LOG_GL_ERRORV(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirtyFirst, RAMP_WIDTH, dirtyLast - dirtyFirst,
+                                          GL_RGBA, GL_UNSIGNED_BYTE, &ramps[dirtyFirst * RAMP_WIDTH]));
+        }
+        dirtyFirst = dirtyLast = 0;
+    }
+
+    std::vector<uint32_t> ramps;
+    std::map<std::vector<uint32_t>, uint32_t> rows;
+    std::vector<std::vector<uint32_t>> rowKeys; // empty for free rows
+    std::vector<uint32_t> rowUsers;             // gradients using each row
+    std::vector<uint32_t> freeRows;
+    uint32_t dirtyFirst = 0;
+    uint32_t dirtyLast = 0;
+    uint32_t textureRows = 0;
+    uint32_t maxRows = 0;
+    GLuint buffer = 0;
+    GLuint texture = 0;
+
+    xlOGL3VertexColorAccumulator triangles;
+    bool trianglesValid = false;
+};
+
+xlGradientAccumulator *xlOGL3GraphicsContext::createGradientAccumulator() {
+    return new xlOGL3GradientAccumulator();
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawGradients(xlGradientAccumulator *gac, int start, int count) {
+    xlOGL3GradientAccumulator *g = dynamic_cast<xlOGL3GradientAccumulator*>(gac);
+    int n = (int)g->getCount() - start;
+    if (count >= 0) {
+        n = std::min(n, count);
+    }
+    if (start < 0 || n <= 0) {
+        return this;
+    }
+    if (!canvas->IsCoreProfile() || !gradientProgram.IsAvailable()) {
+        drawTriangles(g->GetTriangles(), start * xlOGL3GradientAccumulator::TRIANGLE_VERTICES,
+                      n * xlOGL3GradientAccumulator::TRIANGLE_VERTICES);
+        return this;
+    }
+    ShaderProgram *program = gradientProgram.Get(0);
+    if (!program->valid) {
+        return this;
+    }
+    program->UseProgram();
+    SetFrameData(program);
+    canvas->bindVertexArrayID(program->ProgramID);
+    g->SetBufferBytes(start);
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "ramps"), 0));
+    LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+    for (int x = 0; x < 3; x++) {
+        LOG_GL_ERRORV(glVertexAttribDivisor(x, 0));
+        program->UnbindBuffer(x);
+    }
+    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, 0));
+    return this;
+}
+
+
+class xlOGL3PixelGridAccumulator : public xlPixelGridAccumulator {
+public:
+    xlOGL3PixelGridAccumulator() {}
+    virtual ~xlOGL3PixelGridAccumulator() {
+        if (buffers[0]) {
+            LOG_GL_ERRORV(glDeleteBuffers(2, buffers));
+        }
+        if (texture) {
+            LOG_GL_ERRORV(glDeleteTextures(1, &texture));
+        }
+    }
+    virtual uint32_t getCount() override {
+        return pixels.size() / 4;
+    }
+    virtual void Reset() override {
+        if (!finalized) {
+            pixels.resize(0);
+            colors.resize(0);
+            pixelsChanged = true;
+            MarkColors(0, 0);
+        }
+    }
+    virtual void PreAlloc(unsigned int i) override {
+        pixels.reserve(i * 4);
+        colors.reserve(i * 3);
+    }
+    virtual void AddPixel(float x, float y, float z, float size) override {
+        if (!finalized) {
+            pixels.insert(pixels.end(), { x, y, z, size });
+            colors.insert(colors.end(), { 0, 0, 0 });
+            pixelsChanged = true;
+            pointsStale = true;
+            // the buffer is sized again on the next draw
+            colorsResized = true;
+        }
+    }
+    virtual void Finalize(bool mc) override {
+        finalized = true;
+        mayChange = mc;
+    }
+    virtual void SetPixel(uint32_t idx, float x, float y, float z, float size) override {
+        if (idx < getCount() && (!finalized || mayChange)) {
+            float *p = &pixels[idx * 4];
+            p[0] = x;
+            p[1] = y;
+            p[2] = z;
+            p[3] = size;
+            pixelsChanged = true;
+            pointsStale = true;
+        }
+    }
+    virtual void SetColor(uint32_t idx, const xlColor &c) override {
+        if (idx < getCount()) {
+            uint8_t *d = &colors[idx * 3];
+            d[0] = c.red;
+            d[1] = c.green;
+            d[2] = c.blue;
+            MarkColors(idx, 1);
+        }
+    }
+    virtual void SetColors(const uint8_t *rgb, uint32_t start, uint32_t count) override {
+        if (start >= getCount()) {
+            return;
+        }
+        count = std::min(count, getCount() - start);
+        memcpy(&colors[start * 3], rgb, count * 3);
+        MarkColors(start, count);
+    }
+
+    // The positions as per instance attribute 0 and the colors on texture
+    // unit 0, only the colors that changed since the last draw are sent
+    void SetBufferBytes(uint32_t first) {
+        if (!buffers[0]) {
+            LOG_GL_ERRORV(glGenBuffers(2, buffers));
+            LOG_GL_ERRORV(glGenTextures(1, &texture));
+            pixelsChanged = true;
+            colorsResized = true;
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, buffers[0]));
+        if (pixelsChanged) {
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, pixels.size() * sizeof(float), &pixels[0], mayChange ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW));
+            pixelsChanged = false;
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]));
+        if (colorsResized) {
+            LOG_GL_ERRORV(glBufferData(GL_TEXTURE_BUFFER, colors.size(), &colors[0], GL_STREAM_DRAW));
+            LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, texture));
+            LOG_GL_ERRORV(glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, buffers[1]));
+            colorsResized = false;
+            dirtyEnd = 0;
+        } else if (dirtyEnd > dirtyStart) {
+            if (dirtyStart == 0 && dirtyEnd == getCount()) {
+                // a whole frame, let the driver hand us a fresh buffer
+                LOG_GL_ERRORV(glBufferData(GL_TEXTURE_BUFFER, colors.size(), &colors[0], GL_STREAM_DRAW));
+            } else {
+                LOG_GL_ERRORV(glBufferSubData(GL_TEXTURE_BUFFER, dirtyStart * 3, (dirtyEnd - dirtyStart) * 3, &colors[dirtyStart * 3]));
+            }
+            dirtyEnd = 0;
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0));
+        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, texture));
+
+        LOG_GL_ERRORV(glEnableVertexAttribArray(0));
+        LOG_GL_ERRORV(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)(first * sizeof(float) * 4)));
+        LOG_GL_ERRORV(glVertexAttribDivisor(0, 1));
+    }
+
+    // Plain points for profiles without texture buffers, black pixels are
+    // drawn like the rest
+    xlOGL3VertexColorAccumulator *GetPoints() {
+        // never finalized so it can be filled again after the grid is Reset
+        if (points.getCount() != getCount() || pointsStale) {
+            points.Reset();
+            uint32_t *c = nullptr;
+            float *v = points.ReserveVertices(getCount(), c);
+            for (uint32_t i = 0; i < points.getCount(); i++) {
+                v[i * 3] = pixels[i * 4];
+                v[i * 3 + 1] = pixels[i * 4 + 1];
+                v[i * 3 + 2] = pixels[i * 4 + 2];
+            }
+        }
+        pointsStale = false;
+        for (uint32_t i = 0; i < points.getCount(); i++) {
+            points.colors[i] = xlColor(colors[i * 3], colors[i * 3 + 1], colors[i * 3 + 2]).GetRGBA();
+        }
+        points.cchanged = true;
+        return &points;
+    }
+
+    std::vector<float> pixels;
+    std::vector<uint8_t> colors;
+    bool finalized = false;
+    bool mayChange = false;
+
+private:
+    void MarkColors(uint32_t start, uint32_t count) {
+        if (dirtyEnd <= dirtyStart) {
+            dirtyStart = start;
+            dirtyEnd = start + count;
+        } else {
+            dirtyStart = std::min(dirtyStart, start);
+            dirtyEnd = std::max(dirtyEnd, start + count);
+        }
+    }
+
+    bool pixelsChanged = false;
+    bool colorsResized = false;
+    bool pointsStale = true;
+    uint32_t dirtyStart = 0;
+    uint32_t dirtyEnd = 0;
+    GLuint buffers[2] = { 0, 0 }; // positions and sizes, colors
+    GLuint texture = 0;
+
+    xlOGL3VertexColorAccumulator points;
+};
+
+xlPixelGridAccumulator *xlOGL3GraphicsContext::createPixelGridAccumulator() {
+    return new xlOGL3PixelGridAccumulator();
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawPixelGrid(xlPixelGridAccumulator *pac,
+                                                        xlPixelGridAccumulator::PixelShape shape,
+                                                        bool hideBlack, int start, int count) {
+    xlOGL3PixelGridAccumulator *p = dynamic_cast<xlOGL3PixelGridAccumulator*>(pac);
+    int n = count < 0 ? (int)p->getCount() - start : count;
+    if (n <= 0) {
+        return this;
+    }
+    if (!canvas->IsCoreProfile() || !pixelGridProgram.IsAvailable()) {
+        // GL_POINTS, one draw per run of pixels of the same size
+        xlOGL3VertexColorAccumulator *points = p->GetPoints();
+        bool smooth = shape != xlPixelGridAccumulator::SQUARE_PIXELS;
+        int runStart = start;
+        for (int i = start + 1; i <= start + n; i++) {
+            if (i == start + n || p->pixels[i * 4 + 3] != p->pixels[runStart * 4 + 3]) {
+                drawPoints(points, p->pixels[runStart * 4 + 3], smooth, runStart, i - runStart);
+                runStart = i;
+            }
+        }
+        return this;
+    }
+    uint32_t features = 0;
+    if (shape == xlPixelGridAccumulator::ROUND_PIXELS) {
+        features = SHADER_SMOOTH_POINTS;
+    } else if (shape == xlPixelGridAccumulator::BLURRED_PIXELS) {
+        features = SHADER_BLURRED;
+    }
+    ShaderProgram *program = pixelGridProgram.Get(features);
+    if (!program->valid) {
+        return this;
+    }
+    program->UseProgram();
+    SetFrameData(program);
+    canvas->bindVertexArrayID(program->ProgramID);
+    p->SetBufferBytes(start);
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "pixelColors"), 0));
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "firstPixel"), start));
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "hideBlack"), hideBlack ? 1 : 0));
+    LOG_GL_ERRORV(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n));
+    LOG_GL_ERRORV(glVertexAttribDivisor(0, 0));
+    program->UnbindBuffer(0);
+    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_BUFFER, 0));
+    return this;
+}
+
+
+class xlOGL3PathAccumulator : public xlPathAccumulator {
+public:
+    struct Path {
+        uint32_t first; // fan triangles in 'triangles'
+        uint32_t count;
+        float z;
+        FillRule rule;
+        xlColor color;
+        float bounds[4];
+    };
+
+    xlOGL3PathAccumulator() {}
+    virtual ~xlOGL3PathAccumulator() {}
+
+    virtual uint32_t getCount() override {
+        return paths.size();
+    }
+    virtual void Reset() override {
+        if (!finalized) {
+            paths.resize(0);
+            triangles.Reset();
+            covers.Reset();
+            contourOpen = false;
+            coversValid = false;
+        }
+    }
+    virtual void StartPath(const xlColor &c, FillRule rule, float z) override {
+        if (!finalized) {
+            EndContour();
+            paths.push_back({ triangles.getCount(), 0, z, rule, c,
+                              { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                                std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() } });
+            hasPivot = false;
+            coversValid = false;
+        }
+    }
+    virtual void Finalize(bool mc) override {
+        EndContour();
+        finalized = true;
+        mayChange = mc;
+    }
+    virtual void SetColor(uint32_t idx, const xlColor &c) override {
+        if (idx < paths.size() && (!finalized || mayChange)) {
+            paths[idx].color = c;
+        }
+    }
+
+    // Closes any open contour and builds the cover rectangles, call before
+    // drawing
+    void Prepare() {
+        EndContour();
+        if (coversValid) {
+            return;
+        }
+        covers.Reset();
+        covers.PreAlloc(paths.size() * 6);
+        for (auto &p : paths) {
+            if (p.count == 0) {
+                p.bounds[0] = p.bounds[1] = p.bounds[2] = p.bounds[3] = 0.0f;
+            }
+            const float *b = p.bounds;
+            covers.AddVertex(b[0], b[1], p.z);
+            covers.AddVertex(b[0], b[3], p.z);
+            covers.AddVertex(b[2], b[3], p.z);
+            covers.AddVertex(b[2], b[3], p.z);
+            covers.AddVertex(b[2], b[1], p.z);
+            covers.AddVertex(b[0], b[1], p.z);
+        }
+        coversValid = true;
+    }
+
+    std::vector<Path> paths;
+    xlOGL3VertexAccumulator triangles;
+    xlOGL3VertexAccumulator covers;
+    bool finalized = false;
+    bool mayChange = false;
+
+protected:
+    // Each edge makes a triangle with the first point of the path.  Where
+    // the triangles overlap they count up or down the stencil depending on
+    // which way they wind, which is the winding number of the shape.
+    virtual void StartContour(float x, float y) override {
+        if (finalized) {
+            return;
+        }
+        EndContour();
+        if (paths.empty()) {
+            StartPath(xlBLACK, NONZERO_FILL, 0.0f);
+        }
+        if (!hasPivot) {
+            pivotX = x;
+            pivotY = y;
+            hasPivot = true;
+        }
+        firstX = lastX = x;
+        firstY = lastY = y;
+        contourOpen = true;
+        AddBounds(x, y);
+    }
+    virtual void AddContourPoint(float x, float y) override {
+        if (finalized) {
+            return;
+        }
+        if (!contourOpen) {
+            StartContour(penX, penY);
+        }
+        AddEdge(x, y);
+    }
+    // Close() ends the contour, a later LineTo starts the next one at the
+    // start point
+    virtual void EndContour() override {
+        if (contourOpen) {
+            contourOpen = false;
+            if (lastX != firstX || lastY != firstY) {
+                AddEdge(firstX, firstY);
+            }
+        }
+    }
+
+private:
+    void AddEdge(float x, float y) {
+        Path &p = paths.back();
+        triangles.AddVertex(pivotX, pivotY, p.z);
+        triangles.AddVertex(lastX, lastY, p.z);
+        triangles.AddVertex(x, y, p.z);
+        p.count += 3;
+        lastX = x;
+        lastY = y;
+        AddBounds(x, y);
+    }
+    void AddBounds(float x, float y) {
+        float *b = paths.back().bounds;
+        coversValid = false;
+        b[0] = std::min(b[0], x);
+        b[1] = std::min(b[1], y);
+        b[2] = std::max(b[2], x);
+        b[3] = std::max(b[3], y);
+    }
+
+    bool contourOpen = false;
+    bool coversValid = false;
+    bool hasPivot = false;
+    float pivotX = 0.0f, pivotY = 0.0f;
+    float firstX = 0.0f, firstY = 0.0f;
+    float lastX = 0.0f, lastY = 0.0f;
+};
+
+xlPathAccumulator *xlOGL3GraphicsContext::createPathAccumulator() {
+    return new xlOGL3PathAccumulator();
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawPaths(xlPathAccumulator *pac, int start, int count) {
+    xlOGL3PathAccumulator *p = dynamic_cast<xlOGL3PathAccumulator*>(pac);
+    int n = (int)p->getCount() - start;
+    if (count >= 0) {
+        n = std::min(n, count);
+    }
+    if (start < 0 || n <= 0) {
+        return this;
+    }
+    p->Prepare();
+    if (canvas->GetStencilBits() == 0) {
+        for (int i = start; i < start + n; i++) {
+            const auto &path = p->paths[i];
+            drawTriangles(&p->triangles, path.color, path.first, path.count);
+        }
+        return this;
+    }
+
+    LOG_GL_ERRORV(glEnable(GL_STENCIL_TEST));
+    for (int i = start; i < start + n; i++) {
+        const auto &path = p->paths[i];
+        if (path.count == 0) {
+            continue;
+        }
+        // count the windings into the stencil, hidden triangles count too
+        LOG_GL_ERRORV(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+        LOG_GL_ERRORV(glDepthMask(GL_FALSE));
+        LOG_GL_ERRORV(glStencilFunc(GL_ALWAYS, 0, 0xFF));
+        if (path.rule == xlPathAccumulator::EVEN_ODD_FILL) {
+            LOG_GL_ERRORV(glStencilMask(0x01));
+            LOG_GL_ERRORV(glStencilOp(GL_KEEP, GL_INVERT, GL_INVERT));
+        } else {
+            LOG_GL_ERRORV(glStencilMask(0xFF));
+            LOG_GL_ERRORV(glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_INCR_WRAP, GL_INCR_WRAP));
+            LOG_GL_ERRORV(glStencilOpSeparate(GL_BACK, GL_KEEP, GL_DECR_WRAP, GL_DECR_WRAP));
+        }
+        drawTriangles(&p->triangles, path.color, path.first, path.count);
+
+        // then cover the bounds where it isn't zero, clearing the stencil
+        // for the next path as it goes, depth writes are on for every
+        // other draw
+        LOG_GL_ERRORV(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+        LOG_GL_ERRORV(glDepthMask(GL_TRUE));
+        LOG_GL_ERRORV(glStencilMask(0xFF));
+        LOG_GL_ERRORV(glStencilFunc(GL_NOTEQUAL, 0, path.rule == xlPathAccumulator::EVEN_ODD_FILL ? 0x01 : 0xFF));
+        LOG_GL_ERRORV(glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO));
+        drawTriangles(&p->covers, path.color, i * 6, 6);
+    }
+    LOG_GL_ERRORV(glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP));
+    LOG_GL_ERRORV(glDisable(GL_STENCIL_TEST));
+    return this;
+}
+
+
+class xlOGL3ChunkedColorAccumulator : public xlChunkedColorAccumulator {
+public:
+    struct Tile {
+        uint32_t first; // range in 'sorted'
+        uint32_t count;
+        xlBounds bounds;
+        bool dirty;
+        bool verticesChanged;
+    };
+
+    xlOGL3ChunkedColorAccumulator(PrimitiveType t, float ts) : type(t), tileSize(ts > 0.0f ? ts : 1.0f) {}
+    virtual ~xlOGL3ChunkedColorAccumulator() {}
+
+    virtual uint32_t getCount() override {
+        return colors.size();
+    }
+    virtual uint32_t getTileCount() override {
+        return tiles.size();
+    }
+    virtual void Reset() override {
+        if (!finalized) {
+            vertices.resize(0);
+            colors.resize(0);
+            built = false;
+        }
+    }
+    virtual void PreAlloc(unsigned int i) override {
+        vertices.reserve(i * 3);
+        colors.reserve(i);
+    }
+    virtual void AddVertex(float x, float y, float z, const xlColor &c) override {
+        if (!finalized) {
+            vertices.insert(vertices.end(), { x, y, z });
+            colors.push_back(c.GetRGBA());
+            built = false;
+        }
+    }
+    virtual void Finalize(bool mcv, bool mcc) override {
+        finalized = true;
+        mayChangeVertices = mcv;
+        mayChangeColors = mcc;
+        Build();
+        sorted.Finalize(mcv, mcc);
+    }
+    virtual void SetVertex(uint32_t vertex, float x, float y, float z, const xlColor &c) override {
+        if (vertex >= UsedCount() || (finalized && !mayChangeVertices)) {
+            return;
+        }
+        float *v = &vertices[vertex * 3];
+        v[0] = x;
+        v[1] = y;
+        v[2] = z;
+        colors[vertex] = c.GetRGBA();
+        if (built) {
+            Tile &t = tiles[tileOfPrimitive[vertex / PerPrimitive()]];
+            sorted.SetVertex(position[vertex], x, y, z, c);
+            t.bounds.Grow(glm::vec3(x, y, z));
+            t.dirty = true;
+            t.verticesChanged = true;
+        }
+    }
+    virtual void SetVertex(uint32_t vertex, const xlColor &c) override {
+        if (vertex >= UsedCount() || (finalized && !mayChangeColors)) {
+            return;
+        }
+        colors[vertex] = c.GetRGBA();
+        if (built) {
+            sorted.SetVertex(position[vertex], c);
+            tiles[tileOfPrimitive[vertex / PerPrimitive()]].dirty = true;
+        }
+    }
+
+    // Sends the tiles that changed, then finds the runs of tiles inside the
+    // frustum.  Neighbouring tiles sit next to each other in the buffer so
+    // they join into one run.  Returns the sorted vertices, or null if
+    // nothing is visible.
+    xlOGL3VertexColorAccumulator *Prepare(const glm::mat4 &mvp) {
+        Build();
+        for (auto &t : tiles) {
+            // each flush clears the changed flags, so set them for every tile
+            if (t.dirty) {
+                sorted.vchanged = sorted.vchanged || t.verticesChanged;
+                sorted.cchanged = true;
+                sorted.FlushRange(t.first, t.count);
+                t.dirty = false;
+                t.verticesChanged = false;
+            }
+        }
+
+        xlFrustum frustum(mvp);
+        runFirsts.clear();
+        runCounts.clear();
+        for (auto &t : tiles) {
+            unsigned int mask = 0x3F;
+            if (frustum.Test(t.bounds, mask) == 0) {
+                continue;
+            }
+            if (!runFirsts.empty() && (uint32_t)(runFirsts.back() + runCounts.back()) == t.first) {
+                runCounts.back() += t.count;
+            } else {
+                runFirsts.push_back(t.first);
+                runCounts.push_back(t.count);
+            }
+        }
+        return runFirsts.empty() ? nullptr : &sorted;
+    }
+
+    const PrimitiveType type;
+    std::vector<GLint> runFirsts;
+    std::vector<GLsizei> runCounts;
+
+private:
+    uint32_t PerPrimitive() const {
+        return type == CHUNKED_LINES ? 2 : 3;
+    }
+    // a partial primitive at the end is never drawn or sorted
+    uint32_t UsedCount() const {
+        return colors.size() / PerPrimitive() * PerPrimitive();
+    }
+
+    void Build() {
+        if (built) {
+            return;
+        }
+        uint32_t per = PerPrimitive();
+        uint32_t primitives = getCount() / per;
+        uint32_t count = primitives * per;
+
+        // the tile of each primitive, tiles numbered in x then y order
+        std::map<std::pair<int, int>, uint32_t> tileIndex;
+        std::vector<std::pair<int, int>> keys(primitives);
+        for (uint32_t p = 0; p < primitives; p++) {
+            float cx = 0.0f, cy = 0.0f;
+            for (uint32_t v = p * per; v < (p + 1) * per; v++) {
+                cx += vertices[v * 3];
+                cy += vertices[v * 3 + 1];
+            }
+            keys[p] = { (int)std::floor(cx / per / tileSize), (int)std::floor(cy / per / tileSize) };
+            tileIndex[keys[p]] = 0;
+        }
+        tiles.clear();
+        tiles.reserve(tileIndex.size());
+        for (auto &k : tileIndex) {
+            k.second = tiles.size();
+            tiles.push_back({ 0, 0, xlBounds(), false, false });
+        }
+        tileOfPrimitive.resize(primitives);
+        for (uint32_t p = 0; p < primitives; p++) {
+            tileOfPrimitive[p] = tileIndex[keys[p]];
+            tiles[tileOfPrimitive[p]].count += per;
+        }
+        uint32_t first = 0;
+        for (auto &t : tiles) {
+            t.first = first;
+            first += t.count;
+        }
+
+        std::vector<uint32_t> fill(tiles.size(), 0);
+        position.resize(count);
+        sorted.Reset();
+        uint32_t *sortedColors = nullptr;
+        float *sortedVertices = sorted.ReserveVertices(count, sortedColors);
+        for (uint32_t p = 0; p < primitives; p++) {
+            Tile &t = tiles[tileOfPrimitive[p]];
+            for (uint32_t v = p * per; v < (p + 1) * per; v++) {
+                uint32_t to = t.first + fill[tileOfPrimitive[p]]++;
+                position[v] = to;
+                memcpy(&sortedVertices[to * 3], &vertices[v * 3], sizeof(float) * 3);
+                sortedColors[to] = colors[v];
+                t.bounds.Grow(glm::vec3(vertices[v * 3], vertices[v * 3 + 1], vertices[v * 3 + 2]));
+            }
+        }
+        built = true;
+    }
+
+    float tileSize;
+    std::vector<float> vertices;
+    std::vector<uint32_t> colors;
+    bool finalized = false;
+    bool mayChangeVertices = false;
+    bool mayChangeColors = false;
+
+    bool built = false;
+    std::vector<Tile> tiles;
+    std::vector<uint32_t> tileOfPrimitive;
+    std::vector<uint32_t> position; // where each vertex went in 'sorted'
+    xlOGL3VertexColorAccumulator sorted;
+};
+
+xlChunkedColorAccumulator *xlOGL3GraphicsContext::createChunkedColorAccumulator(xlChunkedColorAccumulator::PrimitiveType type, float tileSize) {
+    return new xlOGL3ChunkedColorAccumulator(type, tileSize);
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawChunks(xlChunkedColorAccumulator *cac) {
+    xlOGL3ChunkedColorAccumulator *c = dynamic_cast<xlOGL3ChunkedColorAccumulator*>(cac);
+    if (c->getCount() == 0) {
+        return this;
+    }
+    xlOGL3VertexColorAccumulator *v = c->Prepare(transforms.GetMVP());
+    if (v) {
+        drawPrimitiveRuns(c->type == xlChunkedColorAccumulator::CHUNKED_LINES ? GL_LINES : GL_TRIANGLES, v, c->runFirsts, c->runCounts);
+    }
+    return this;
+}
+
+
+class xlOGL3StaticBatch : public xlStaticBatch {
+public:
+    struct Member {
+        xlOGL3VertexColorAccumulator *colored;
+        xlOGL3VertexAccumulator *plain;
+        uint32_t color;
+        PrimitiveType type;
+        bool visible;
+        uint32_t vertexCount; // when last built
+        uint32_t first;       // range in 'merged'
+    };
+    static const int TYPE_COUNT = BATCH_LINE_STRIP + 1;
+
+    xlOGL3StaticBatch() {}
+    virtual ~xlOGL3StaticBatch() {}
+
+    virtual uint32_t Add(xlVertexColorAccumulator *vac, PrimitiveType type) override {
+        members.push_back({ Static(vac), nullptr, 0, type, true, 0, 0 });
+        dirty = true;
+        return members.size() - 1;
+    }
+    virtual uint32_t Add(xlVertexAccumulator *vac, const xlColor &c, PrimitiveType type) override {
+        members.push_back({ nullptr, Static(vac), c.GetRGBA(), type, true, 0, 0 });
+        dirty = true;
+        return members.size() - 1;
+    }
+    virtual void Replace(uint32_t idx, xlVertexColorAccumulator *vac) override {
+        if (idx < members.size()) {
+            members[idx].colored = Static(vac);
+            members[idx].plain = nullptr;
+            dirty = true;
+        }
+    }
+    virtual void Replace(uint32_t idx, xlVertexAccumulator *vac, const xlColor &c) override {
+        if (idx < members.size()) {
+            members[idx].colored = nullptr;
+            members[idx].plain = Static(vac);
+            members[idx].color = c.GetRGBA();
+            dirty = true;
+        }
+    }
+    virtual void Remove(uint32_t idx) override {
+        if (idx < members.size()) {
+            members[idx].colored = nullptr;
+            members[idx].plain = nullptr;
+            dirty = true;
+        }
+    }
+    virtual void SetVisible(uint32_t idx, bool visible) override {
+        if (idx < members.size()) {
+            members[idx].visible = visible;
+        }
+    }
+    virtual void Clear() override {
+        members.clear();
+        dirty = true;
+    }
+    virtual uint32_t getCount() override {
+        return members.size();
+    }
+
+    // Finds the draw ranges of the visible members of the type in the merged
+    // buffer.  Lists from members next to each other in the buffer join into
+    // one range, strips never do.  Returns null if there is nothing to draw.
+    xlOGL3VertexColorAccumulator *Prepare(PrimitiveType type) {
+        bool separate = type == BATCH_TRIANGLE_STRIP || type == BATCH_LINE_STRIP;
+        runFirsts.clear();
+        runCounts.clear();
+        for (const Member *m : byType[type]) {
+            if (!m->visible || m->vertexCount == 0) {
+                continue;
+            }
+            if (!separate && !runFirsts.empty() && (uint32_t)(runFirsts.back() + runCounts.back()) == m->first) {
+                runCounts.back() += m->vertexCount;
+            } else {
+                runFirsts.push_back(m->first);
+                runCounts.push_back(m->vertexCount);
+            }
+        }
+        return runFirsts.empty() ? nullptr : &merged;
+    }
+    std::vector<GLint> runFirsts;
+    std::vector<GLsizei> runCounts;
+
+    static uint32_t VertexCount(const Member &m) {
+        if (m.colored) {
+            return m.colored->getCount();
+        }
+        return m.plain ? m.plain->getCount() : 0;
+    }
+
+    // Copies the members into the merged buffer after the set of members
+    // changed, laid out by type so each type's ranges sit together
+    void Build() {
+        if (!dirty) {
+            return;
+        }
+        uint32_t total = 0;
+        for (int t = 0; t < TYPE_COUNT; t++) {
+            byType[t].clear();
+        }
+        for (auto &m : members) {
+            m.vertexCount = VertexCount(m);
+            total += m.vertexCount;
+            byType[m.type].push_back(&m);
+        }
+        merged.Reset();
+        uint32_t *colors = nullptr;
+        float *vertices = merged.ReserveVertices(total, colors);
+        uint32_t first = 0;
+        for (int t = 0; t < TYPE_COUNT; t++) {
+            for (Member *m : byType[t]) {
+                m->first = first;
+                if (m->vertexCount == 0) {
+                    continue;
+                }
+                if (m->colored) {
+                    memcpy(&vertices[first * 3], &m->colored->vertices[0], m->vertexCount * 3 * sizeof(float));
+                    memcpy(&colors[first], &m->colored->colors[0], m->vertexCount * sizeof(uint32_t));
+                } else if (m->plain) {
+                    memcpy(&vertices[first * 3], &m->plain->vertices[0], m->vertexCount * 3 * sizeof(float));
+                    std::fill(colors + first, colors + first + m->vertexCount, m->color);
+                }
+                first += m->vertexCount;
+            }
+        }
+        dirty = false;
+    }
+
+private:
+    // Only accumulators finalized without mayChange are taken, nothing else
+    // tells the batch their vertices changed
+    template<class T>
+    static T *StaticMember(T *v, bool mayChange, const std::string &name) {
+        if (v && (!v->finalized || mayChange)) {
+            static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+            logger_opengl.warn("Static batch member %s is not finalized as unchanging, not drawn.", name.c_str());
+            return nullptr;
+        }
+        return v;
+    }
+    static xlOGL3VertexColorAccumulator *Static(xlVertexColorAccumulator *vac) {
+        xlOGL3VertexColorAccumulator *v = dynamic_cast<xlOGL3VertexColorAccumulator*>(vac);
+        return StaticMember(v, v && (v->mayChangeVertices || v->mayChangeColors), vac ? vac->GetName() : "");
+    }
+    static xlOGL3VertexAccumulator *Static(xlVertexAccumulator *vac) {
+        xlOGL3VertexAccumulator *v = dynamic_cast<xlOGL3VertexAccumulator*>(vac);
+        return StaticMember(v, v && v->mayChange, vac ? vac->GetName() : "");
+    }
+
+    std::vector<Member> members;
+    std::vector<Member*> byType[TYPE_COUNT];
+    bool dirty = true;
+    xlOGL3VertexColorAccumulator merged;
+};
+
+xlStaticBatch *xlOGL3GraphicsContext::createStaticBatch() {
+    return new xlOGL3StaticBatch();
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawStaticBatch(xlStaticBatch *batch) {
+    static const int GL_TYPES[] = { GL_TRIANGLES, GL_TRIANGLE_STRIP, GL_LINES, GL_LINE_STRIP };
+    xlOGL3StaticBatch *b = dynamic_cast<xlOGL3StaticBatch*>(batch);
+    b->Build();
+    for (int t = 0; t < xlOGL3StaticBatch::TYPE_COUNT; t++) {
+        xlOGL3VertexColorAccumulator *v = b->Prepare((xlStaticBatch::PrimitiveType)t);
+        if (v) {
+            drawPrimitiveRuns(GL_TYPES[t], v, b->runFirsts, b->runCounts);
+        }
+    }
+    return this;
+}
+
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlTexture *texture,
+                         float x, float y, float x2, float y2,
+                         float tx, float ty, float tx2, float ty2,
+                         bool nearest,
+                         int brightness, int alpha) {
+    xlOGL3VertexTextureAccumulator va;
+    va.PreAlloc(6);
+
+    va.AddVertex(x, y, 0, tx, ty);
+    va.AddVertex(x, y2, 0, tx, ty2);
+    va.AddVertex(x2, y2, 0, tx2, ty2);
+    va.AddVertex(x, y, 0, tx, ty);
+    va.AddVertex(x2, y2, 0, tx2, ty2);
+    va.AddVertex(x2, y, 0, tx2, ty);
+    return drawTexture(&va, texture, brightness, alpha, 0, 6);
+}
+xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, int brightness, uint8_t alpha, int start, int count) {
+    xlOGL3VertexTextureAccumulator *va = dynamic_cast<xlOGL3VertexTextureAccumulator*>(vac);
+    xlGLTexture *t = (xlGLTexture*)texture;
+
+    if (va->count == 0) {
+        return this;
+    }
+    int c = count;
+    if (c < 0) {
+        c = va->count - start;
+    }
+    if (c <= 0) {
+        return this;
+    }
+    ShaderProgram *program = texture3Program.Get(0);
+    program->UseProgram();
+    SetFrameData(program);
+    
+    int bid = 0;
+    int vid = 1;
+    if (!canvas->bindVertexArrayID(program->ProgramID)) {
+        bid = glGetAttribLocation(program->ProgramID, "vertexPosition_modelspace" );
+        vid = glGetAttribLocation(program->ProgramID, "vertexUV" );
+    }
+    va->SetBufferBytes(bid, vid);
+
+    LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
+    LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
+    LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "tex"), 0));
+
+    GLuint cid = glGetUniformLocation(program->ProgramID, "inColor");
+    float b = brightness / 100.0f;
     LOG_GL_ERRORV(glUniform4f(cid, b, b, b, ((float)alpha)/255.0));
 
     
@@ -1529,8 +3705,8 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator
     LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, 0));
     LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
 
-    texture3Program.UnbindBuffer(bid);
-    texture3Program.UnbindBuffer(vid);
+    program->UnbindBuffer(bid);
+    program->UnbindBuffer(vid);
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, const xlColor &color, int start, int count) {
@@ -1547,10 +3723,10 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator
     if (c <= 0) {
         return this;
     }
-    ShaderProgram *program = &texture3Program;
+    ShaderProgram *program = texture3Program.Get(SHADER_ALPHA_TEXTURE);
 
     program->UseProgram();
-    program->SetMatrix(frameData.MVP);
+    SetFrameData(program);
     
     int bid = 0;
     int vid = 1;
@@ -1565,8 +3741,6 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator
     LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
     LOG_GL_ERRORV(glUniform1i(glGetUniformLocation(program->ProgramID, "tex"), 0));
 
-    
-    program->SetRenderType(1);
     GLuint cid = glGetUniformLocation(program->ProgramID, "inColor");
     LOG_GL_ERRORV(glUniform4f(cid, ((float)color.red) / 255.0f,
                               ((float)color.green) / 255.0f,
@@ -1588,477 +3762,363 @@ xlGraphicsContext* xlOGL3GraphicsContext::drawTexture(xlVertexTextureAccumulator
     return this;
 }
 
-// class xlGLMesh : public xlMesh {
-// public:
-//     struct MeshVertexInput {
-//         float positionX;
-//         float positionY;
-//         float positionZ;
-//         float normalX;
-//         float normalY;
-//         float normalZ;
-//         float texcoordX;
-//         float texcoordY;
-//     };
-
-//     class xlOGLSubMesh {
-//     public:
-//         xlOGLSubMesh() {
+class xlGLMesh : public xlMesh {
+public:
+    class xlOGLSubMesh {
+    public:
+        xlOGLSubMesh() {
             
-//         }
-//         ~xlOGLSubMesh() {
-//         }
+        }
+        ~xlOGLSubMesh() {
+        }
         
-//         std::string name;
-//         int startIndex;
-//         int count;
-//         GLuint type;
-//         int material = 0;
-//     };
+        std::string name;
+        int startIndex;
+        int count;
+        GLuint type;
+        int material = 0;
+    };
     
     
     
-//     xlGLMesh(const std::string &file, xlOGL3GraphicsContext *ctx) : xlMesh(ctx, file) {
-//     }
-//     virtual ~xlGLMesh() {
-//         for (auto a: subMeshes) {
-//             delete a;
-//         }
-//         if (vbuffer) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &vbuffer));
-//         }
-//         if (tbuffer) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &tbuffer));
-//         }
-//         if (nbuffer) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &nbuffer));
-//         }
-//         if (wfIndexes) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &wfIndexes));
-//         }
-//         if (lineIndexes) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &lineIndexes));
-//         }
-//         if (indexBuffer) {
-//             LOG_GL_ERRORV(glDeleteBuffers(1, &indexBuffer));
-//         }
-//     }
+    xlGLMesh(const std::string &file, xlOGL3GraphicsContext *ctx) : xlMesh(ctx, file) {
+    }
+    virtual ~xlGLMesh() {
+        for (auto a: subMeshes) {
+            delete a;
+        }
+        if (vbuffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &vbuffer));
+        }
+        if (tbuffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &tbuffer));
+        }
+        if (nbuffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &nbuffer));
+        }
+        if (wfIndexes) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &wfIndexes));
+        }
+        if (lineIndexes) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &lineIndexes));
+        }
+        if (indexBuffer) {
+            LOG_GL_ERRORV(glDeleteBuffers(1, &indexBuffer));
+        }
+    }
     
-//     struct Index3 {
-//         int x, y, z;
-//     };
-//     struct CompareIndex3 {
-//         bool operator()(const Index3& lhs, const Index3& rhs) const {
-//             if (lhs.x != rhs.x) {
-//                 return lhs.x < rhs.x;
-//             }
-//             if (lhs.y != rhs.y) {
-//                 return lhs.y < rhs.y;
-//             }
-//             if (lhs.z != rhs.z) {
-//                 return lhs.z < rhs.z;
-//             }
-//             return false;
-//         }
-//     };
-//     uint32_t getOrAddIndex(std::map<Index3, uint32_t, CompareIndex3> &indexMap, std::vector<MeshVertexInput> &input, const tinyobj::index_t &idx) {
-//         Index3 key;
-//         key.x = idx.vertex_index;
-//         key.y = idx.normal_index;
-//         key.z = idx.texcoord_index;
-//         int ret = indexMap[key];
-        
-//         if (ret == 0) {
-//             ret = input.size();
-//             MeshVertexInput mvi;
-//             mvi.positionX = objects.GetAttrib().vertices[idx.vertex_index * 3];
-//             mvi.positionY = objects.GetAttrib().vertices[idx.vertex_index * 3 + 1];
-//             mvi.positionZ = objects.GetAttrib().vertices[idx.vertex_index * 3 + 2];
-//             if (idx.normal_index == -1) {
-//                 mvi.normalX = 0;
-//                 mvi.normalY = 0;
-//                 mvi.normalZ = 0;
-//             } else {
-//                 mvi.normalX = objects.GetAttrib().normals[idx.normal_index * 3];
-//                 mvi.normalY = objects.GetAttrib().normals[idx.normal_index * 3 + 1];
-//                 mvi.normalZ = objects.GetAttrib().normals[idx.normal_index * 3 + 2];
-//             }
-//             if (idx.texcoord_index == -1) {
-//                 mvi.texcoordX = 0;
-//                 mvi.texcoordY = 0;
-//             } else {
-//                 mvi.texcoordX = objects.GetAttrib().texcoords[idx.texcoord_index * 2];
-//                 mvi.texcoordY = objects.GetAttrib().texcoords[idx.texcoord_index * 2 + 1];
-//             }
-//             indexMap[key] = ret;
-//             input.emplace_back(mvi);
-//         }
-//         return ret;
-//     }
-//     void LoadBuffers() {
-//         std::map<Index3, uint32_t, CompareIndex3> indexMap;
-        
-//         std::vector<MeshVertexInput> input;
-//         input.reserve(objects.GetAttrib().vertices.size());
-//         input.resize(1); // 0 position is ignored, indexMap[key] == 0 means not found yet
-        
-//         indexes.resize(0);
-//         lines.resize(0);
-//         wireFrame.resize(0);
-//         indexes.reserve(objects.GetAttrib().vertices.size());
-//         lines.reserve(objects.GetAttrib().vertices.size() * 2);
-//         wireFrame.reserve(objects.GetAttrib().vertices.size() * 2);
-
-//         xlOGLSubMesh *lastMesh = nullptr;
-//         for (auto &s : objects.GetShapes()) {
-//             if (!s.mesh.indices.empty()) {
-//                 xlOGLSubMesh *sm;
-//                 if (lastMesh && (s.mesh.material_ids[0] == lastMesh->material)) {
-//                     sm = lastMesh;
-//                 } else {
-//                     sm = new xlOGLSubMesh();
-//                     sm->name = s.name;
-//                     sm->type = GL_TRIANGLES;
-//                     sm->startIndex = indexes.size();
-//                     sm->material = s.mesh.material_ids[0];
-//                     subMeshes.push_back(sm);
-//                     lastMesh = sm;
-//                 }
-//                 for (size_t idx = 0; idx < s.mesh.material_ids.size(); idx++) {
-//                     if (sm->material != s.mesh.material_ids[idx]) {
-//                         sm->count = indexes.size() - sm->startIndex;
-
-//                         sm = new xlOGLSubMesh();
-//                         sm->name = s.name;
-//                         sm->type = GL_TRIANGLES;
-//                         sm->startIndex = indexes.size();
-//                         sm->material = s.mesh.material_ids[idx];
-//                         lastMesh = sm;
-//                         subMeshes.push_back(sm);
-//                     }
-//                     uint32_t vidx1 = getOrAddIndex(indexMap, input, s.mesh.indices[idx*3]);
-//                     uint32_t vidx2 = getOrAddIndex(indexMap, input, s.mesh.indices[idx*3 + 1]);
-//                     uint32_t vidx3 = getOrAddIndex(indexMap, input, s.mesh.indices[idx*3 + 2]);
-//                     indexes.push_back(vidx1);
-//                     indexes.push_back(vidx2);
-//                     indexes.push_back(vidx3);
-
-//                     wireFrame.push_back(vidx1);
-//                     wireFrame.push_back(vidx2);
-//                     wireFrame.push_back(vidx2);
-//                     wireFrame.push_back(vidx3);
-//                     wireFrame.push_back(vidx3);
-//                     wireFrame.push_back(vidx1);
-//                 }
-//                 sm->count = indexes.size() - sm->startIndex;
-//             }
-//             if (!s.lines.indices.empty()) {
-//                 for (auto &idx : s.lines.indices) {
-//                     uint32_t vindex = getOrAddIndex(indexMap, input, idx);
-//                     lines.push_back(vindex);
-//                 }
-//             }
-//             if (!s.points.indices.empty()) {
-//                 xlOGLSubMesh *sm = new xlOGLSubMesh();
-//                 sm->name = s.name;
-//                 sm->type = GL_POINTS;
-//                 sm->startIndex = indexes.size();
-//                 for (auto &idx : s.points.indices) {
-//                     indexes.push_back(getOrAddIndex(indexMap, input, idx));
-//                 }
-//                 sm->count = indexes.size() - sm->startIndex;
-//                 subMeshes.push_back(sm);
-//             }
-//         }
-        
-//         std::vector<float> vertices;
-//         std::vector<float> tvertices;
-//         std::vector<float> normals;
+    // The loader already produced deduplicated, indexed vertices, only the
+    // wireframe edges are derived here
+    void LoadBuffers() {
+        const xlObjMesh &obj = GetObjects();
+        const std::vector<uint32_t> &indexes = obj.indexes;
+        lines = obj.lines;
+        indexCount = indexes.size();
         
-//         for (auto &sm : input) {
-//             vertices.push_back(sm.positionX);
-//             vertices.push_back(sm.positionY);
-//             vertices.push_back(sm.positionZ);
+        wireFrame.resize(0);
+        for (auto &s : obj.subMeshes) {
+            xlOGLSubMesh *sm = new xlOGLSubMesh();
+            sm->name = s.name;
+            sm->type = s.points ? GL_POINTS : GL_TRIANGLES;
+            sm->startIndex = s.startIndex;
+            sm->count = s.count;
+            sm->material = s.material;
+            subMeshes.push_back(sm);
             
-//             tvertices.push_back(sm.texcoordX);
-//             tvertices.push_back(sm.texcoordY);
-            
-//             normals.push_back(sm.normalX);
-//             normals.push_back(sm.normalY);
-//             normals.push_back(sm.normalZ);
-//         }
-//         LOG_GL_ERRORV(glGenBuffers(1, &vbuffer));
-//         LOG_GL_ERRORV(glGenBuffers(1, &tbuffer));
-//         LOG_GL_ERRORV(glGenBuffers(1, &nbuffer));
-//         LOG_GL_ERRORV(glGenBuffers(1, &wfIndexes));
-//         LOG_GL_ERRORV(glGenBuffers(1, &lineIndexes));
-//         LOG_GL_ERRORV(glGenBuffers(1, &indexBuffer));
-
-
-//         if (vertices.size() > 0)
-//         {
-//             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, vbuffer));
-//             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW));
-
-//             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, tbuffer));
-//             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, tvertices.size() * sizeof(float), &tvertices[0], GL_STATIC_DRAW));
-//         }
-
-//         if (normals.size() > 0)
-//         {
-//             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, nbuffer));
-//             LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], GL_STATIC_DRAW));
-//         }
+            if (!s.points) {
+                wireFrame.reserve(wireFrame.size() + s.count * 2);
+                for (uint32_t idx = s.startIndex; idx + 2 < s.startIndex + s.count; idx += 3) {
+                    uint32_t vidx1 = indexes[idx];
+                    uint32_t vidx2 = indexes[idx + 1];
+                    uint32_t vidx3 = indexes[idx + 2];
+                    wireFrame.push_back(vidx1);
+                    wireFrame.push_back(vidx2);
+                    wireFrame.push_back(vidx2);
+                    wireFrame.push_back(vidx3);
+                    wireFrame.push_back(vidx3);
+                    wireFrame.push_back(vidx1);
+                }
+            }
+        }
         
-//         if (wireFrame.size() > 0)
-//         {
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, wfIndexes));
-//             LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, wireFrame.size() * sizeof(uint32_t), &wireFrame[0], GL_STATIC_DRAW));
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-//         }
-
-//         if (lines.size() > 0)
-//         {
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lineIndexes));
-//             LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, lines.size() * sizeof(uint32_t), &lines[0], GL_STATIC_DRAW));
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-//         }
-
-//         if (indexes.size() > 0)
-//         {
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer));
-//             LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes.size() * sizeof(uint32_t), &indexes[0], GL_STATIC_DRAW));
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-//         }
-//     }
-
-//     GLuint vbuffer = 0;
-//     GLuint tbuffer = 0;
-//     GLuint nbuffer = 0;
-
-//     GLuint wfIndexes = 0;
-//     GLuint lineIndexes = 0;
-//     GLuint indexBuffer = 0;
-
-//     std::vector<xlOGLSubMesh*> subMeshes;
-//     std::vector<uint32_t> indexes;
-//     std::vector<uint32_t> lines;
-//     std::vector<uint32_t> wireFrame;
-// };
-
-
-// xlMesh *xlOGL3GraphicsContext::loadMeshFromObjFile(const std::string &file) {
-//     return new xlGLMesh(file, this);
-// }
-// xlGraphicsContext* xlOGL3GraphicsContext::drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) {
-//     drawMesh(mesh, brightness, useViewMatrix, false);
-//     return this;
-// }
-// xlGraphicsContext* xlOGL3GraphicsContext::drawMeshTransparents(xlMesh *mesh, int brightness) {
-//     drawMesh(mesh, brightness, false, true);
-//     return this;
-// }
-// void xlOGL3GraphicsContext::drawMesh(xlMesh *mesh, int brightness, bool useViewMatrix, bool transparents) {
-//     xlGLMesh *glm = (xlGLMesh*)mesh;
-//     if (glm->vbuffer == 0) {
-//         glm->LoadBuffers();
-//     }
-//     if (glm->indexes.size()) {
-//         LOG_GL_ERRORV(glDepthFunc(GL_LESS));
-//         float b = brightness;
-//         b /= 100.0f;
+        LOG_GL_ERRORV(glGenBuffers(1, &vbuffer));
+        LOG_GL_ERRORV(glGenBuffers(1, &tbuffer));
+        LOG_GL_ERRORV(glGenBuffers(1, &nbuffer));
+        LOG_GL_ERRORV(glGenBuffers(1, &wfIndexes));
+        LOG_GL_ERRORV(glGenBuffers(1, &lineIndexes));
+        LOG_GL_ERRORV(glGenBuffers(1, &indexBuffer));
+
+
+        if (obj.positions.size() > 0)
+        {
+            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, vbuffer));
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, obj.positions.size() * sizeof(float), &obj.positions[0], GL_STATIC_DRAW));
+
+            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, tbuffer));
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, obj.texcoords.size() * sizeof(float), &obj.texcoords[0], GL_STATIC_DRAW));
+        }
+
+        if (obj.normals.size() > 0)
+        {
+            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, nbuffer));
+            LOG_GL_ERRORV(glBufferData(GL_ARRAY_BUFFER, obj.normals.size() * sizeof(float), &obj.normals[0], GL_STATIC_DRAW));
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        
+        // most meshes have few enough vertices for 16 bit indexes
+        if (obj.GetVertexCount() <= 65536) {
+            indexType = GL_UNSIGNED_SHORT;
+            indexSize = sizeof(uint16_t);
+        }
+        UploadIndexes(wfIndexes, wireFrame);
+        UploadIndexes(lineIndexes, lines);
+        UploadIndexes(indexBuffer, indexes);
+    }
+
+    void UploadIndexes(GLuint buffer, const std::vector<uint32_t> &idx) {
+        if (idx.empty()) {
+            return;
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer));
+        if (indexType == GL_UNSIGNED_SHORT) {
+            std::vector<uint16_t> shortIdx(idx.begin(), idx.end());
+            LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIdx.size() * sizeof(uint16_t), &shortIdx[0], GL_STATIC_DRAW));
+        } else {
+            LOG_GL_ERRORV(glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint32_t), &idx[0], GL_STATIC_DRAW));
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    }
+
+    GLuint vbuffer = 0;
+    GLuint tbuffer = 0;
+    GLuint nbuffer = 0;
+
+    GLuint wfIndexes = 0;
+    GLuint lineIndexes = 0;
+    GLuint indexBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexSize = sizeof(uint32_t);
+
+    std::vector<xlOGLSubMesh*> subMeshes;
+    size_t indexCount = 0;
+    std::vector<uint32_t> lines;
+    std::vector<uint32_t> wireFrame;
+};
+
+
+xlMesh *xlOGL3GraphicsContext::loadMeshFromObjFile(const std::string &file) {
+    return new xlGLMesh(file, this);
+}
+xlGraphicsContext* xlOGL3GraphicsContext::drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) {
+    drawMesh(mesh, brightness, useViewMatrix, false);
+    return this;
+}
+xlGraphicsContext* xlOGL3GraphicsContext::drawMeshTransparents(xlMesh *mesh, int brightness) {
+    drawMesh(mesh, brightness, false, true);
+    return this;
+}
+void xlOGL3GraphicsContext::drawMesh(xlMesh *mesh, int brightness, bool useViewMatrix, bool transparents) {
+    xlGLMesh *glMesh = (xlGLMesh*)mesh;
+    if (glMesh->vbuffer == 0) {
+        glMesh->LoadBuffers();
+    }
+    if (glMesh->indexCount) {
+        LOG_GL_ERRORV(glDepthFunc(GL_LESS));
+        float b = brightness;
+        b /= 100.0f;
         
-//         glm::mat4 vm = useViewMatrix ? frameData.viewMatrix * frameData.modelMatrix : frameData.modelMatrix;
-
-//         meshTextureProgram.UseProgram();
-//         int bid = 0;
-//         int vnid = 1;
-//         int vid = 2;
-//         bool setVAS = false;
-//         if (!canvas->bindVertexArrayID(meshTextureProgram.ProgramID)) {
-//             bid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexPosition_modelspace" );
-//             vid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexUV" );
-//             vnid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexNormal_modelspace" );
-//             setVAS = true;
-//         }
-//         meshTextureProgram.SetMatrix(frameData.MVP);
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(bid));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->vbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(bid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(vid));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->tbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(vid, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(vnid));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->nbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(vnid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->indexBuffer));
-//         LOG_GL_ERRORV(GLuint textureBrightness = glGetUniformLocation(meshTextureProgram.ProgramID, "brightness"));
-//         LOG_GL_ERRORV(glUniform1f(textureBrightness, b));
-//         LOG_GL_ERRORV(GLuint textureID = glGetUniformLocation(meshTextureProgram.ProgramID, "tex"));
-//         LOG_GL_ERRORV(GLuint textureCid = glGetUniformLocation(meshTextureProgram.ProgramID, "inColor"));
-//         LOG_GL_ERRORV(GLuint MatrixID = glGetUniformLocation(meshTextureProgram.ProgramID, "NM"));
-//         LOG_GL_ERRORV(glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(vm)));
-//         LOG_GL_ERRORV(glUniform4f(textureCid, 0, 0, 0, 1.0f));
+        meshTextureProgram.UseProgram();
+        SetFrameData(&meshTextureProgram);
+        glm::mat4 vm = useViewMatrix ? frameData.viewMatrix * frameData.modelMatrix : frameData.modelMatrix;
+
+        int bid = 0;
+        int vnid = 1;
+        int vid = 2;
+        if (!canvas->bindVertexArrayID(meshTextureProgram.ProgramID)) {
+            bid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexPosition_modelspace" );
+            vid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexUV" );
+            vnid = glGetAttribLocation(meshTextureProgram.ProgramID, "vertexNormal_modelspace" );
+        }
+        LOG_GL_ERRORV(glEnableVertexAttribArray(bid));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->vbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(bid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(vid));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->tbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(vid, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(vnid));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->nbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(vnid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->indexBuffer));
+        LOG_GL_ERRORV(GLuint textureBrightness = glGetUniformLocation(meshTextureProgram.ProgramID, "brightness"));
+        LOG_GL_ERRORV(glUniform1f(textureBrightness, b));
+        LOG_GL_ERRORV(GLuint textureID = glGetUniformLocation(meshTextureProgram.ProgramID, "tex"));
+        LOG_GL_ERRORV(GLuint textureCid = glGetUniformLocation(meshTextureProgram.ProgramID, "inColor"));
+        LOG_GL_ERRORV(GLuint MatrixID = glGetUniformLocation(meshTextureProgram.ProgramID, "NM"));
+        LOG_GL_ERRORV(glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(vm)));
+        LOG_GL_ERRORV(glUniform4f(textureCid, 0, 0, 0, 1.0f));
         
-//         meshSolidProgram.UseProgram();
-//         int bids = 0;
-//         int vnids = 1;
-//         if (!canvas->bindVertexArrayID(meshSolidProgram.ProgramID)) {
-//             bids = glGetAttribLocation(meshSolidProgram.ProgramID, "vertexPosition_modelspace" );
-//             vnids = glGetAttribLocation(meshSolidProgram.ProgramID, "vertexNormal_modelspace" );
-//             setVAS = true;
-//         }
-//         meshSolidProgram.SetMatrix(frameData.MVP);
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->indexBuffer));
-//         LOG_GL_ERRORV(GLuint solidCid = glGetUniformLocation(meshSolidProgram.ProgramID, "inColor"));
-//         LOG_GL_ERRORV(GLuint MatrixID2 = glGetUniformLocation(meshSolidProgram.ProgramID, "NM"));
-//         LOG_GL_ERRORV(glUniformMatrix4fv(MatrixID2, 1, GL_FALSE, glm::value_ptr(vm)));
-
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(bids));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->vbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(bids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        meshSolidProgram.UseProgram();
+        SetFrameData(&meshSolidProgram);
+        int bids = 0;
+        int vnids = 1;
+        if (!canvas->bindVertexArrayID(meshSolidProgram.ProgramID)) {
+            bids = glGetAttribLocation(meshSolidProgram.ProgramID, "vertexPosition_modelspace" );
+            vnids = glGetAttribLocation(meshSolidProgram.ProgramID, "vertexNormal_modelspace" );
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->indexBuffer));
+        LOG_GL_ERRORV(GLuint solidCid = glGetUniformLocation(meshSolidProgram.ProgramID, "inColor"));
+        LOG_GL_ERRORV(GLuint MatrixID2 = glGetUniformLocation(meshSolidProgram.ProgramID, "NM"));
+        LOG_GL_ERRORV(glUniformMatrix4fv(MatrixID2, 1, GL_FALSE, glm::value_ptr(vm)));
+
+        LOG_GL_ERRORV(glEnableVertexAttribArray(bids));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->vbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(bids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
         
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(vnids));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->nbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(vnids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(vnids));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->nbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(vnids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
 
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->indexBuffer));
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->indexBuffer));
 
 
-//         xlTexture *lastTexture = nullptr;
-//         bool lastIsSolid = true;
-//         for (auto sm : glm->subMeshes) {
-//             int mid = sm->material;
+        xlTexture *lastTexture = nullptr;
+        bool lastIsSolid = true;
+        for (auto sm : glMesh->subMeshes) {
+            int mid = sm->material;
             
-//             bool output = mid < 0 || glm->GetMaterial(mid).color.alpha == 255;
-//             if (transparents) {
-//                 output = mid > 0 && glm->GetMaterial(mid).color.alpha != 255;
-//             }
+            bool output = mid < 0 || glMesh->GetMaterial(mid).color.alpha == 255;
+            if (transparents) {
+                output = mid >= 0 && glMesh->GetMaterial(mid).color.alpha != 255;
+            }
             
-//             if (output) {
-//                 if (mid < 0 || !glm->GetMaterial(mid).texture || glm->GetMaterial(mid).forceColor) {
-//                     if (!lastIsSolid) {
-//                         lastIsSolid = true;
-//                         meshSolidProgram.UseProgram();
-//                         if (!canvas->bindVertexArrayID(meshSolidProgram.ProgramID)) {
-//                             LOG_GL_ERRORV(glEnableVertexAttribArray(bids));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->vbuffer));
-//                             LOG_GL_ERRORV(glVertexAttribPointer(bids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+            if (output) {
+                if (mid < 0 || !glMesh->GetMaterial(mid).texture || glMesh->GetMaterial(mid).forceColor) {
+                    if (!lastIsSolid) {
+                        lastIsSolid = true;
+                        meshSolidProgram.UseProgram();
+                        if (!canvas->bindVertexArrayID(meshSolidProgram.ProgramID)) {
+                            LOG_GL_ERRORV(glEnableVertexAttribArray(bids));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->vbuffer));
+                            LOG_GL_ERRORV(glVertexAttribPointer(bids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
                             
-//                             LOG_GL_ERRORV(glEnableVertexAttribArray(vnids));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->nbuffer));
-//                             LOG_GL_ERRORV(glVertexAttribPointer(vnids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//                         }
-//                     }
-//                     xlColor color = mid < 0 ? xlWHITE : glm->GetMaterial(mid).color;
-//                     if (sm->type == GL_LINES) {
-//                         color = xlBLACK;
-//                     }
-//                     LOG_GL_ERRORV(glUniform4f(solidCid,
-//                                 ((float)color.Red())/255.0 * b,
-//                                 ((float)color.Green())/255.0 * b,
-//                                 ((float)color.Blue())/255.0 * b,
-//                                 ((float)color.Alpha())/255.0
-//                                 ));
-//                 } else {
-//                     xlGLTexture *t = (xlGLTexture*)glm->GetMaterial(mid).texture;
-//                     if (lastIsSolid) {
-//                         lastIsSolid = false;
-//                         meshTextureProgram.UseProgram();
-//                         if (!canvas->bindVertexArrayID(meshTextureProgram.ProgramID)) {
-//                             LOG_GL_ERRORV(glEnableVertexAttribArray(bid));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->vbuffer));
-//                             LOG_GL_ERRORV(glVertexAttribPointer(bid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//                             LOG_GL_ERRORV(glEnableVertexAttribArray(vid));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->tbuffer));
-//                             LOG_GL_ERRORV(glVertexAttribPointer(vid, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//                             LOG_GL_ERRORV(glEnableVertexAttribArray(vnid));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->nbuffer));
-//                             LOG_GL_ERRORV(glVertexAttribPointer(vnid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//                             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->indexBuffer));
-//                         }
-
-//                         LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
-//                         LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
-//                         LOG_GL_ERRORV(glUniform1i(textureID, 0));
-//                         LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-//                         LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-//                         lastTexture = t;
-//                     } else if (t != lastTexture) {
-//                         LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
-//                         LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
-//                         LOG_GL_ERRORV(glUniform1i(textureID, 0));
-//                         LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-//                         LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-//                         lastTexture = t;
-//                     }
-//                 }
-//                 // Draw the submesh.
-//                 LOG_GL_ERRORV(glDrawElements(sm->type, sm->count, GL_UNSIGNED_INT, (void*)(sm->startIndex * sizeof(uint32_t))));
-//             }
-//         }
-//         if (!lastIsSolid) {
-//             //lastIsSolid = true;
-//             meshSolidProgram.UseProgram();
-//         }
-//         if (!transparents && glm->lines.size()) {
-//             LOG_GL_ERRORV(glEnable(GL_LINE_SMOOTH));
-//             LOG_GL_ERRORV(glUniform4f(solidCid, 0.0, 0, 0.0, 1.0));
-//             LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->lineIndexes));
-//             LOG_GL_ERRORV(glDrawElements(GL_LINES, glm->lines.size(), GL_UNSIGNED_INT, 0));
-//             LOG_GL_ERRORV(glDisable(GL_LINE_SMOOTH));
-//         }
+                            LOG_GL_ERRORV(glEnableVertexAttribArray(vnids));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->nbuffer));
+                            LOG_GL_ERRORV(glVertexAttribPointer(vnids, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+                        }
+                    }
+                    xlColor color = mid < 0 ? xlWHITE : glMesh->GetMaterial(mid).color;
+                    if (sm->type == GL_LINES) {
+                        color = xlBLACK;
+                    }
+                    LOG_GL_ERRORV(glUniform4f(solidCid,
+                                ((float)color.Red())/255.0 * b,
+                                ((float)color.Green())/255.0 * b,
+                                ((float)color.Blue())/255.0 * b,
+                                ((float)color.Alpha())/255.0
+                                ));
+                } else {
+                    xlGLTexture *t = (xlGLTexture*)glMesh->GetMaterial(mid).texture;
+                    if (lastIsSolid) {
+                        lastIsSolid = false;
+                        meshTextureProgram.UseProgram();
+                        if (!canvas->bindVertexArrayID(meshTextureProgram.ProgramID)) {
+                            LOG_GL_ERRORV(glEnableVertexAttribArray(bid));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->vbuffer));
+                            LOG_GL_ERRORV(glVertexAttribPointer(bid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+                            LOG_GL_ERRORV(glEnableVertexAttribArray(vid));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->tbuffer));
+                            LOG_GL_ERRORV(glVertexAttribPointer(vid, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+                            LOG_GL_ERRORV(glEnableVertexAttribArray(vnid));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->nbuffer));
+                            LOG_GL_ERRORV(glVertexAttribPointer(vnid, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+                            LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->indexBuffer));
+                        }
+
+                        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
+                        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
+                        LOG_GL_ERRORV(glUniform1i(textureID, 0));
+                        LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+                        LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+                        lastTexture = t;
+                    } else if (t != lastTexture) {
+                        LOG_GL_ERRORV(glActiveTexture(GL_TEXTURE0)); //switch to texture image unit 0
+                        LOG_GL_ERRORV(glBindTexture(GL_TEXTURE_2D, t->_texId));
+                        LOG_GL_ERRORV(glUniform1i(textureID, 0));
+                        LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+                        LOG_GL_ERRORV(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+                        lastTexture = t;
+                    }
+                }
+                // Draw the submesh.
+                LOG_GL_ERRORV(glDrawElements(sm->type, sm->count, glMesh->indexType, (void*)(sm->startIndex * glMesh->indexSize)));
+            }
+        }
+        if (!lastIsSolid) {
+            //lastIsSolid = true;
+            meshSolidProgram.UseProgram();
+        }
+        if (!transparents && glMesh->lines.size()) {
+            LOG_GL_ERRORV(glEnable(GL_LINE_SMOOTH));
+            LOG_GL_ERRORV(glUniform4f(solidCid, 0.0, 0, 0.0, 1.0));
+            LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->lineIndexes));
+            LOG_GL_ERRORV(glDrawElements(GL_LINES, glMesh->lines.size(), glMesh->indexType, 0));
+            LOG_GL_ERRORV(glDisable(GL_LINE_SMOOTH));
+        }
         
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(0));
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(1));
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(2));
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(3));
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(4));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-
-//         LOG_GL_ERRORV(glDepthFunc(GL_LEQUAL));
-//     }
-// }
+        LOG_GL_ERRORV(glDisableVertexAttribArray(0));
+        LOG_GL_ERRORV(glDisableVertexAttribArray(1));
+        LOG_GL_ERRORV(glDisableVertexAttribArray(2));
+        LOG_GL_ERRORV(glDisableVertexAttribArray(3));
+        LOG_GL_ERRORV(glDisableVertexAttribArray(4));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 
-// xlGraphicsContext* xlOGL3GraphicsContext::drawMeshWireframe(xlMesh *mesh, int brightness) {
-//     xlGLMesh *glm = (xlGLMesh*)mesh;
-//     if (glm->vbuffer == 0) {
-//         glm->LoadBuffers();
-//     }
-//     if (glm->wireFrame.size()) {
-//         LOG_GL_ERRORV(glDepthFunc(GL_LESS));
+        LOG_GL_ERRORV(glDepthFunc(GL_LEQUAL));
+    }
+}
+
+xlGraphicsContext* xlOGL3GraphicsContext::drawMeshWireframe(xlMesh *mesh, int brightness) {
+    xlGLMesh *glMesh = (xlGLMesh*)mesh;
+    if (glMesh->vbuffer == 0) {
+        glMesh->LoadBuffers();
+    }
+    if (glMesh->wireFrame.size()) {
+        LOG_GL_ERRORV(glDepthFunc(GL_LESS));
         
-//         ShaderProgram *program = &singleColor3Program;
-//         program->UseProgram();
-//         program->SetMatrix(frameData.MVP);
+        ShaderProgram *program = singleColor3Program.Get(0);
+        program->UseProgram();
+        SetFrameData(program);
         
-//         LOG_GL_ERRORV(GLuint cid = glGetUniformLocation(program->ProgramID, "inColor"));
-//         float b = brightness;
-//         b /= 100.0f;
-//         LOG_GL_ERRORV(glUniform4f(cid, 0.0f, 1.0f * b, 0.0f, 255.0f));
+        LOG_GL_ERRORV(GLuint cid = glGetUniformLocation(program->ProgramID, "inColor"));
+        float b = brightness;
+        b /= 100.0f;
+        LOG_GL_ERRORV(glUniform4f(cid, 0.0f, 1.0f * b, 0.0f, 255.0f));
         
-//         LOG_GL_ERRORV(glEnableVertexAttribArray(0));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glm->vbuffer));
-//         LOG_GL_ERRORV(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
-//         int caps = enableCapabilities;
-//         if (isBlending) {
-//             caps = GL_LINE_SMOOTH;
-//         }
-//         LOG_GL_ERRORV(glEnable(caps));
-//         program->SetRenderType(0);
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glm->wfIndexes));
-//         LOG_GL_ERRORV(glDrawElements(GL_LINES, glm->wireFrame.size(), GL_UNSIGNED_INT, 0));
+        LOG_GL_ERRORV(glEnableVertexAttribArray(0));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, glMesh->vbuffer));
+        LOG_GL_ERRORV(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0 ));
+        int caps = enableCapabilities;
+        if (isBlending) {
+            caps = GL_LINE_SMOOTH;
+        }
+        if (caps > 0) {
+            LOG_GL_ERRORV(glEnable(caps));
+        }
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glMesh->wfIndexes));
+        LOG_GL_ERRORV(glDrawElements(GL_LINES, glMesh->wireFrame.size(), glMesh->indexType, 0));
+        if (caps > 0) {
+            LOG_GL_ERRORV(glDisable(caps));
+        }
         
-//         LOG_GL_ERRORV(glDisableVertexAttribArray(0));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
-//         LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-
-//         LOG_GL_ERRORV(glDepthFunc(GL_LEQUAL));
-//         return this;
-//     }
-//     return this;
-// }
+        LOG_GL_ERRORV(glDisableVertexAttribArray(0));
+        LOG_GL_ERRORV(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        LOG_GL_ERRORV(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+        LOG_GL_ERRORV(glDepthFunc(GL_LEQUAL));
+        return this;
+    }
+    return this;
+}
 
 xlGraphicsContext* xlOGL3GraphicsContext::enableBlending(bool e) {
     if (e) {
@@ -2073,9 +4133,73 @@ xlGraphicsContext* xlOGL3GraphicsContext::enableBlending(bool e) {
 }
 
 // Setup the Viewport
+// When the canvas is rendering one tile of a larger frame, returns the matrix that
+// maps that tile's portion of clip space onto the whole viewport.  Identity otherwise.
+glm::mat4 xlOGL3GraphicsContext::TileProjection() const {
+    const xlGLCanvas::RenderTile &tile = canvas->GetRenderTile();
+    if (!tile.active || tile.width <= 0 || tile.height <= 0) {
+        return glm::mat4(1.0f);
+    }
+    float sx = (float)tile.fullWidth / (float)tile.width;
+    float sy = (float)tile.fullHeight / (float)tile.height;
+    // center of the tile in normalized device coordinates of the full frame
+    float cx = (2.0f * tile.x + tile.width) / (float)tile.fullWidth - 1.0f;
+    float cy = (2.0f * tile.y + tile.height) / (float)tile.fullHeight - 1.0f;
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(-cx * sx, -cy * sy, 0.0f));
+    return glm::scale(m, glm::vec3(sx, sy, 1.0f));
+}
+
+void xlOGL3GraphicsContext::SetFrameData(ShaderProgram *program) {
+    if (frameDataChanged) {
+        // only now are the pending transforms multiplied out
+        frameData.MVP = transforms.GetMVP();
+        frameData.modelMatrix = transforms.GetModel();
+        frameData.viewMatrix = transforms.GetView();
+        frameData.perspectiveMatrix = transforms.GetProjection();
+    }
+    if (!program->UsesFrameDataBlock) {
+        program->SetMatrix(frameData.MVP);
+        return;
+    }
+    if (frameDataOwner != contextSerial) {
+        if (frameDataBuffer == 0) {
+            LOG_GL_ERRORV(glGenBuffers(1, &frameDataBuffer));
+            LOG_GL_ERRORV(glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer));
+            LOG_GL_ERRORV(glBufferData(GL_UNIFORM_BUFFER, sizeof(OGLFrameData), nullptr, GL_DYNAMIC_DRAW));
+        }
+        // binding points are per GL context, so bind again for each new frame
+        LOG_GL_ERRORV(glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameDataBuffer));
+        frameDataOwner = contextSerial;
+        frameDataChanged = true;
+    }
+    if (frameDataChanged) {
+        LOG_GL_ERRORV(glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer));
+        LOG_GL_ERRORV(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(OGLFrameData), &frameData));
+        LOG_GL_ERRORV(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+        frameDataChanged = false;
+    }
+}
+
+float xlOGL3GraphicsContext::GetPixelsPerUnit() {
+    const glm::mat4 &mvp = transforms.GetMVP();
+    // model x and y axes at the origin, in pixels, the larger one so nothing
+    // gets too few segments
+    float w = std::abs(mvp[3][3]) > 0.000001f ? std::abs(mvp[3][3]) : 0.000001f;
+    float hw = frameData.viewport.x * 0.5f;
+    float hh = frameData.viewport.y * 0.5f;
+    float px = std::sqrt(mvp[0][0] * hw * mvp[0][0] * hw + mvp[0][1] * hh * mvp[0][1] * hh);
+    float py = std::sqrt(mvp[1][0] * hw * mvp[1][0] * hw + mvp[1][1] * hh * mvp[1][1] * hh);
+    return std::max(px, py) / w;
+}
+
+// size of the viewport in framebuffer pixels, for shaders sizing things in pixels
+void xlOGL3GraphicsContext::SetViewportSize(int w, int h) {
+    w = std::max(w, 1);
+    h = std::max(h, 1);
+    frameData.viewport = glm::vec4(w, h, 2.0f / w, 2.0f / h);
+}
+
 xlGraphicsContext* xlOGL3GraphicsContext::SetViewport(int topleft_x, int topleft_y, int bottomright_x, int bottomright_y, bool is3D) {
-    frameData.modelMatrix = glm::mat4(1.0);
-    frameData.viewMatrix = glm::mat4(1.0);
     if (is3D) {
         float x, y, x2, y2;
         x = topleft_x;
@@ -2090,16 +4214,24 @@ xlGraphicsContext* xlOGL3GraphicsContext::SetViewport(int topleft_x, int topleft
         y = sf * y;
         x2 = sf * x2;
         y2 = sf * y2;
-        LOG_GL_ERRORV(glViewport(x, y, x2 - x, y2 - y));
-        LOG_GL_ERRORV(glScissor(0, 0, x2 - x, y2 - y));
+        if (canvas->GetRenderTile().active) {
+            const xlGLCanvas::RenderTile &tile = canvas->GetRenderTile();
+            LOG_GL_ERRORV(glViewport(0, 0, tile.width, tile.height));
+            LOG_GL_ERRORV(glScissor(0, 0, tile.width, tile.height));
+            SetViewportSize(tile.width, tile.height);
+        } else {
+            LOG_GL_ERRORV(glViewport(x, y, x2 - x, y2 - y));
+            LOG_GL_ERRORV(glScissor(0, 0, x2 - x, y2 - y));
+            SetViewportSize(x2 - x, y2 - y);
+        }
         
         float min = 1.0f;
         if (depth < 24) {
             min = 50.0f;
         }
         glm::mat4 m = glm::perspective(glm::radians(45.0f), (float) (bottomright_x-topleft_x) / (float)(topleft_y-bottomright_y), min, 200000.0f); // bumped from 20,000 to 200,000 to allow bigger models without clipping
-        frameData.MVP = m;
-        frameData.perspectiveMatrix = frameData.MVP;
+        m = TileProjection() * m;
+        transforms.Reset(m);
 
         LOG_GL_ERRORV(glClearColor(0,0,0,0));   // background color
         LOG_GL_ERRORV(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
@@ -2120,10 +4252,16 @@ xlGraphicsContext* xlOGL3GraphicsContext::SetViewport(int topleft_x, int topleft
 
         int w = std::max(x, x2) - std::min(x, x2);
         int h = std::max(y, y2) - std::min(y, y2);
-        LOG_GL_ERRORV(glViewport(x,y,w,h));
+        if (canvas->GetRenderTile().active) {
+            LOG_GL_ERRORV(glViewport(0, 0, canvas->GetRenderTile().width, canvas->GetRenderTile().height));
+            SetViewportSize(canvas->GetRenderTile().width, canvas->GetRenderTile().height);
+        } else {
+            LOG_GL_ERRORV(glViewport(x,y,w,h));
+            SetViewportSize(w, h);
+        }
         glm::mat4 m = glm::ortho((float)topleft_x, (float)bottomright_x, (float)bottomright_y, (float)topleft_y);
-        frameData.MVP = m;
-        frameData.perspectiveMatrix = frameData.MVP;
+        m = TileProjection() * m;
+        transforms.Reset(m);
 
         if (canvas->RequiresDepthBuffer()) {
             LOG_GL_ERRORV(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
@@ -2137,70 +4275,54 @@ xlGraphicsContext* xlOGL3GraphicsContext::SetViewport(int topleft_x, int topleft
 
 //manipulating the matrices
 xlGraphicsContext* xlOGL3GraphicsContext::PushMatrix() {
-    matrixStack.push(frameData.MVP);
-    matrixStack.push(frameData.viewMatrix);
-    matrixStack.push(frameData.modelMatrix);
+    transforms.Push();
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::PopMatrix() {
-    if (!matrixStack.empty()) {
-        frameData.modelMatrix = matrixStack.top();
-        matrixStack.pop();
-        frameData.viewMatrix = matrixStack.top();
-        matrixStack.pop();
-        frameData.MVP = matrixStack.top();
-        matrixStack.pop();
+    if (transforms.Pop()) {
         frameDataChanged = true;
     }
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::Translate(float x, float y, float z) {
-    frameData.MVP = glm::translate(frameData.MVP, glm::vec3(x, y, z));
-    frameData.modelMatrix = glm::translate(frameData.modelMatrix, glm::vec3(x, y, z));
+    transforms.TranslateModel(x, y, z);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::Rotate(float angle, float x, float y, float z) {
     angle = angle * 3.14159f/180.0f;
-    frameData.MVP = glm::rotate(frameData.MVP, angle, glm::vec3(x, y, z));
-    frameData.modelMatrix = glm::rotate(frameData.modelMatrix, angle, glm::vec3(x, y, z));
+    transforms.RotateModel(angle, x, y, z);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::Scale(float w, float h, float z) {
-    frameData.MVP = glm::scale(frameData.MVP, glm::vec3(w, h, z));
-    frameData.modelMatrix = glm::scale(frameData.modelMatrix, glm::vec3(w, h, z));
+    transforms.ScaleModel(w, h, z);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::ScaleViewMatrix(float w, float h, float z) {
-    frameData.MVP = glm::scale(frameData.MVP, glm::vec3(w, h, z));
-    frameData.viewMatrix = glm::scale(frameData.viewMatrix, glm::vec3(w, h, z));
+    transforms.ScaleView(w, h, z);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::TranslateViewMatrix(float x, float y, float z) {
-    frameData.MVP = glm::translate(frameData.MVP, glm::vec3(x, y, z));
-    frameData.viewMatrix = glm::translate(frameData.viewMatrix, glm::vec3(x, y, z));
+    transforms.TranslateView(x, y, z);
     frameDataChanged = true;
     return this;
 }
 
 xlGraphicsContext* xlOGL3GraphicsContext::SetCamera(const glm::mat4 &m) {
-    frameData.MVP = frameData.MVP * m;
-    frameData.viewMatrix = frameData.viewMatrix * m;
+    transforms.ApplyView(m);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::SetModelMatrix(const glm::mat4 &m) {
-    frameData.MVP = frameData.MVP * m;
-    frameData.modelMatrix = m;
+    transforms.SetModel(m);
     frameDataChanged = true;
     return this;
 }
 xlGraphicsContext* xlOGL3GraphicsContext::ApplyMatrix(const glm::mat4 &m) {
-    frameData.MVP = frameData.MVP * m;
-    frameData.modelMatrix = frameData.modelMatrix * m;
+    transforms.ApplyModel(m);
     frameDataChanged = true;
     return this;
 }
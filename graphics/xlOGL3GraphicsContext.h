@@ -11,8 +11,6 @@
 
 #include <GL/glew.h>
 
-#include <stack>
-
 
 #define GLM_ENABLE_EXPERIMENTAL
 
@@ -24,22 +22,32 @@
 
 #include "xlGraphicsContext.h"
 #include "xlGLCanvas.h"
+#include "xlTransformStack.h"
+
 
+class ShaderProgram;
+class xlOGL3VertexColorAccumulator;
 
 class xlOGL3GraphicsContext : public xlGraphicsContext {
 public:
+    // Mirrors the std140 FrameData uniform block, keep the members in sync
     class OGLFrameData {
     public:
         glm::mat4 MVP;
         glm::mat4 modelMatrix;
         glm::mat4 viewMatrix;
         glm::mat4 perspectiveMatrix;
+        glm::vec4 viewport; // width, height, 2 / width, 2 / height in pixels
     };
     
     xlOGL3GraphicsContext(xlGLCanvas *c);
     virtual ~xlOGL3GraphicsContext();
     
     static bool InitializeSharedContext();
+    // Start building the programs that are otherwise created on first use
+    static void WarmUpShaders();
+    // Finish any submitted programs the driver has completed, never blocks
+    static void ResolveCompletedShaders();
     
     
     virtual xlVertexAccumulator *createVertexAccumulator() override;
@@ -61,12 +69,17 @@ public:
     virtual xlGraphicsContext* drawTriangleStrip(xlVertexAccumulator *vac, const xlColor &c, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawPoints(xlVertexAccumulator *vac, const xlColor &c, float pointSize, bool smoothPoints, int start = 0, int count = -1) override;
 
-    xlGraphicsContext* drawPrimitive(int type, xlVertexColorAccumulator *vac, int start, int count);
+    // visibleOnly draws just the vertices that are neither black nor transparent
+    xlGraphicsContext* drawPrimitive(int type, xlVertexColorAccumulator *vac, int start, int count, bool visibleOnly = false);
+    // the vertices firsts[i] to firsts[i] + counts[i] for each i, in one call
+    xlGraphicsContext* drawPrimitiveRuns(int type, xlVertexColorAccumulator *vac,
+                                         const std::vector<GLint> &firsts, const std::vector<GLsizei> &counts);
     virtual xlGraphicsContext* drawLines(xlVertexColorAccumulator *vac, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawLineStrip(xlVertexColorAccumulator *vac, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawTriangles(xlVertexColorAccumulator *vac, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawTriangleStrip(xlVertexColorAccumulator *vac, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawPoints(xlVertexColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) override;
+    virtual xlGraphicsContext* drawVisiblePoints(xlVertexColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) override;
 
 
     virtual xlVertexIndexedColorAccumulator *createVertexIndexedColorAccumulator() override;
@@ -76,6 +89,25 @@ public:
     virtual xlGraphicsContext* drawTriangleStrip(xlVertexIndexedColorAccumulator *vac, int start = 0, int count = -1) override;
     virtual xlGraphicsContext* drawPoints(xlVertexIndexedColorAccumulator *vac, float pointSize, bool smoothPoints, int start = 0, int count = -1) override;
 
+    virtual xlCircleAccumulator *createCircleAccumulator() override;
+    virtual xlGraphicsContext* drawCircles(xlCircleAccumulator *cac, int start = 0, int count = -1) override;
+    virtual xlPolylineAccumulator *createPolylineAccumulator() override;
+    virtual xlGraphicsContext* drawPolylines(xlPolylineAccumulator *pac, float width,
+                                             xlPolylineAccumulator::JoinStyle join = xlPolylineAccumulator::MITER_JOIN,
+                                             float dashLength = 0.0f, float gapLength = 0.0f) override;
+    virtual xlGradientAccumulator *createGradientAccumulator() override;
+    virtual xlGraphicsContext* drawGradients(xlGradientAccumulator *gac, int start = 0, int count = -1) override;
+    virtual xlPixelGridAccumulator *createPixelGridAccumulator() override;
+    virtual xlGraphicsContext* drawPixelGrid(xlPixelGridAccumulator *pac,
+                                             xlPixelGridAccumulator::PixelShape shape = xlPixelGridAccumulator::SQUARE_PIXELS,
+                                             bool hideBlack = false, int start = 0, int count = -1) override;
+    virtual xlPathAccumulator *createPathAccumulator() override;
+    virtual xlGraphicsContext* drawPaths(xlPathAccumulator *pac, int start = 0, int count = -1) override;
+    virtual xlChunkedColorAccumulator *createChunkedColorAccumulator(xlChunkedColorAccumulator::PrimitiveType type, float tileSize) override;
+    virtual xlGraphicsContext* drawChunks(xlChunkedColorAccumulator *cac) override;
+    virtual xlStaticBatch *createStaticBatch() override;
+    virtual xlGraphicsContext* drawStaticBatch(xlStaticBatch *batch) override;
+
     
     virtual xlGraphicsContext* drawTexture(xlTexture *texture,
                                            float x, float y, float x2, float y2,
@@ -85,18 +117,19 @@ public:
     virtual xlGraphicsContext* drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, int brightness, uint8_t alpha, int start, int count) override;
     virtual xlGraphicsContext* drawTexture(xlVertexTextureAccumulator *vac, xlTexture *texture, const xlColor &c, int start = 0, int count = -1) override;
 
-    // virtual xlMesh *loadMeshFromObjFile(const std::string &file) override;
-    // virtual xlGraphicsContext* drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) override;
-    // virtual xlGraphicsContext* drawMeshTransparents(xlMesh *mesh, int brightness) override;
-    // virtual xlGraphicsContext* drawMeshWireframe(xlMesh *mesh, int brightness) override;
+    virtual xlMesh *loadMeshFromObjFile(const std::string &file) override;
+    virtual xlGraphicsContext* drawMeshSolids(xlMesh *mesh, int brightness, bool useViewMatrix) override;
+    virtual xlGraphicsContext* drawMeshTransparents(xlMesh *mesh, int brightness) override;
+    virtual xlGraphicsContext* drawMeshWireframe(xlMesh *mesh, int brightness) override;
     
-    // void drawMesh(xlMesh *mesh, int brightness, bool useViewMatrix, bool transparents);
+    void drawMesh(xlMesh *mesh, int brightness, bool useViewMatrix, bool transparents);
 
 
     virtual xlGraphicsContext* enableBlending(bool e = true) override;
 
     // Setup the Viewport
     xlGraphicsContext* SetViewport(int x1, int y1, int x2, int y2, bool is3D) override;
+    glm::mat4 TileProjection() const;
 
     //manipulating the matrices
     virtual xlGraphicsContext* PushMatrix() override;
@@ -106,6 +139,7 @@ public:
     virtual xlGraphicsContext* Scale(float w, float h, float z) override;
     virtual xlGraphicsContext* ScaleViewMatrix(float w, float h, float z) override;
     virtual xlGraphicsContext* TranslateViewMatrix(float x, float y, float z) override;
+    virtual float GetPixelsPerUnit() override;
 
     virtual xlGraphicsContext* SetCamera(const glm::mat4 &m) override;
     virtual xlGraphicsContext* SetModelMatrix(const glm::mat4 &m) override;
@@ -115,7 +149,23 @@ public:
     bool isBlending = false;
     xlGLCanvas *canvas;
     
-    std::stack<glm::mat4> matrixStack;
+    xlTransformStack transforms;
     OGLFrameData frameData;
     bool frameDataChanged = true;
+
+private:
+    // Make the current matrices visible to the program, via the shared uniform
+    // buffer when it reads the FrameData block, otherwise through its MVP uniform
+    void SetFrameData(ShaderProgram *program);
+    // Binds the distance field circle program, radii in pixels or model units,
+    // or returns null if the profile has no instancing
+    ShaderProgram *UseCircleProgram(bool pixelRadius);
+    // Binds the program and buffers for the colored vertices around 'draw'
+    void drawColored(int type, xlOGL3VertexColorAccumulator *v, const std::function<void()> &draw);
+    void SetViewportSize(int w, int h);
+
+    // last glPointSize, so it never has to be read back
+    float pointSize = 1.0f;
+
+    uint64_t contextSerial;
 };
@@ -0,0 +1,885 @@
+#include "xlObjLoader.h"
+#include "xlMeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <log4cpp/Category.hh>
+
+namespace {
+    // bump if the cache layout changes
+    static const uint32_t CACHE_VERSION = 2;
+    static const char CACHE_MAGIC[4] = { 'X', 'L', 'M', 'C' };
+    // smaller files are not worth the threads
+    static const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+    // Read only view of a whole file, memory mapped where possible
+    class MappedFile {
+    public:
+        MappedFile(const std::string &file) {
+#ifdef _WIN32
+            fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (fileHandle == INVALID_HANDLE_VALUE) {
+                return;
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+                return;
+            }
+            mapHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapHandle == nullptr) {
+                return;
+            }
+            data = (const char*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+            if (data != nullptr) {
+                length = (size_t)size.QuadPart;
+            }
+#else
+            fd = open(file.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                return;
+            }
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                return;
+            }
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            data = (const char*)p;
+            length = st.st_size;
+#endif
+        }
+        ~MappedFile() {
+#ifdef _WIN32
+            if (data) {
+                UnmapViewOfFile(data);
+            }
+            if (mapHandle) {
+                CloseHandle(mapHandle);
+            }
+            if (fileHandle != INVALID_HANDLE_VALUE) {
+                CloseHandle(fileHandle);
+            }
+#else
+            if (data) {
+                munmap((void*)data, length);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+#endif
+        }
+        const char *data = nullptr;
+        size_t length = 0;
+    private:
+#ifdef _WIN32
+        HANDLE fileHandle = INVALID_HANDLE_VALUE;
+        HANDLE mapHandle = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+
+    static inline bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+    static inline const char *SkipSpace(const char *p, const char *end) {
+        while (p < end && IsSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+    static inline const char *SkipLine(const char *p, const char *end) {
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        return p;
+    }
+
+    // strtof is locale dependent and slow, OBJ only needs plain decimal numbers
+    static inline const char *ParseFloat(const char *p, const char *end, float &out) {
+        static const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        p = SkipSpace(p, end);
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = *p == '-';
+            p++;
+        }
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+            } else {
+                exponent++;
+            }
+            p++;
+        }
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits++;
+                    exponent--;
+                }
+                p++;
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool eneg = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                eneg = *p == '-';
+                p++;
+            }
+            int e = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (e < 10000) {
+                    e = e * 10 + (*p - '0');
+                }
+                p++;
+            }
+            exponent += eneg ? -e : e;
+        }
+        double v = (double)mantissa;
+        if (exponent < 0) {
+            v = exponent >= -22 ? v / POW10[-exponent] : v * std::pow(10.0, exponent);
+        } else if (exponent > 0) {
+            v = exponent <= 22 ? v * POW10[exponent] : v * std::pow(10.0, exponent);
+        }
+        out = (float)(neg ? -v : v);
+        return p;
+    }
+    static inline const char *ParseInt(const char *p, const char *end, int &out) {
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = *p == '-';
+            p++;
+        }
+        int v = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            v = v * 10 + (*p - '0');
+            p++;
+        }
+        out = neg ? -v : v;
+        return p;
+    }
+    static inline std::string ParseName(const char *p, const char *end) {
+        p = SkipSpace(p, end);
+        const char *e = SkipLine(p, end);
+        while (e > p && IsSpace(e[-1])) {
+            e--;
+        }
+        return std::string(p, e);
+    }
+
+    // One corner of a face, line or point.  Positive OBJ indexes are stored
+    // zero based.  Negative (relative) ones can only be resolved once the
+    // counts of the earlier chunks are known, so they are stored relative to
+    // the chunk start with the matching REL bit set.
+    struct RawIndex {
+        enum { REL_V = 1, REL_T = 2, REL_N = 4 };
+        int v = -1;
+        int t = -1;
+        int n = -1;
+        uint8_t rel = 0;
+    };
+
+    // A range of chunk corners sharing material, name and primitive type
+    struct Run {
+        std::string material;
+        std::string name;
+        bool hasMaterial = false;
+        bool hasName = false;
+        bool points = false;
+        uint32_t start = 0;
+        uint32_t count = 0;
+    };
+
+    struct Chunk {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+
+        std::vector<float> v, vn, vt;
+        std::vector<RawIndex> corners; // 3 per triangle, 1 per point
+        std::vector<RawIndex> lineCorners; // 2 per segment
+        std::vector<Run> runs;
+        std::vector<std::string> mtllibs;
+
+        // state while parsing
+        std::string material;
+        std::string name;
+        bool hasMaterial = false;
+        bool hasName = false;
+
+        void AddCorners(const RawIndex *c, int count, bool points) {
+            if (runs.empty() || runs.back().points != points
+                || runs.back().hasMaterial != hasMaterial || runs.back().material != material
+                || runs.back().hasName != hasName || runs.back().name != name) {
+                Run r;
+                r.material = material;
+                r.name = name;
+                r.hasMaterial = hasMaterial;
+                r.hasName = hasName;
+                r.points = points;
+                r.start = corners.size();
+                runs.push_back(r);
+            }
+            corners.insert(corners.end(), c, c + count);
+            runs.back().count += count;
+        }
+
+        const char *ParseCorner(const char *p, const char *e, RawIndex &idx) {
+            int i;
+            p = ParseInt(p, e, i);
+            if (i < 0) {
+                idx.v = (int)(v.size() / 3) + i;
+                idx.rel |= RawIndex::REL_V;
+            } else {
+                idx.v = i - 1;
+            }
+            if (p < e && *p == '/') {
+                p++;
+                if (p < e && *p != '/') {
+                    p = ParseInt(p, e, i);
+                    if (i < 0) {
+                        idx.t = (int)(vt.size() / 2) + i;
+                        idx.rel |= RawIndex::REL_T;
+                    } else {
+                        idx.t = i - 1;
+                    }
+                }
+                if (p < e && *p == '/') {
+                    p++;
+                    p = ParseInt(p, e, i);
+                    if (i < 0) {
+                        idx.n = (int)(vn.size() / 3) + i;
+                        idx.rel |= RawIndex::REL_N;
+                    } else {
+                        idx.n = i - 1;
+                    }
+                }
+            }
+            return p;
+        }
+
+        void Parse() {
+            std::vector<RawIndex> poly;
+            const char *p = begin;
+            while (p < end) {
+                p = SkipSpace(p, end);
+                const char *eol = SkipLine(p, end);
+                if (p + 1 < eol) {
+                    char c0 = p[0];
+                    char c1 = p[1];
+                    if (c0 == 'v' && IsSpace(c1)) {
+                        float x, y, z;
+                        const char *q = ParseFloat(p + 2, eol, x);
+                        q = ParseFloat(q, eol, y);
+                        ParseFloat(q, eol, z);
+                        v.push_back(x);
+                        v.push_back(y);
+                        v.push_back(z);
+                    } else if (c0 == 'v' && c1 == 'n') {
+                        float x, y, z;
+                        const char *q = ParseFloat(p + 2, eol, x);
+                        q = ParseFloat(q, eol, y);
+                        ParseFloat(q, eol, z);
+                        vn.push_back(x);
+                        vn.push_back(y);
+                        vn.push_back(z);
+                    } else if (c0 == 'v' && c1 == 't') {
+                        float x, y = 0.0f;
+                        const char *q = ParseFloat(p + 2, eol, x);
+                        q = SkipSpace(q, eol);
+                        if (q < eol) {
+                            ParseFloat(q, eol, y);
+                        }
+                        vt.push_back(x);
+                        vt.push_back(y);
+                    } else if ((c0 == 'f' || c0 == 'l' || c0 == 'p') && IsSpace(c1)) {
+                        poly.clear();
+                        const char *q = SkipSpace(p + 2, eol);
+                        while (q < eol) {
+                            RawIndex idx;
+                            const char *n = ParseCorner(q, eol, idx);
+                            if (n == q) {
+                                break;
+                            }
+                            poly.push_back(idx);
+                            q = SkipSpace(n, eol);
+                        }
+                        if (c0 == 'f') {
+                            // triangle fan, fine for the convex polygons exporters write
+                            for (size_t x = 2; x < poly.size(); x++) {
+                                RawIndex tri[3] = { poly[0], poly[x - 1], poly[x] };
+                                AddCorners(tri, 3, false);
+                            }
+                        } else if (c0 == 'l') {
+                            for (size_t x = 1; x < poly.size(); x++) {
+                                lineCorners.push_back(poly[x - 1]);
+                                lineCorners.push_back(poly[x]);
+                            }
+                        } else if (!poly.empty()) {
+                            AddCorners(&poly[0], poly.size(), true);
+                        }
+                    } else if ((c0 == 'o' || c0 == 'g') && IsSpace(c1)) {
+                        name = ParseName(p + 2, eol);
+                        hasName = true;
+                    } else if (eol - p > 7 && strncmp(p, "usemtl", 6) == 0 && IsSpace(p[6])) {
+                        material = ParseName(p + 7, eol);
+                        hasMaterial = true;
+                    } else if (eol - p > 7 && strncmp(p, "mtllib", 6) == 0 && IsSpace(p[6])) {
+                        mtllibs.push_back(ParseName(p + 7, eol));
+                    }
+                }
+                p = eol + 1;
+            }
+        }
+    };
+
+    struct VertexKey {
+        int v, t, n;
+        bool operator==(const VertexKey &o) const {
+            return v == o.v && t == o.t && n == o.n;
+        }
+    };
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey &k) const {
+            uint64_t h = (uint64_t)(uint32_t)k.v * 0x9E3779B97F4A7C15ULL;
+            h ^= ((uint64_t)(uint32_t)k.t + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+            h ^= ((uint64_t)(uint32_t)k.n + 0x165667B19E3779F9ULL) * 0x94D049BB133111EBULL;
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    // size and modification time, what the cache is validated against
+    struct FileStamp {
+        uint64_t size = 0;
+        int64_t time = 0;
+        bool valid = false;
+    };
+    static FileStamp GetStamp(const std::string &file) {
+        FileStamp s;
+        std::error_code ec;
+        s.size = std::filesystem::file_size(file, ec);
+        if (ec) {
+            return s;
+        }
+        auto t = std::filesystem::last_write_time(file, ec);
+        if (ec) {
+            return s;
+        }
+        s.time = (int64_t)t.time_since_epoch().count();
+        s.valid = true;
+        return s;
+    }
+
+    template<class T>
+    static void WriteVector(std::ofstream &out, const std::vector<T> &v) {
+        uint64_t n = v.size();
+        out.write((const char*)&n, sizeof(n));
+        if (n) {
+            out.write((const char*)&v[0], n * sizeof(T));
+        }
+    }
+    template<class T>
+    static bool ReadVector(std::ifstream &in, std::vector<T> &v) {
+        uint64_t n = 0;
+        if (!in.read((char*)&n, sizeof(n)) || n > ((uint64_t)1 << 34)) {
+            return false;
+        }
+        v.resize(n);
+        return n == 0 || (bool)in.read((char*)&v[0], n * sizeof(T));
+    }
+    static void WriteString(std::ofstream &out, const std::string &s) {
+        uint32_t n = s.size();
+        out.write((const char*)&n, sizeof(n));
+        out.write(s.c_str(), n);
+    }
+    static bool ReadString(std::ifstream &in, std::string &s) {
+        uint32_t n = 0;
+        if (!in.read((char*)&n, sizeof(n)) || n > 65536) {
+            return false;
+        }
+        s.resize(n);
+        return n == 0 || (bool)in.read(&s[0], n);
+    }
+    template<class T>
+    static void WritePOD(std::ofstream &out, const T &v) {
+        out.write((const char*)&v, sizeof(T));
+    }
+    template<class T>
+    static bool ReadPOD(std::ifstream &in, T &v) {
+        return (bool)in.read((char*)&v, sizeof(T));
+    }
+
+    static std::string CachePath(const std::string &file) {
+        return file + ".xlmesh";
+    }
+}
+
+void xlObjMesh::Clear() {
+    positions.clear();
+    normals.clear();
+    texcoords.clear();
+    indexes.clear();
+    lines.clear();
+    subMeshes.clear();
+    materials.clear();
+    mtlFiles.clear();
+    fromCache = false;
+}
+
+bool xlObjMesh::Load(const std::string &file, bool useCache) {
+    static log4cpp::Category &logger_base = log4cpp::Category::getInstance(std::string("log_base"));
+    Clear();
+    if (useCache && ReadCache(file)) {
+        fromCache = true;
+        logger_base.debug("Loaded mesh %s from cache: %d vertices, %d indexes.",
+                          file.c_str(), (int)GetVertexCount(), (int)indexes.size());
+        return true;
+    }
+    Clear();
+
+    MappedFile mapped(file);
+    if (mapped.data == nullptr) {
+        logger_base.error("Could not read mesh file %s.", file.c_str());
+        return false;
+    }
+    if (!ParseObj(file, mapped.data, mapped.length)) {
+        return false;
+    }
+    logger_base.debug("Loaded mesh %s: %d vertices, %d indexes, %d materials.",
+                      file.c_str(), (int)GetVertexCount(), (int)indexes.size(), (int)materials.size());
+    // the cache holds the optimized order, so this only runs on the first load
+    Optimize(file);
+    if (useCache) {
+        WriteCache(file);
+    }
+    return true;
+}
+
+bool xlObjMesh::ParseObj(const std::string &file, const char *data, size_t len) {
+    // line aligned chunks, one per thread
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t numChunks = std::max((size_t)1, std::min(threads, len / MIN_CHUNK_SIZE));
+    std::vector<Chunk> chunks(numChunks);
+    const char *end = data + len;
+    const char *p = data;
+    for (size_t x = 0; x < numChunks; x++) {
+        chunks[x].begin = p;
+        const char *e = x == numChunks - 1 ? end : std::min(end, data + len * (x + 1) / numChunks);
+        e = SkipLine(e, end);
+        if (e < end) {
+            e++;
+        }
+        chunks[x].end = e;
+        p = e;
+    }
+    if (numChunks == 1) {
+        chunks[0].Parse();
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t x = 1; x < numChunks; x++) {
+            workers.emplace_back([&chunks, x]() { chunks[x].Parse(); });
+        }
+        chunks[0].Parse();
+        for (auto &w : workers) {
+            w.join();
+        }
+    }
+
+    // merge the chunk attributes in order, remembering where each chunk starts
+    std::vector<float> v, vn, vt;
+    std::vector<int> vStart(numChunks), vnStart(numChunks), vtStart(numChunks);
+    size_t totalV = 0, totalVn = 0, totalVt = 0, totalCorners = 0;
+    for (auto &c : chunks) {
+        totalV += c.v.size();
+        totalVn += c.vn.size();
+        totalVt += c.vt.size();
+        totalCorners += c.corners.size();
+    }
+    v.reserve(totalV);
+    vn.reserve(totalVn);
+    vt.reserve(totalVt);
+    for (size_t x = 0; x < numChunks; x++) {
+        vStart[x] = v.size() / 3;
+        vnStart[x] = vn.size() / 3;
+        vtStart[x] = vt.size() / 2;
+        v.insert(v.end(), chunks[x].v.begin(), chunks[x].v.end());
+        vn.insert(vn.end(), chunks[x].vn.begin(), chunks[x].vn.end());
+        vt.insert(vt.end(), chunks[x].vt.begin(), chunks[x].vt.end());
+        chunks[x].v.clear();
+        chunks[x].vn.clear();
+        chunks[x].vt.clear();
+        chunks[x].v.shrink_to_fit();
+        chunks[x].vn.shrink_to_fit();
+        chunks[x].vt.shrink_to_fit();
+    }
+    int numV = v.size() / 3;
+    int numVn = vn.size() / 3;
+    int numVt = vt.size() / 2;
+
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> indexMap;
+    indexMap.reserve(std::min(totalCorners, (size_t)numV * 2 + 16));
+    positions.reserve((size_t)numV * 3);
+    normals.reserve((size_t)numV * 3);
+    texcoords.reserve((size_t)numV * 2);
+    indexes.reserve(totalCorners);
+
+    auto getOrAddIndex = [&](const RawIndex &r, size_t chunk) -> uint32_t {
+        VertexKey key;
+        key.v = r.v + ((r.rel & RawIndex::REL_V) ? vStart[chunk] : 0);
+        key.t = r.t + ((r.rel & RawIndex::REL_T) ? vtStart[chunk] : 0);
+        key.n = r.n + ((r.rel & RawIndex::REL_N) ? vnStart[chunk] : 0);
+        if (key.v < 0 || key.v >= numV) {
+            key.v = 0; // broken file, don't read out of bounds
+        }
+        if (key.t >= numVt || key.t < 0) {
+            key.t = -1;
+        }
+        if (key.n >= numVn || key.n < 0) {
+            key.n = -1;
+        }
+        auto it = indexMap.emplace(key, (uint32_t)(positions.size() / 3));
+        if (it.second) {
+            positions.insert(positions.end(), &v[key.v * 3], &v[key.v * 3] + 3);
+            if (key.n >= 0) {
+                normals.insert(normals.end(), &vn[key.n * 3], &vn[key.n * 3] + 3);
+            } else {
+                normals.insert(normals.end(), 3, 0.0f);
+            }
+            if (key.t >= 0) {
+                texcoords.insert(texcoords.end(), &vt[key.t * 2], &vt[key.t * 2] + 2);
+            } else {
+                texcoords.insert(texcoords.end(), 2, 0.0f);
+            }
+        }
+        return it.first->second;
+    };
+
+    if (numV == 0) {
+        return true;
+    }
+
+    // MTL files first so material names can be resolved while merging
+    std::filesystem::path dir = std::filesystem::path(file).parent_path();
+    for (auto &c : chunks) {
+        for (auto &lib : c.mtllibs) {
+            std::string path = (dir / lib).string();
+            if (std::find(mtlFiles.begin(), mtlFiles.end(), path) == mtlFiles.end()) {
+                mtlFiles.push_back(path);
+                ParseMtl(path);
+            }
+        }
+    }
+    auto materialIndex = [this](const std::string &name) -> int {
+        for (size_t x = 0; x < materials.size(); x++) {
+            if (materials[x].name == name) {
+                return x;
+            }
+        }
+        // referenced but not defined, draw it with the default
+        Material m;
+        m.name = name;
+        materials.push_back(m);
+        return materials.size() - 1;
+    };
+
+    int material = -1;
+    std::string name;
+    for (size_t x = 0; x < numChunks; x++) {
+        Chunk &c = chunks[x];
+        for (auto &run : c.runs) {
+            if (run.hasMaterial) {
+                material = materialIndex(run.material);
+            }
+            if (run.hasName) {
+                name = run.name;
+            }
+            // consecutive runs with the same material are drawn together
+            if (subMeshes.empty() || subMeshes.back().material != material || subMeshes.back().points != run.points) {
+                SubMesh sm;
+                sm.name = name;
+                sm.material = material;
+                sm.points = run.points;
+                sm.startIndex = indexes.size();
+                subMeshes.push_back(sm);
+            }
+            for (uint32_t i = run.start; i < run.start + run.count; i++) {
+                indexes.push_back(getOrAddIndex(c.corners[i], x));
+            }
+            subMeshes.back().count = indexes.size() - subMeshes.back().startIndex;
+        }
+        for (auto &l : c.lineCorners) {
+            lines.push_back(getOrAddIndex(l, x));
+        }
+        c.corners.clear();
+        c.corners.shrink_to_fit();
+    }
+    return true;
+}
+
+void xlObjMesh::Optimize(const std::string &file) {
+    static log4cpp::Category &logger_base = log4cpp::Category::getInstance(std::string("log_base"));
+    size_t numVerts = GetVertexCount();
+    if (numVerts == 0 || indexes.empty()) {
+        return;
+    }
+    // only the triangles of each submesh are reordered, within the submesh
+    auto stats = [this, numVerts]() {
+        xlMeshOptimizer::CacheStats total;
+        size_t tris = 0;
+        for (auto &sm : subMeshes) {
+            if (!sm.points && sm.count >= 3) {
+                xlMeshOptimizer::CacheStats s = xlMeshOptimizer::AnalyzeVertexCache(&indexes[sm.startIndex], sm.count, numVerts);
+                total.acmr += s.acmr * (sm.count / 3);
+                total.atvr += s.atvr * (sm.count / 3);
+                tris += sm.count / 3;
+            }
+        }
+        if (tris) {
+            total.acmr /= tris;
+            total.atvr /= tris;
+        }
+        return total;
+    };
+    xlMeshOptimizer::CacheStats before = stats();
+    for (auto &sm : subMeshes) {
+        if (!sm.points && sm.count >= 6) {
+            xlMeshOptimizer::OptimizeTriangles(&indexes[sm.startIndex], sm.count - sm.count % 3, &positions[0], 3, numVerts);
+        }
+    }
+
+    std::vector<uint32_t> remap;
+    xlMeshOptimizer::OptimizeVertexFetch(&indexes[0], indexes.size(), numVerts, remap);
+    for (auto &l : lines) {
+        l = remap[l];
+    }
+    xlMeshOptimizer::RemapVertices(positions, 3, remap);
+    xlMeshOptimizer::RemapVertices(normals, 3, remap);
+    xlMeshOptimizer::RemapVertices(texcoords, 2, remap);
+    xlMeshOptimizer::CacheStats after = stats();
+
+    logger_base.debug("Optimized mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.",
+                      file.c_str(), before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+void xlObjMesh::ParseMtl(const std::string &file) {
+    static log4cpp::Category &logger_base = log4cpp::Category::getInstance(std::string("log_base"));
+    MappedFile mapped(file);
+    if (mapped.data == nullptr) {
+        logger_base.warn("Could not read material file %s.", file.c_str());
+        return;
+    }
+    std::filesystem::path dir = std::filesystem::path(file).parent_path();
+    const char *p = mapped.data;
+    const char *end = p + mapped.length;
+    Material *cur = nullptr;
+    while (p < end) {
+        p = SkipSpace(p, end);
+        const char *eol = SkipLine(p, end);
+        size_t l = eol - p;
+        if (l > 7 && strncmp(p, "newmtl", 6) == 0 && IsSpace(p[6])) {
+            Material m;
+            m.name = ParseName(p + 7, eol);
+            materials.push_back(m);
+            cur = &materials.back();
+        } else if (cur != nullptr && l > 3 && strncmp(p, "Kd", 2) == 0 && IsSpace(p[2])) {
+            const char *q = ParseFloat(p + 3, eol, cur->diffuse[0]);
+            q = ParseFloat(q, eol, cur->diffuse[1]);
+            ParseFloat(q, eol, cur->diffuse[2]);
+        } else if (cur != nullptr && l > 2 && p[0] == 'd' && IsSpace(p[1])) {
+            ParseFloat(p + 2, eol, cur->alpha);
+        } else if (cur != nullptr && l > 3 && strncmp(p, "Tr", 2) == 0 && IsSpace(p[2])) {
+            float tr;
+            ParseFloat(p + 3, eol, tr);
+            cur->alpha = 1.0f - tr;
+        } else if (cur != nullptr && l > 7 && strncmp(p, "map_Kd", 6) == 0 && IsSpace(p[6])) {
+            // options may come first, the file name is the last token
+            std::string f = ParseName(p + 7, eol);
+            size_t sp = f.find_last_of(" \t");
+            if (sp != std::string::npos) {
+                f = f.substr(sp + 1);
+            }
+            std::replace(f.begin(), f.end(), '\\', '/');
+            cur->diffuseTexture = (dir / f).string();
+        }
+        p = eol + 1;
+    }
+}
+
+bool xlObjMesh::ReadCache(const std::string &file) {
+    std::ifstream in(CachePath(file), std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    if (!in.read(magic, 4) || memcmp(magic, CACHE_MAGIC, 4) != 0
+        || !ReadPOD(in, version) || version != CACHE_VERSION) {
+        return false;
+    }
+    // the OBJ and every MTL it used must be unchanged
+    uint32_t numDeps = 0;
+    if (!ReadPOD(in, numDeps) || numDeps == 0 || numDeps > 1024) {
+        return false;
+    }
+    for (uint32_t x = 0; x < numDeps; x++) {
+        std::string dep;
+        FileStamp stamp;
+        if (!ReadString(in, dep) || !ReadPOD(in, stamp.size) || !ReadPOD(in, stamp.time)) {
+            return false;
+        }
+        if (x == 0 && dep != file) {
+            return false;
+        }
+        FileStamp cur = GetStamp(dep);
+        if (!cur.valid || cur.size != stamp.size || cur.time != stamp.time) {
+            return false;
+        }
+        if (x > 0) {
+            mtlFiles.push_back(dep);
+        }
+    }
+
+    uint32_t numMaterials = 0;
+    if (!ReadPOD(in, numMaterials) || numMaterials > 65536) {
+        return false;
+    }
+    materials.resize(numMaterials);
+    for (auto &m : materials) {
+        if (!ReadString(in, m.name) || !ReadPOD(in, m.diffuse) || !ReadPOD(in, m.alpha) || !ReadString(in, m.diffuseTexture)) {
+            return false;
+        }
+    }
+    uint32_t numSubMeshes = 0;
+    if (!ReadPOD(in, numSubMeshes)) {
+        return false;
+    }
+    subMeshes.resize(numSubMeshes);
+    for (auto &sm : subMeshes) {
+        uint8_t points = 0;
+        if (!ReadString(in, sm.name) || !ReadPOD(in, sm.material) || !ReadPOD(in, sm.startIndex)
+            || !ReadPOD(in, sm.count) || !ReadPOD(in, points)) {
+            return false;
+        }
+        sm.points = points != 0;
+    }
+    if (!ReadVector(in, positions) || !ReadVector(in, normals) || !ReadVector(in, texcoords)
+        || !ReadVector(in, indexes) || !ReadVector(in, lines)) {
+        return false;
+    }
+    // sanity check so a damaged cache can't index outside the vertices
+    size_t numVerts = GetVertexCount();
+    if (positions.size() != numVerts * 3 || normals.size() != numVerts * 3 || texcoords.size() != numVerts * 2) {
+        return false;
+    }
+    for (auto &sm : subMeshes) {
+        if ((size_t)sm.startIndex + sm.count > indexes.size()
+            || sm.material < -1 || sm.material >= (int)materials.size()) {
+            return false;
+        }
+    }
+    for (uint32_t i : indexes) {
+        if (i >= numVerts) {
+            return false;
+        }
+    }
+    if (lines.size() % 2 != 0) {
+        return false;
+    }
+    for (uint32_t i : lines) {
+        if (i >= numVerts) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void xlObjMesh::WriteCache(const std::string &file) {
+    static log4cpp::Category &logger_base = log4cpp::Category::getInstance(std::string("log_base"));
+    std::vector<std::string> deps;
+    deps.push_back(file);
+    deps.insert(deps.end(), mtlFiles.begin(), mtlFiles.end());
+
+    // write to a temp file and rename so a concurrent load never reads a partial cache
+    std::string path = CachePath(file);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            // read only prop libraries are fine, just slower every time
+            logger_base.debug("Could not write mesh cache %s.", path.c_str());
+            return;
+        }
+        out.write(CACHE_MAGIC, 4);
+        WritePOD(out, CACHE_VERSION);
+        WritePOD(out, (uint32_t)deps.size());
+        for (auto &d : deps) {
+            FileStamp stamp = GetStamp(d);
+            WriteString(out, d);
+            WritePOD(out, stamp.size);
+            WritePOD(out, stamp.time);
+        }
+        WritePOD(out, (uint32_t)materials.size());
+        for (auto &m : materials) {
+            WriteString(out, m.name);
+            WritePOD(out, m.diffuse);
+            WritePOD(out, m.alpha);
+            WriteString(out, m.diffuseTexture);
+        }
+        WritePOD(out, (uint32_t)subMeshes.size());
+        for (auto &sm : subMeshes) {
+            WriteString(out, sm.name);
+            WritePOD(out, sm.material);
+            WritePOD(out, sm.startIndex);
+            WritePOD(out, sm.count);
+            WritePOD(out, (uint8_t)(sm.points ? 1 : 0));
+        }
+        WriteVector(out, positions);
+        WriteVector(out, normals);
+        WriteVector(out, texcoords);
+        WriteVector(out, indexes);
+        WriteVector(out, lines);
+        if (!out.good()) {
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            logger_base.warn("Could not write mesh cache %s.", path.c_str());
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ (and MTL) loading for xlMesh.
+//
+// The file is memory mapped and split into line aligned chunks that are parsed
+// in parallel.  The chunks are then merged in order: position/normal/uv index
+// tuples are deduplicated into a single indexed vertex list, which is then
+// reordered for the GPU vertex cache and fetch (xlMeshOptimizer).
+// The result is also written as a binary cache next to the source file
+// ("<file>.xlmesh") that later loads read directly while the OBJ and its MTL
+// files are unchanged.
+class xlObjMesh {
+public:
+    struct Material {
+        std::string name;
+        float diffuse[3] = { 1.0f, 1.0f, 1.0f };
+        float alpha = 1.0f;
+        std::string diffuseTexture; // full path, empty if none
+    };
+    struct SubMesh {
+        std::string name;
+        int material = -1;      // index into materials, -1 for none
+        uint32_t startIndex = 0;
+        uint32_t count = 0;
+        bool points = false;    // GL_POINTS instead of GL_TRIANGLES
+    };
+
+    // one entry per unique vertex
+    std::vector<float> positions; // xyz
+    std::vector<float> normals;   // xyz, zero if the OBJ had none
+    std::vector<float> texcoords; // uv, zero if the OBJ had none
+
+    std::vector<uint32_t> indexes; // triangles and points, see subMeshes
+    std::vector<uint32_t> lines;   // GL_LINES pairs
+    std::vector<SubMesh> subMeshes;
+    std::vector<Material> materials;
+
+    size_t GetVertexCount() const { return positions.size() / 3; }
+    void Clear();
+
+    // Loads file, from the cache if it is current.  Returns false if the file
+    // could not be read.
+    bool Load(const std::string &file, bool useCache = true);
+
+    // how the last Load went, for logging
+    bool LoadedFromCache() const { return fromCache; }
+
+private:
+    bool ParseObj(const std::string &file, const char *data, size_t len);
+    // vertex cache, overdraw and vertex fetch ordering, see xlMeshOptimizer
+    void Optimize(const std::string &file);
+    void ParseMtl(const std::string &file);
+    bool ReadCache(const std::string &file);
+    void WriteCache(const std::string &file);
+
+    // MTL files referenced by the OBJ, checked when validating the cache
+    std::vector<std::string> mtlFiles;
+    bool fromCache = false;
+};
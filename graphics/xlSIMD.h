@@ -0,0 +1,236 @@
+#pragma once
+
+// Small SIMD kernels for the hot matrix paths.  SSE on x86, NEON on ARM, and a
+// plain scalar version otherwise.  Matrices are 16 floats in column major order,
+// the same layout as glm::mat4 and OpenGL.
+
+#include <cmath>
+#include <stdint.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define XL_SIMD_SSE 1
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XL_SIMD_SSE2 1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define XL_SIMD_NEON 1
+#endif
+
+namespace xlSIMD
+{
+    // Four lane float vector used to process four objects at a time
+#if defined(XL_SIMD_SSE)
+    typedef __m128 float4;
+    inline float4 Load4(const float *p) { return _mm_loadu_ps(p); }
+    inline void Store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+    inline float4 Set4(float f) { return _mm_set1_ps(f); }
+    inline float4 Add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+    inline float4 Sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+    inline float4 Mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+    inline float4 Div(float4 a, float4 b) { return _mm_div_ps(a, b); }
+    inline float4 Sqrt(float4 a) { return _mm_sqrt_ps(a); }
+    // a with its sign flipped where b is negative
+    inline float4 FlipSign(float4 a, float4 b) { return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.0f))); }
+    inline void Transpose4(float4 &a, float4 &b, float4 &c, float4 &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+#elif defined(XL_SIMD_NEON)
+    typedef float32x4_t float4;
+    inline float4 Load4(const float *p) { return vld1q_f32(p); }
+    inline void Store4(float *p, float4 v) { vst1q_f32(p, v); }
+    inline float4 Set4(float f) { return vdupq_n_f32(f); }
+    inline float4 Add(float4 a, float4 b) { return vaddq_f32(a, b); }
+    inline float4 Sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+    inline float4 Mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+    inline float4 Div(float4 a, float4 b) {
+#if defined(__aarch64__)
+        return vdivq_f32(a, b);
+#else
+        // estimate plus two Newton-Raphson steps
+        float32x4_t r = vrecpeq_f32(b);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+#endif
+    }
+    inline float4 Sqrt(float4 a) {
+#if defined(__aarch64__)
+        return vsqrtq_f32(a);
+#else
+        float r[4];
+        vst1q_f32(r, a);
+        for (int x = 0; x < 4; x++) r[x] = sqrtf(r[x]);
+        return vld1q_f32(r);
+#endif
+    }
+    inline float4 FlipSign(float4 a, float4 b) {
+        uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(b), vdupq_n_u32(0x80000000));
+        return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), sign));
+    }
+    inline void Transpose4(float4 &a, float4 &b, float4 &c, float4 &d) {
+        float32x4x2_t ab = vtrnq_f32(a, b);
+        float32x4x2_t cd = vtrnq_f32(c, d);
+        a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+        b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+        c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+        d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+#else
+    struct float4 {
+        float v[4];
+    };
+    inline float4 Load4(const float *p) { return { { p[0], p[1], p[2], p[3] } }; }
+    inline void Store4(float *p, float4 v) { for (int x = 0; x < 4; x++) p[x] = v.v[x]; }
+    inline float4 Set4(float f) { return { { f, f, f, f } }; }
+    inline float4 Add(float4 a, float4 b) { for (int x = 0; x < 4; x++) a.v[x] += b.v[x]; return a; }
+    inline float4 Sub(float4 a, float4 b) { for (int x = 0; x < 4; x++) a.v[x] -= b.v[x]; return a; }
+    inline float4 Mul(float4 a, float4 b) { for (int x = 0; x < 4; x++) a.v[x] *= b.v[x]; return a; }
+    inline float4 Div(float4 a, float4 b) { for (int x = 0; x < 4; x++) a.v[x] /= b.v[x]; return a; }
+    inline float4 Sqrt(float4 a) { for (int x = 0; x < 4; x++) a.v[x] = sqrtf(a.v[x]); return a; }
+    inline float4 FlipSign(float4 a, float4 b) { for (int x = 0; x < 4; x++) if (std::signbit(b.v[x])) a.v[x] = -a.v[x]; return a; }
+    inline void Transpose4(float4 &a, float4 &b, float4 &c, float4 &d) {
+        float4 r[4] = { a, b, c, d };
+        a = { { r[0].v[0], r[1].v[0], r[2].v[0], r[3].v[0] } };
+        b = { { r[0].v[1], r[1].v[1], r[2].v[1], r[3].v[1] } };
+        c = { { r[0].v[2], r[1].v[2], r[2].v[2], r[3].v[2] } };
+        d = { { r[0].v[3], r[1].v[3], r[2].v[3], r[3].v[3] } };
+    }
+#endif
+
+    // out = a * b, out may be the same as a or b
+    inline void MultiplyMat4(const float *a, const float *b, float *out) {
+#if defined(XL_SIMD_SSE)
+        __m128 a0 = _mm_loadu_ps(a);
+        __m128 a1 = _mm_loadu_ps(a + 4);
+        __m128 a2 = _mm_loadu_ps(a + 8);
+        __m128 a3 = _mm_loadu_ps(a + 12);
+        __m128 r[4];
+        for (int c = 0; c < 4; c++) {
+            const float *bc = b + c * 4;
+            __m128 v = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+            v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+            v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+            v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+            r[c] = v;
+        }
+        for (int c = 0; c < 4; c++) {
+            _mm_storeu_ps(out + c * 4, r[c]);
+        }
+#elif defined(XL_SIMD_NEON)
+        float32x4_t a0 = vld1q_f32(a);
+        float32x4_t a1 = vld1q_f32(a + 4);
+        float32x4_t a2 = vld1q_f32(a + 8);
+        float32x4_t a3 = vld1q_f32(a + 12);
+        float32x4_t r[4];
+        for (int c = 0; c < 4; c++) {
+            float32x4_t bc = vld1q_f32(b + c * 4);
+            float32x4_t v = vmulq_lane_f32(a0, vget_low_f32(bc), 0);
+            v = vmlaq_lane_f32(v, a1, vget_low_f32(bc), 1);
+            v = vmlaq_lane_f32(v, a2, vget_high_f32(bc), 0);
+            v = vmlaq_lane_f32(v, a3, vget_high_f32(bc), 1);
+            r[c] = v;
+        }
+        for (int c = 0; c < 4; c++) {
+            vst1q_f32(out + c * 4, r[c]);
+        }
+#else
+        float r[16];
+        for (int c = 0; c < 4; c++) {
+            for (int row = 0; row < 4; row++) {
+                r[c * 4 + row] = a[row] * b[c * 4]
+                    + a[4 + row] * b[c * 4 + 1]
+                    + a[8 + row] * b[c * 4 + 2]
+                    + a[12 + row] * b[c * 4 + 3];
+            }
+        }
+        for (int x = 0; x < 16; x++) {
+            out[x] = r[x];
+        }
+#endif
+    }
+
+    // m = m * translate(x, y, z), only the last column changes
+    inline void TranslateMat4(float *m, float x, float y, float z) {
+#if defined(XL_SIMD_SSE)
+        __m128 v = _mm_loadu_ps(m + 12);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(x)));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(y)));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(z)));
+        _mm_storeu_ps(m + 12, v);
+#elif defined(XL_SIMD_NEON)
+        float32x4_t v = vld1q_f32(m + 12);
+        v = vmlaq_n_f32(v, vld1q_f32(m), x);
+        v = vmlaq_n_f32(v, vld1q_f32(m + 4), y);
+        v = vmlaq_n_f32(v, vld1q_f32(m + 8), z);
+        vst1q_f32(m + 12, v);
+#else
+        for (int row = 0; row < 4; row++) {
+            m[12 + row] += m[row] * x + m[4 + row] * y + m[8 + row] * z;
+        }
+#endif
+    }
+
+    // m = m * scale(x, y, z), scales the first three columns
+    inline void ScaleMat4(float *m, float x, float y, float z) {
+#if defined(XL_SIMD_SSE)
+        _mm_storeu_ps(m, _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(x)));
+        _mm_storeu_ps(m + 4, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(y)));
+        _mm_storeu_ps(m + 8, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(z)));
+#elif defined(XL_SIMD_NEON)
+        vst1q_f32(m, vmulq_n_f32(vld1q_f32(m), x));
+        vst1q_f32(m + 4, vmulq_n_f32(vld1q_f32(m + 4), y));
+        vst1q_f32(m + 8, vmulq_n_f32(vld1q_f32(m + 8), z));
+#else
+        for (int row = 0; row < 4; row++) {
+            m[row] *= x;
+            m[4 + row] *= y;
+            m[8 + row] *= z;
+        }
+#endif
+    }
+
+    // Writes first + i for each of the count colors that is neither black nor
+    // fully transparent, colors packed as by xlColor::GetRGBA().  Returns the
+    // number of indexes written
+    inline uint32_t CompactVisible(const uint32_t *colors, uint32_t count, uint32_t first, uint32_t *indexes) {
+        uint32_t n = 0;
+        uint32_t i = 0;
+#if defined(XL_SIMD_SSE2)
+        const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 4 <= count; i += 4) {
+            __m128i c = _mm_loadu_si128((const __m128i*)(colors + i));
+            __m128i hidden = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(c, rgb), zero),
+                                          _mm_cmpeq_epi32(_mm_and_si128(c, alpha), zero));
+            int visible = ~_mm_movemask_ps(_mm_castsi128_ps(hidden)) & 0xF;
+            for (uint32_t b = 0; visible; b++, visible >>= 1) {
+                if (visible & 1) {
+                    indexes[n++] = first + i + b;
+                }
+            }
+        }
+#elif defined(XL_SIMD_NEON)
+        const uint32x4_t rgb = vdupq_n_u32(0x00FFFFFF);
+        const uint32x4_t alpha = vdupq_n_u32(0xFF000000);
+        const uint32x4_t zero = vdupq_n_u32(0);
+        uint32_t hidden[4];
+        for (; i + 4 <= count; i += 4) {
+            uint32x4_t c = vld1q_u32(colors + i);
+            vst1q_u32(hidden, vorrq_u32(vceqq_u32(vandq_u32(c, rgb), zero), vceqq_u32(vandq_u32(c, alpha), zero)));
+            for (uint32_t b = 0; b < 4; b++) {
+                if (!hidden[b]) {
+                    indexes[n++] = first + i + b;
+                }
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            if ((colors[i] & 0x00FFFFFF) && (colors[i] & 0xFF000000)) {
+                indexes[n++] = first + i;
+            }
+        }
+        return n;
+    }
+}
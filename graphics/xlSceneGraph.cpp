@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "xlSceneGraph.h"
+#include "xlTransformBatch.h"
+
+// Leaves hold at most this many objects
+static const int MAX_LEAF_SIZE = 4;
+// Bins used to evaluate the SAH splits
+static const int SAH_BINS = 12;
+// Rebuild instead of refit once the tree got this much worse than when built
+static const float REBUILD_RATIO = 1.5f;
+// Below this many objects culling on one thread is faster than waking more
+static const size_t PARALLEL_CULL_MIN = 4096;
+
+// ----------------------------------------------------------------------------
+// Threads kept waiting between frames so a cull doesn't pay for starting and
+// joining a thread per subtree every time it runs
+// ----------------------------------------------------------------------------
+class CullWorkers
+{
+public:
+    static CullWorkers& Get()
+    {
+        static CullWorkers workers;
+        return workers;
+    }
+
+    unsigned int GetThreadCount() const { return (unsigned int)_threads.size() + 1; }
+
+    // Calls job(0) .. job(count - 1) spread over the workers and the calling
+    // thread, returns once all are done
+    void Run(size_t count, const std::function<void(size_t)>& job)
+    {
+        std::lock_guard<std::mutex> running(_runLock);
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _job = &job;
+            _count = count;
+            _next = 0;
+            _busy = _threads.size();
+            ++_generation;
+        }
+        _wake.notify_all();
+        Work(job, count);
+
+        std::unique_lock<std::mutex> lock(_lock);
+        _done.wait(lock, [this]() { return _busy == 0; });
+        _job = nullptr;
+    }
+
+private:
+    CullWorkers()
+    {
+        unsigned int threads = std::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < threads; ++i)
+            _threads.emplace_back([this]() { Loop(); });
+    }
+
+    ~CullWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& t : _threads)
+            t.join();
+    }
+
+    void Work(const std::function<void(size_t)>& job, size_t count)
+    {
+        for (size_t i = _next++; i < count; i = _next++)
+            job(i);
+    }
+
+    void Loop()
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            const std::function<void(size_t)>* job;
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+                if ( _stop )
+                    return;
+                seen = _generation;
+                job = _job;
+                count = _count;
+            }
+            Work(*job, count);
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+                --_busy;
+            }
+            _done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> _threads;
+    std::mutex _runLock;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(size_t)>* _job = nullptr;
+    size_t _count = 0;
+    std::atomic<size_t> _next{ 0 };
+    size_t _busy = 0;
+    unsigned int _generation = 0;
+    bool _stop = false;
+};
+
+// ----------------------------------------------------------------------------
+// xlBounds
+// ----------------------------------------------------------------------------
+xlBounds::xlBounds()
+    : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+{
+}
+
+xlBounds xlBounds::FromPoints(const float* xyz, size_t count)
+{
+    xlBounds b;
+    for (size_t i = 0; i < count; ++i, xyz += 3)
+        b.Grow(glm::vec3(xyz[0], xyz[1], xyz[2]));
+    return b;
+}
+
+void xlBounds::Grow(const glm::vec3& p)
+{
+    min.x = std::min(min.x, p.x);
+    min.y = std::min(min.y, p.y);
+    min.z = std::min(min.z, p.z);
+    max.x = std::max(max.x, p.x);
+    max.y = std::max(max.y, p.y);
+    max.z = std::max(max.z, p.z);
+}
+
+void xlBounds::Grow(const xlBounds& b)
+{
+    if ( b.IsEmpty() )
+        return;
+    Grow(b.min);
+    Grow(b.max);
+}
+
+float xlBounds::SurfaceArea() const
+{
+    if ( IsEmpty() )
+        return 0.0f;
+    glm::vec3 d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+xlBounds xlBounds::Transformed(const float* m) const
+{
+    if ( IsEmpty() )
+        return *this;
+
+    // Transform the center, the extent grows by the absolute value of the
+    // rotation/scale part (Arvo)
+    glm::vec3 c = Center();
+    glm::vec3 e = max - c;
+    glm::vec3 nc, ne;
+    for (int row = 0; row < 3; ++row)
+    {
+        nc[row] = m[row] * c.x + m[4 + row] * c.y + m[8 + row] * c.z + m[12 + row];
+        ne[row] = std::fabs(m[row]) * e.x + std::fabs(m[4 + row]) * e.y + std::fabs(m[8 + row]) * e.z;
+    }
+    return xlBounds(nc - ne, nc + ne);
+}
+
+// ----------------------------------------------------------------------------
+// xlFrustum
+// ----------------------------------------------------------------------------
+xlFrustum::xlFrustum(const glm::mat4& m)
+{
+    // Gribb/Hartmann: the planes are sums and differences of the matrix rows
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+    _planes[0] = rows[3] + rows[0]; // left
+    _planes[1] = rows[3] - rows[0]; // right
+    _planes[2] = rows[3] + rows[1]; // bottom
+    _planes[3] = rows[3] - rows[1]; // top
+    _planes[4] = rows[3] + rows[2]; // near
+    _planes[5] = rows[3] - rows[2]; // far
+}
+
+int xlFrustum::Test(const xlBounds& b, unsigned int& mask) const
+{
+    unsigned int straddled = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        if ( !(mask & (1u << i)) )
+            continue;
+        const glm::vec4& p = _planes[i];
+        // The corner furthest along the normal, and the one furthest against it
+        glm::vec3 pos(p.x >= 0 ? b.max.x : b.min.x, p.y >= 0 ? b.max.y : b.min.y, p.z >= 0 ? b.max.z : b.min.z);
+        glm::vec3 neg(p.x >= 0 ? b.min.x : b.max.x, p.y >= 0 ? b.min.y : b.max.y, p.z >= 0 ? b.min.z : b.max.z);
+        if ( p.x * pos.x + p.y * pos.y + p.z * pos.z + p.w < 0.0f )
+            return 0;
+        if ( p.x * neg.x + p.y * neg.y + p.z * neg.z + p.w < 0.0f )
+            straddled |= 1u << i;
+    }
+    mask = straddled;
+    return straddled ? 1 : 2;
+}
+
+// ----------------------------------------------------------------------------
+// xlSceneGraph
+// ----------------------------------------------------------------------------
+xlSceneGraph::xlSceneGraph()
+    : _needsBuild(true), _builtCost(0.0f)
+{
+}
+
+void xlSceneGraph::Clear()
+{
+    _local.clear();
+    _world.clear();
+    _order.clear();
+    _nodes.clear();
+    _needsBuild = true;
+}
+
+int xlSceneGraph::AddObject(const xlBounds& localBounds)
+{
+    _local.push_back(localBounds);
+    _world.push_back(localBounds);
+    _needsBuild = true;
+    return (int)_local.size() - 1;
+}
+
+void xlSceneGraph::UpdateTransforms(const xlTransformBatch& transforms)
+{
+    size_t n = std::min(_local.size(), transforms.Size());
+    for (size_t i = 0; i < n; ++i)
+        _world[i] = _local[i].Transformed(transforms.GetObjectData(i));
+
+    if ( _needsBuild )
+    {
+        Build();
+        return;
+    }
+    Refit();
+    // Moving objects make the boxes of the old partition overlap more and more
+    if ( Cost() > _builtCost * REBUILD_RATIO )
+        Build();
+}
+
+void xlSceneGraph::Build()
+{
+    _order.resize(_local.size());
+    for (size_t i = 0; i < _order.size(); ++i)
+        _order[i] = (int)i;
+
+    _nodes.clear();
+    _nodes.reserve(_local.size() * 2);
+    if ( !_order.empty() )
+    {
+        _nodes.push_back(Node());
+        BuildRange(0, 0, (int)_order.size(), 0);
+    }
+    _builtCost = Cost();
+    _needsBuild = false;
+}
+
+// Fills in node nodeIdx for the objects _order[begin, end)
+void xlSceneGraph::BuildRange(int nodeIdx, int begin, int end, int depth)
+{
+    int count = end - begin;
+
+    xlBounds bounds, centers;
+    for (int i = begin; i < end; ++i)
+    {
+        bounds.Grow(_world[_order[i]]);
+        centers.Grow(_world[_order[i]].Center());
+    }
+    _nodes[nodeIdx].bounds = bounds;
+    _nodes[nodeIdx].first = begin;
+    _nodes[nodeIdx].count = count;
+
+    if ( count <= 2 || depth >= 64 )
+        return;
+
+    // Split along the axis the centers are spread most
+    glm::vec3 extent = centers.max - centers.min;
+    int axis = 0;
+    if ( extent.y > extent[axis] ) axis = 1;
+    if ( extent.z > extent[axis] ) axis = 2;
+
+    int mid = begin;
+    if ( extent[axis] <= 0.0f )
+    {
+        // All centers at the same place, there is nothing to gain from SAH
+        if ( count <= MAX_LEAF_SIZE )
+            return;
+        mid = begin + count / 2;
+    }
+    else
+    {
+        struct Bin { xlBounds bounds; int count = 0; } bins[SAH_BINS];
+        float scale = SAH_BINS / extent[axis];
+        auto binOf = [&](int obj) {
+            int b = (int)((_world[obj].Center()[axis] - centers.min[axis]) * scale);
+            return std::min(b, SAH_BINS - 1);
+        };
+        for (int i = begin; i < end; ++i)
+        {
+            Bin& b = bins[binOf(_order[i])];
+            b.bounds.Grow(_world[_order[i]]);
+            b.count++;
+        }
+
+        // Sweep from the right, then from the left to find the cheapest plane
+        float rightArea[SAH_BINS];
+        int rightCount[SAH_BINS];
+        xlBounds acc;
+        int n = 0;
+        for (int b = SAH_BINS - 1; b > 0; --b)
+        {
+            acc.Grow(bins[b].bounds);
+            n += bins[b].count;
+            rightArea[b] = acc.SurfaceArea();
+            rightCount[b] = n;
+        }
+        float bestCost = FLT_MAX;
+        int bestSplit = -1;
+        acc = xlBounds();
+        n = 0;
+        for (int b = 0; b < SAH_BINS - 1; ++b)
+        {
+            acc.Grow(bins[b].bounds);
+            n += bins[b].count;
+            if ( n == 0 || rightCount[b + 1] == 0 )
+                continue;
+            float cost = acc.SurfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+            if ( cost < bestCost )
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        float area = bounds.SurfaceArea();
+        float leafCost = (float)count;
+        float splitCost = area > 0.0f ? 1.0f + bestCost / area : 1.0f;
+        if ( bestSplit < 0 || (count <= MAX_LEAF_SIZE && leafCost <= splitCost) )
+        {
+            if ( count <= MAX_LEAF_SIZE )
+                return;
+            mid = begin + count / 2;
+            std::nth_element(_order.begin() + begin, _order.begin() + mid, _order.begin() + end,
+                             [&](int a, int b) { return _world[a].Center()[axis] < _world[b].Center()[axis]; });
+        }
+        else
+        {
+            mid = (int)(std::partition(_order.begin() + begin, _order.begin() + end,
+                                       [&](int obj) { return binOf(obj) <= bestSplit; }) - _order.begin());
+        }
+    }
+
+    int left = (int)_nodes.size();
+    _nodes[nodeIdx].first = left;
+    _nodes[nodeIdx].count = 0;
+
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+    BuildRange(left, begin, mid, depth + 1);
+    BuildRange(left + 1, mid, end, depth + 1);
+}
+
+void xlSceneGraph::Refit()
+{
+    // Children always come after their parent, so one backwards pass suffices
+    for (int i = (int)_nodes.size() - 1; i >= 0; --i)
+    {
+        Node& node = _nodes[i];
+        xlBounds b;
+        if ( node.count > 0 )
+        {
+            for (int o = node.first; o < node.first + node.count; ++o)
+                b.Grow(_world[_order[o]]);
+        }
+        else
+        {
+            b = _nodes[node.first].bounds;
+            b.Grow(_nodes[node.first + 1].bounds);
+        }
+        node.bounds = b;
+    }
+}
+
+float xlSceneGraph::Cost() const
+{
+    if ( _nodes.empty() )
+        return 0.0f;
+    float rootArea = _nodes[0].bounds.SurfaceArea();
+    if ( rootArea <= 0.0f )
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (const Node& node : _nodes)
+        cost += node.bounds.SurfaceArea() * (node.count > 0 ? node.count : 1);
+    return cost / rootArea;
+}
+
+void xlSceneGraph::CullNode(const xlFrustum& frustum, int node, unsigned int mask,
+                            std::vector<unsigned int>& visible) const
+{
+    int stack[128];
+    unsigned int masks[128];
+    int top = 0;
+    stack[top] = node;
+    masks[top++] = mask;
+
+    while ( top > 0 )
+    {
+        --top;
+        const Node& n = _nodes[stack[top]];
+        unsigned int m = masks[top];
+        if ( m && frustum.Test(n.bounds, m) == 0 )
+            continue;
+
+        if ( n.count > 0 )
+        {
+            for (int o = n.first; o < n.first + n.count; ++o)
+            {
+                // Objects of a leaf only partly in view get their own test
+                unsigned int om = m;
+                if ( n.count == 1 || !om || frustum.Test(_world[_order[o]], om) != 0 )
+                    visible.push_back(_order[o]);
+            }
+        }
+        else
+        {
+            stack[top] = n.first;
+            masks[top++] = m;
+            stack[top] = n.first + 1;
+            masks[top++] = m;
+        }
+    }
+}
+
+void xlSceneGraph::Cull(const xlFrustum& frustum, std::vector<unsigned int>& visible) const
+{
+    visible.clear();
+    if ( _nodes.empty() )
+        return;
+
+    const unsigned int allPlanes = 0x3F;
+    if ( _local.size() < PARALLEL_CULL_MIN || CullWorkers::Get().GetThreadCount() < 2 )
+    {
+        CullNode(frustum, 0, allPlanes, visible);
+    }
+    else
+    {
+        // Open the top of the tree until there is a subtree per thread, then
+        // walk the subtrees in parallel
+        unsigned int threads = CullWorkers::Get().GetThreadCount();
+        std::vector<std::pair<int, unsigned int>> roots(1, std::make_pair(0, allPlanes));
+        while ( roots.size() < threads )
+        {
+            bool opened = false;
+            std::vector<std::pair<int, unsigned int>> next;
+            for (auto& r : roots)
+            {
+                const Node& n = _nodes[r.first];
+                unsigned int m = r.second;
+                if ( m && frustum.Test(n.bounds, m) == 0 )
+                    continue;
+                if ( n.count > 0 )
+                {
+                    next.push_back(std::make_pair(r.first, m));
+                    continue;
+                }
+                next.push_back(std::make_pair(n.first, m));
+                next.push_back(std::make_pair(n.first + 1, m));
+                opened = true;
+            }
+            roots.swap(next);
+            if ( !opened )
+                break;
+        }
+
+        std::vector<std::vector<unsigned int>> results(roots.size());
+        CullWorkers::Get().Run(roots.size(), [&](size_t i) {
+            CullNode(frustum, roots[i].first, roots[i].second, results[i]);
+        });
+
+        for (auto& r : results)
+            visible.insert(visible.end(), r.begin(), r.end());
+    }
+    // Objects are grouped by mesh in the batch, keep that order for drawing
+    std::sort(visible.begin(), visible.end());
+}
@@ -0,0 +1,96 @@
+#ifndef XLSCENEGRAPH_H
+#define XLSCENEGRAPH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class xlTransformBatch;
+
+//-----------------------------------------------------------------------------
+// Axis aligned box
+struct xlBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    xlBounds();
+    xlBounds(const glm::vec3& mn, const glm::vec3& mx) : min(mn), max(mx) {}
+
+    // Bounds of 'count' points stored as consecutive xyz floats
+    static xlBounds FromPoints(const float* xyz, size_t count);
+
+    bool IsEmpty() const { return min.x > max.x; }
+    void Grow(const glm::vec3& p);
+    void Grow(const xlBounds& b);
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    float SurfaceArea() const;
+    // Bounds of this box after the column major matrix m (as packed by xlTransformBatch)
+    xlBounds Transformed(const float* m) const;
+};
+
+//-----------------------------------------------------------------------------
+// The six planes of a view frustum, normals pointing inside
+class xlFrustum
+{
+public:
+    // Planes from projection * view
+    explicit xlFrustum(const glm::mat4& viewProjection);
+
+    // 0 = outside, 1 = intersecting, 2 = fully inside.  Planes whose bit is not
+    // set in 'mask' are skipped, on return 'mask' has only the planes the box
+    // straddles so children can skip the others.
+    int Test(const xlBounds& b, unsigned int& mask) const;
+
+private:
+    glm::vec4 _planes[6];
+};
+
+//-----------------------------------------------------------------------------
+// The objects of the 3D view.  Each object has bounds in its own space and a
+// slot in a xlTransformBatch that places it in the world.  World bounds are kept
+// in a BVH built with the surface area heuristic.  When objects move the BVH is
+// refitted, and rebuilt only once refitting has made it noticeably worse.
+class xlSceneGraph
+{
+public:
+    xlSceneGraph();
+
+    void Clear();
+    // Returns the index of the new object, the same as its slot in the batch
+    int AddObject(const xlBounds& localBounds);
+    size_t Size() const { return _local.size(); }
+
+    // Update the world bounds from the current (computed) transforms
+    void UpdateTransforms(const xlTransformBatch& transforms);
+
+    // Indices of the objects intersecting the frustum, in increasing order
+    void Cull(const xlFrustum& frustum, std::vector<unsigned int>& visible) const;
+
+    const xlBounds& GetWorldBounds(int idx) const { return _world[idx]; }
+
+private:
+    struct Node
+    {
+        xlBounds bounds;
+        int first; // leaf: first object in _order, inner: index of the left child (right is first + 1)
+        int count; // objects in the leaf, 0 for inner nodes
+    };
+
+    void Build();
+    void BuildRange(int nodeIdx, int begin, int end, int depth);
+    void Refit();
+    float Cost() const;
+    void CullNode(const xlFrustum& frustum, int node, unsigned int mask,
+                  std::vector<unsigned int>& visible) const;
+
+    std::vector<xlBounds> _local;
+    std::vector<xlBounds> _world;
+    std::vector<int>      _order; // object indices, leaves reference ranges of it
+    std::vector<Node>     _nodes;
+
+    bool  _needsBuild;
+    float _builtCost; // SAH cost right after the last build
+};
+
+#endif // XLSCENEGRAPH_H
@@ -0,0 +1,226 @@
+#include "xlShaderCache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <log4cpp/Category.hh>
+
+int xlShaderCache::hits = 0;
+int xlShaderCache::misses = 0;
+
+namespace {
+    // bump if the file layout changes
+    static const uint32_t CACHE_VERSION = 1;
+    static const char CACHE_MAGIC[4] = { 'X', 'L', 'P', 'B' };
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // 64 bit FNV-1a
+    static uint64_t HashBytes(uint64_t h, const void *data, size_t len) {
+        const uint8_t *p = (const uint8_t*)data;
+        for (size_t x = 0; x < len; x++) {
+            h ^= p[x];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+    static uint64_t HashString(uint64_t h, const std::string &s) {
+        h = HashBytes(h, s.c_str(), s.size());
+        // separator so {"ab","c"} and {"a","bc"} differ
+        uint8_t zero = 0;
+        return HashBytes(h, &zero, 1);
+    }
+    static std::string GetGLString(GLenum e) {
+        const GLubyte *s = glGetString(e);
+        return s == nullptr ? std::string() : std::string((const char*)s);
+    }
+    static void ClearGLErrors() {
+        while (glGetError() != GL_NO_ERROR) {}
+    }
+}
+
+bool xlShaderCache::IsAvailable() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    // some drivers (macOS) expose the entry points but no formats
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    ClearGLErrors();
+    return formats > 0;
+}
+
+std::string xlShaderCache::MakeKey(const std::vector<std::string> &parts) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = HashString(h, GetGLString(GL_VENDOR));
+    h = HashString(h, GetGLString(GL_RENDERER));
+    h = HashString(h, GetGLString(GL_VERSION));
+    for (auto &p : parts) {
+        h = HashString(h, p);
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+std::string xlShaderCache::GetCacheDirectory() {
+    static std::string dir;
+    if (!dir.empty()) {
+        return dir;
+    }
+    std::filesystem::path base;
+#if defined(_WIN32)
+    if (const char *d = getenv("LOCALAPPDATA")) {
+        base = d;
+    }
+#elif defined(__APPLE__)
+    if (const char *d = getenv("HOME")) {
+        base = std::filesystem::path(d) / "Library" / "Caches";
+    }
+#else
+    if (const char *d = getenv("XDG_CACHE_HOME")) {
+        base = d;
+    } else if (const char *d = getenv("HOME")) {
+        base = std::filesystem::path(d) / ".cache";
+    }
+#endif
+    if (base.empty()) {
+        base = std::filesystem::temp_directory_path();
+    }
+    base /= "wxgl";
+    base /= "shaders";
+
+    std::error_code ec;
+    std::filesystem::create_directories(base, ec);
+    if (ec) {
+        static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+        logger_opengl.warn("Could not create shader cache directory %s: %s", base.string().c_str(), ec.message().c_str());
+    }
+    dir = base.string();
+    return dir;
+}
+
+std::string xlShaderCache::GetEntryPath(const std::string &key) {
+    return (std::filesystem::path(GetCacheDirectory()) / (key + ".bin")).string();
+}
+
+GLuint xlShaderCache::Load(const std::string &key) {
+    if (!IsAvailable()) {
+        return 0;
+    }
+    std::string path = GetEntryPath(key);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        misses++;
+        return 0;
+    }
+
+    CacheHeader header;
+    std::vector<char> data;
+    if (in.read((char*)&header, sizeof(header))
+        && memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+        && header.version == CACHE_VERSION
+        && header.length > 0) {
+        data.resize(header.length);
+        if (!in.read(&data[0], header.length)) {
+            data.clear();
+        }
+    }
+    in.close();
+
+    GLuint program = 0;
+    if (!data.empty()) {
+        ClearGLErrors();
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, &data[0], header.length);
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        // an unknown format is reported as GL_INVALID_ENUM rather than a link failure
+        if (glGetError() != GL_NO_ERROR || status != GL_TRUE) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (program == 0) {
+        // stale (driver changed the format) or corrupt, recompile and replace it
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        misses++;
+        return 0;
+    }
+    hits++;
+    return program;
+}
+
+void xlShaderCache::PrepareForLink(GLuint program) {
+    if (IsAvailable()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        ClearGLErrors();
+    }
+}
+
+void xlShaderCache::Store(const std::string &key, GLuint program) {
+    static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+    if (program == 0 || !IsAvailable()) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        ClearGLErrors();
+        return;
+    }
+    std::vector<char> data(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, &data[0]);
+    if (glGetError() != GL_NO_ERROR || written <= 0) {
+        return;
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.format = format;
+    header.length = written;
+
+    // write to a temp file and rename so a concurrent start never reads a partial entry
+    std::string path = GetEntryPath(key);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            logger_opengl.warn("Could not write shader cache entry %s", tmp.c_str());
+            return;
+        }
+        out.write((const char*)&header, sizeof(header));
+        out.write(&data[0], written);
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+    }
+}
+
+std::string xlShaderCache::GetStatistics() {
+    int total = hits + misses;
+    int rate = total == 0 ? 0 : (hits * 100) / total;
+    return "Shader cache: " + std::to_string(hits) + " hits, " + std::to_string(misses)
+        + " misses (" + std::to_string(rate) + "% hit rate)";
+}
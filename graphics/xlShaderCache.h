@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// On-disk cache of linked GL program binaries (glGetProgramBinary/glProgramBinary).
+// Entries are keyed by a hash of everything that affects the linked result: the
+// shader sources, the attribute bindings and the GL_VENDOR/GL_RENDERER/GL_VERSION
+// strings.  A driver update or an edited shader simply misses and the caller
+// compiles from source as before, then stores the new binary.
+class xlShaderCache {
+public:
+    // Build a key from the sources and any other inputs (attribute names, defines)
+    // that change the program.  The driver strings of the current context are added.
+    static std::string MakeKey(const std::vector<std::string> &parts);
+
+    // Returns a linked program created from the cached binary, or 0 if there is
+    // no usable entry.  Entries the driver rejects are removed.
+    static GLuint Load(const std::string &key);
+
+    // Call after attaching the shaders but before glLinkProgram so the driver
+    // keeps the binary retrievable.
+    static void PrepareForLink(GLuint program);
+
+    // Save the binary of a successfully linked program
+    static void Store(const std::string &key, GLuint program);
+
+    static bool IsAvailable();
+    static int GetHits() { return hits; }
+    static int GetMisses() { return misses; }
+    static std::string GetStatistics();
+
+private:
+    static std::string GetCacheDirectory();
+    static std::string GetEntryPath(const std::string &key);
+
+    static int hits;
+    static int misses;
+};
@@ -0,0 +1,211 @@
+#include <cmath>
+
+#include "xlTransformBatch.h"
+#include "xlSIMD.h"
+#include "ogl_error.h"
+
+using namespace xlSIMD;
+
+xlTransformBatch::xlTransformBatch()
+    : _count(0), _padded(0), _buffer(0), _texture(0), _gpuCapacity(0)
+{
+}
+
+xlTransformBatch::~xlTransformBatch()
+{
+    if ( _texture )
+        glDeleteTextures(1, &_texture);
+    if ( _buffer )
+        glDeleteBuffers(1, &_buffer);
+}
+
+void xlTransformBatch::Clear()
+{
+    Resize(0);
+}
+
+void xlTransformBatch::Resize(size_t count)
+{
+    size_t padded = (count + 3) & ~(size_t)3;
+    size_t old = _count;
+
+    _px.resize(padded, 0.0f);
+    _py.resize(padded, 0.0f);
+    _pz.resize(padded, 0.0f);
+    _qx.resize(padded, 0.0f);
+    _qy.resize(padded, 0.0f);
+    _qz.resize(padded, 0.0f);
+    _qw.resize(padded, 1.0f);
+    _sx.resize(padded, 1.0f);
+    _sy.resize(padded, 1.0f);
+    _sz.resize(padded, 1.0f);
+    _packed.resize(padded * FLOATS_PER_OBJECT);
+
+    // Slots from old to the previous padding may hold stale data, reset them
+    for (size_t i = old; i < padded && i < _padded; ++i)
+    {
+        _px[i] = _py[i] = _pz[i] = 0.0f;
+        _qx[i] = _qy[i] = _qz[i] = 0.0f;
+        _qw[i] = 1.0f;
+        _sx[i] = _sy[i] = _sz[i] = 1.0f;
+    }
+    _count = count;
+    _padded = padded;
+}
+
+void xlTransformBatch::SetPosition(size_t idx, const glm::vec3& p)
+{
+    _px[idx] = p.x;
+    _py[idx] = p.y;
+    _pz[idx] = p.z;
+}
+
+void xlTransformBatch::SetRotation(size_t idx, float radians, const glm::vec3& axis)
+{
+    float len = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    if ( len == 0.0f )
+    {
+        SetRotation(idx, 0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+    float s = std::sin(radians * 0.5f) / len;
+    SetRotation(idx, axis.x * s, axis.y * s, axis.z * s, std::cos(radians * 0.5f));
+}
+
+void xlTransformBatch::SetRotation(size_t idx, float x, float y, float z, float w)
+{
+    _qx[idx] = x;
+    _qy[idx] = y;
+    _qz[idx] = z;
+    _qw[idx] = w;
+}
+
+void xlTransformBatch::SetScale(size_t idx, const glm::vec3& s)
+{
+    _sx[idx] = s.x;
+    _sy[idx] = s.y;
+    _sz[idx] = s.z;
+}
+
+// Writes one column for each of four objects: lanes a, b, c, d hold the column
+// rows of the four objects, transposed so each object gets a contiguous texel.
+static inline void StoreColumn(float* out, float4 a, float4 b, float4 c, float4 d)
+{
+    Transpose4(a, b, c, d);
+    const int stride = xlTransformBatch::FLOATS_PER_OBJECT;
+    Store4(out, a);
+    Store4(out + stride, b);
+    Store4(out + stride * 2, c);
+    Store4(out + stride * 3, d);
+}
+
+void xlTransformBatch::Compute()
+{
+    const float4 one = Set4(1.0f);
+    const float4 two = Set4(2.0f);
+    const float4 zero = Set4(0.0f);
+
+    for (size_t i = 0; i < _padded; i += 4)
+    {
+        float4 x = Load4(&_qx[i]);
+        float4 y = Load4(&_qy[i]);
+        float4 z = Load4(&_qz[i]);
+        float4 w = Load4(&_qw[i]);
+
+        // Normalize, small drift from callers building quaternions themselves
+        // would otherwise show up as scale
+        float4 n2 = Add(Add(Mul(x, x), Mul(y, y)), Add(Mul(z, z), Mul(w, w)));
+        float4 k = Div(two, n2);
+
+        float4 xx = Mul(Mul(x, x), k), yy = Mul(Mul(y, y), k), zz = Mul(Mul(z, z), k);
+        float4 xy = Mul(Mul(x, y), k), xz = Mul(Mul(x, z), k), yz = Mul(Mul(y, z), k);
+        float4 wx = Mul(Mul(w, x), k), wy = Mul(Mul(w, y), k), wz = Mul(Mul(w, z), k);
+
+        // Rotation matrix columns
+        float4 r00 = Sub(one, Add(yy, zz)), r01 = Add(xy, wz), r02 = Sub(xz, wy);
+        float4 r10 = Sub(xy, wz), r11 = Sub(one, Add(xx, zz)), r12 = Add(yz, wx);
+        float4 r20 = Add(xz, wy), r21 = Sub(yz, wx), r22 = Sub(one, Add(xx, yy));
+
+        float4 sx = Load4(&_sx[i]);
+        float4 sy = Load4(&_sy[i]);
+        float4 sz = Load4(&_sz[i]);
+
+        float* out = &_packed[i * FLOATS_PER_OBJECT];
+
+        // model = translate * rotate * scale
+        StoreColumn(out,      Mul(r00, sx), Mul(r01, sx), Mul(r02, sx), zero);
+        StoreColumn(out + 4,  Mul(r10, sy), Mul(r11, sy), Mul(r12, sy), zero);
+        StoreColumn(out + 8,  Mul(r20, sz), Mul(r21, sz), Mul(r22, sz), zero);
+        StoreColumn(out + 12, Load4(&_px[i]), Load4(&_py[i]), Load4(&_pz[i]), one);
+
+        // transpose(inverse(R * S)) == R * inverse(S)
+        StoreColumn(out + 16, Div(r00, sx), Div(r01, sx), Div(r02, sx), zero);
+        StoreColumn(out + 20, Div(r10, sy), Div(r11, sy), Div(r12, sy), zero);
+        StoreColumn(out + 24, Div(r20, sz), Div(r21, sz), Div(r22, sz), zero);
+    }
+}
+
+static void SendToBuffer(GLuint& buffer, GLuint& texture, size_t& capacity,
+                         const float* data, size_t count)
+{
+    OnGLError(OGL_ERR_CLEAR); //clear error stack
+
+    if ( !buffer )
+        glGenBuffers(1, &buffer);
+    if ( !texture )
+        glGenTextures(1, &texture);
+
+    GLsizeiptr bytes = count * xlTransformBatch::FLOATS_PER_OBJECT * sizeof(GLfloat);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if ( count > capacity )
+    {
+        capacity = count;
+        glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+        // A new store must be attached to the texture again
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    else
+    {
+        // Orphan the old store so we don't wait for draws still reading it
+        glBufferData(GL_TEXTURE_BUFFER, capacity * xlTransformBatch::FLOATS_PER_OBJECT * sizeof(GLfloat),
+                     NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    OnGLError(OGL_ERR_BUFFER);
+}
+
+void xlTransformBatch::Upload()
+{
+    if ( _count == 0 )
+        return;
+    SendToBuffer(_buffer, _texture, _gpuCapacity, &_packed[0], _count);
+}
+
+size_t xlTransformBatch::UploadSubset(const std::vector<unsigned int>& indices)
+{
+    if ( indices.empty() )
+        return 0;
+
+    _gather.resize(indices.size() * FLOATS_PER_OBJECT);
+    float* dst = &_gather[0];
+    for (unsigned int idx : indices)
+    {
+        const float* src = GetObjectData(idx);
+        for (int f = 0; f < FLOATS_PER_OBJECT; f += 4)
+            Store4(dst + f, Load4(src + f));
+        dst += FLOATS_PER_OBJECT;
+    }
+    SendToBuffer(_buffer, _texture, _gpuCapacity, &_gather[0], indices.size());
+    return indices.size();
+}
+
+void xlTransformBatch::Bind(GLuint textureUnit)
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    glActiveTexture(GL_TEXTURE0);
+}
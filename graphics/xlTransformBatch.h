@@ -0,0 +1,70 @@
+#ifndef XLTRANSFORMBATCH_H
+#define XLTRANSFORMBATCH_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+//-----------------------------------------------------------------------------
+// Position, rotation (quaternion) and scale for many objects, kept as separate
+// arrays so the model and normal matrices can be built four objects at a time.
+// The results go to a texture buffer the vertex shader reads with texelFetch,
+// TEXELS_PER_OBJECT RGBA32F texels per object:
+//   0-3  model matrix columns
+//   4-6  normal matrix columns (rotation * inverse scale, w unused)
+// so the shader no longer needs transpose(inverse(model)) per vertex.
+class xlTransformBatch
+{
+public:
+    static const int TEXELS_PER_OBJECT = 7;
+    static const int FLOATS_PER_OBJECT = TEXELS_PER_OBJECT * 4;
+
+    xlTransformBatch();
+    ~xlTransformBatch();
+
+    void Clear();
+    // New objects start at the origin, unrotated and unit scale
+    void Resize(size_t count);
+    size_t Size() const { return _count; }
+
+    void SetPosition(size_t idx, const glm::vec3& p);
+    void SetRotation(size_t idx, float radians, const glm::vec3& axis);
+    void SetRotation(size_t idx, float x, float y, float z, float w);
+    void SetScale(size_t idx, const glm::vec3& s);
+
+    // Direct access for filling many objects at once
+    float* PositionX() { return &_px[0]; }
+    float* PositionY() { return &_py[0]; }
+    float* PositionZ() { return &_pz[0]; }
+
+    // Build the matrices of every object
+    void Compute();
+    // Packed matrices of one object, valid after Compute()
+    const float* GetObjectData(size_t idx) const { return &_packed[idx * FLOATS_PER_OBJECT]; }
+
+    // Send the computed matrices to the GPU and bind the buffer texture to the unit
+    void Upload();
+    void Bind(GLuint textureUnit);
+
+    // Upload only part of the objects (e.g. the visible ones) gathered in order,
+    // returns how many were uploaded
+    size_t UploadSubset(const std::vector<unsigned int>& indices);
+
+private:
+    size_t _count;
+    size_t _padded; // _count rounded up to a multiple of four
+
+    std::vector<float> _px, _py, _pz;
+    std::vector<float> _qx, _qy, _qz, _qw;
+    std::vector<float> _sx, _sy, _sz;
+    std::vector<float> _packed;
+    std::vector<float> _gather;
+
+    GLuint _buffer;
+    GLuint _texture;
+    size_t _gpuCapacity; // objects the GPU buffer can hold
+};
+
+#endif // XLTRANSFORMBATCH_H
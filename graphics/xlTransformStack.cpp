@@ -0,0 +1,155 @@
+#include "xlTransformStack.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <log4cpp/Category.hh>
+
+#include "xlSIMD.h"
+
+static inline void Multiply(glm::mat4 &a, const glm::mat4 &b) {
+    xlSIMD::MultiplyMat4(glm::value_ptr(a), glm::value_ptr(b), glm::value_ptr(a));
+}
+
+xlTransformStack::xlTransformStack() {
+    Reset(glm::mat4(1.0f));
+}
+
+void xlTransformStack::Reset(const glm::mat4 &p) {
+    projection = p;
+    current.base = p;
+    current.model = glm::mat4(1.0f);
+    current.preModel = glm::mat4(1.0f);
+    current.view = glm::mat4(1.0f);
+    current.modelIdentity = true;
+    current.preModelIdentity = true;
+    mvpDirty = true;
+    modelDirty = true;
+}
+
+// A view operation after model operations can't be reordered in front of them,
+// move the model operations so far into base so the view operation applies after
+void xlTransformStack::FoldModel() {
+    if (current.modelIdentity) {
+        return;
+    }
+    Multiply(current.base, current.model);
+    if (current.preModelIdentity) {
+        current.preModel = current.model;
+    } else {
+        Multiply(current.preModel, current.model);
+    }
+    current.preModelIdentity = false;
+    current.model = glm::mat4(1.0f);
+    current.modelIdentity = true;
+    modelDirty = true;
+}
+
+void xlTransformStack::TranslateModel(float x, float y, float z) {
+    xlSIMD::TranslateMat4(glm::value_ptr(current.model), x, y, z);
+    ModelChanged();
+}
+
+void xlTransformStack::RotateModel(float radians, float x, float y, float z) {
+    glm::mat4 r = glm::rotate(glm::mat4(1.0f), radians, glm::vec3(x, y, z));
+    if (current.modelIdentity) {
+        current.model = r;
+    } else {
+        Multiply(current.model, r);
+    }
+    ModelChanged();
+}
+
+void xlTransformStack::ScaleModel(float w, float h, float z) {
+    xlSIMD::ScaleMat4(glm::value_ptr(current.model), w, h, z);
+    ModelChanged();
+}
+
+void xlTransformStack::ApplyModel(const glm::mat4 &m) {
+    if (current.modelIdentity) {
+        current.model = m;
+    } else {
+        Multiply(current.model, m);
+    }
+    ModelChanged();
+}
+
+void xlTransformStack::SetModel(const glm::mat4 &m) {
+    // MVP = MVP * m, but the model matrix itself becomes just m
+    if (!current.modelIdentity) {
+        Multiply(current.base, current.model);
+    }
+    current.model = m;
+    current.preModel = glm::mat4(1.0f);
+    current.preModelIdentity = true;
+    ModelChanged();
+}
+
+void xlTransformStack::TranslateView(float x, float y, float z) {
+    FoldModel();
+    xlSIMD::TranslateMat4(glm::value_ptr(current.base), x, y, z);
+    xlSIMD::TranslateMat4(glm::value_ptr(current.view), x, y, z);
+    mvpDirty = true;
+}
+
+void xlTransformStack::ScaleView(float w, float h, float z) {
+    FoldModel();
+    xlSIMD::ScaleMat4(glm::value_ptr(current.base), w, h, z);
+    xlSIMD::ScaleMat4(glm::value_ptr(current.view), w, h, z);
+    mvpDirty = true;
+}
+
+void xlTransformStack::ApplyView(const glm::mat4 &m) {
+    FoldModel();
+    Multiply(current.base, m);
+    Multiply(current.view, m);
+    mvpDirty = true;
+}
+
+bool xlTransformStack::Push() {
+    if (depth >= MAX_DEPTH) {
+        static log4cpp::Category& logger_opengl = log4cpp::Category::getInstance(std::string("log_opengl"));
+        logger_opengl.error("Matrix stack overflow, more than %d PushMatrix calls without a PopMatrix.", MAX_DEPTH);
+        // still count it so the matching Pop doesn't unwind someone else's state
+        depth++;
+        return false;
+    }
+    stack[depth++] = current;
+    return true;
+}
+
+bool xlTransformStack::Pop() {
+    if (depth == 0) {
+        return false;
+    }
+    depth--;
+    if (depth >= MAX_DEPTH) {
+        return false;
+    }
+    current = stack[depth];
+    mvpDirty = true;
+    modelDirty = true;
+    return true;
+}
+
+const glm::mat4 &xlTransformStack::GetMVP() {
+    if (current.modelIdentity) {
+        return current.base;
+    }
+    if (mvpDirty) {
+        xlSIMD::MultiplyMat4(glm::value_ptr(current.base), glm::value_ptr(current.model), glm::value_ptr(mvp));
+        mvpDirty = false;
+    }
+    return mvp;
+}
+
+const glm::mat4 &xlTransformStack::GetModel() {
+    if (current.preModelIdentity) {
+        return current.model;
+    }
+    if (modelDirty) {
+        xlSIMD::MultiplyMat4(glm::value_ptr(current.preModel), glm::value_ptr(current.model), glm::value_ptr(fullModel));
+        modelDirty = false;
+    }
+    return fullModel;
+}
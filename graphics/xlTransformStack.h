@@ -0,0 +1,67 @@
+#pragma once
+
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <glm/mat4x4.hpp>
+#include <glm/glm.hpp>
+
+// Tracks the projection, view and model transforms of a graphics context.
+//
+// The draw code needs MVP, but the callers build it a step at a time and most
+// steps are never drawn with.  Each operation only updates its own factor and
+// MVP (and the full model matrix) are composed when asked for.  Operations are
+// applied in call order exactly like multiplying MVP directly: view operations
+// made after model operations fold the model so far into the base.
+//
+// Push/Pop use a fixed inline array so there is no allocation per model.
+class xlTransformStack {
+public:
+    static const int MAX_DEPTH = 32;
+
+    xlTransformStack();
+
+    // start a new frame with the given projection, view and model reset to identity
+    void Reset(const glm::mat4 &projection);
+
+    void TranslateModel(float x, float y, float z);
+    void RotateModel(float radians, float x, float y, float z);
+    void ScaleModel(float w, float h, float z);
+    void ApplyModel(const glm::mat4 &m);
+    // replaces the model matrix, but like before MVP keeps what was already applied
+    void SetModel(const glm::mat4 &m);
+
+    void TranslateView(float x, float y, float z);
+    void ScaleView(float w, float h, float z);
+    void ApplyView(const glm::mat4 &m);
+
+    bool Push();
+    bool Pop();
+    int GetDepth() const { return depth; }
+
+    const glm::mat4 &GetMVP();
+    const glm::mat4 &GetModel();
+    const glm::mat4 &GetView() const { return current.view; }
+    const glm::mat4 &GetProjection() const { return projection; }
+
+private:
+    struct State {
+        glm::mat4 base;     // projection, view and any model operations before the last view operation
+        glm::mat4 model;    // model operations since the last view operation
+        glm::mat4 preModel; // model operations folded into base
+        glm::mat4 view;
+        bool modelIdentity;
+        bool preModelIdentity;
+    };
+    void FoldModel();
+    void ModelChanged() { current.modelIdentity = false; mvpDirty = true; modelDirty = true; }
+
+    State current;
+    State stack[MAX_DEPTH];
+    int depth = 0;
+
+    glm::mat4 projection;
+    glm::mat4 mvp;
+    glm::mat4 fullModel;
+    bool mvpDirty = true;
+    bool modelDirty = true;
+};
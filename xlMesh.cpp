@@ -0,0 +1,57 @@
+#include "xlMesh.h"
+
+#include <filesystem>
+
+#include <wx/image.h>
+
+#include <log4cpp/Category.hh>
+
+#include "graphics/xlGraphicsContext.h"
+
+xlMesh::xlMesh(xlGraphicsContext *ctx, const std::string &file) : graphicsContext(ctx), filename(file) {
+    static log4cpp::Category &logger_base = log4cpp::Category::getInstance(std::string("log_base"));
+    loaded = objects.Load(file);
+
+    materials.resize(objects.materials.size());
+    for (size_t x = 0; x < objects.materials.size(); x++) {
+        const xlObjMesh::Material &om = objects.materials[x];
+        Material &m = materials[x];
+        m.name = om.name;
+        m.color = xlColor(om.diffuse[0] * 255.0f, om.diffuse[1] * 255.0f, om.diffuse[2] * 255.0f, om.alpha * 255.0f);
+        if (!om.diffuseTexture.empty()) {
+            std::error_code ec;
+            wxImage image;
+            if (std::filesystem::exists(om.diffuseTexture, ec) && image.LoadFile(om.diffuseTexture)) {
+                // OBJ texture coordinates have v going up
+                m.texture = ctx->createTexture(image.Mirror(false));
+                m.texture->SetName(om.diffuseTexture);
+                m.texture->Finalize();
+            } else {
+                logger_base.warn("Could not load texture %s for mesh %s.", om.diffuseTexture.c_str(), file.c_str());
+            }
+        }
+    }
+}
+
+xlMesh::~xlMesh() {
+    for (auto &m : materials) {
+        if (m.texture) {
+            delete m.texture;
+        }
+    }
+}
+
+void xlMesh::SetMaterialColor(const std::string &name, const xlColor *c) {
+    for (size_t x = 0; x < materials.size(); x++) {
+        if (materials[x].name == name) {
+            if (c) {
+                materials[x].color = *c;
+                materials[x].forceColor = true;
+            } else {
+                const xlObjMesh::Material &om = objects.materials[x];
+                materials[x].color = xlColor(om.diffuse[0] * 255.0f, om.diffuse[1] * 255.0f, om.diffuse[2] * 255.0f, om.alpha * 255.0f);
+                materials[x].forceColor = false;
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Color.h"
+#include "graphics/xlObjLoader.h"
+
+class xlGraphicsContext;
+class xlTexture;
+
+// A 3D prop loaded from an OBJ file.  The graphics context subclasses it to
+// hold the GPU buffers, see xlGraphicsContext::loadMeshFromObjFile.
+class xlMesh {
+public:
+    class Material {
+    public:
+        std::string name;
+        xlColor color;
+        xlTexture *texture = nullptr;
+        bool forceColor = false;
+    };
+
+    xlMesh(xlGraphicsContext *ctx, const std::string &file);
+    virtual ~xlMesh();
+
+    const std::string &GetFilename() const { return filename; }
+    bool IsLoaded() const { return loaded; }
+
+    int GetMaterialCount() const { return materials.size(); }
+    const Material &GetMaterial(int idx) const { return materials[idx]; }
+    // Overrides the color (and texture) of the named material, nullptr to restore it
+    void SetMaterialColor(const std::string &name, const xlColor *c);
+
+    const xlObjMesh &GetObjects() const { return objects; }
+
+protected:
+    xlGraphicsContext *graphicsContext;
+    std::string filename;
+    bool loaded = false;
+
+    xlObjMesh objects;
+    std::vector<Material> materials;
+};